@@ -0,0 +1,477 @@
+/*
+;Copyright (c) 2024 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// bulk.c: file data transfer - LOAD, SAVE, GETBYTES and PUTBYTES,
+// along with OPEN and CLOSE to manage the handles used by the latter.
+//
+// Data sent to the client goes to the port it nominated in the URD
+// slot of the request, in blocks as large as a single econet frame
+// can carry, so each four-way handshake moves as many bytes as
+// possible. Data from the client arrives on the worker's data port
+// and each block except the last is acknowledged on the client's ack port
+// (again nominated in the URD slot).
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/econet.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "message.h"
+#include "fspath.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include "bulk.h"
+
+#define DEFAULT_LOADEXEC   0xffffffff
+#define DEFAULT_ACCESS     0x0f     // owner and public read/write
+
+//------------------------------------------------------------
+// Little endian field helpers
+static uint32_t
+get_le24(const uint8_t *ptr)
+{
+   return ptr[0] | ptr[1] << 8 | ptr[2] << 16;
+}
+
+static void
+put_le24(uint8_t *ptr, uint32_t val)
+{
+   ptr[0] = val;
+   ptr[1] = val >> 8;
+   ptr[2] = val >> 16;
+}
+
+static void
+put_le32(uint8_t *ptr, uint32_t val)
+{
+   put_le24(ptr, val);
+   ptr[3] = val >> 24;
+}
+
+//------------------------------------------------------------
+// Translate the filename in a request, relative to the station's
+// CSD, sending an error reply if it's not valid.
+static bool
+get_path(NetFSMsg *msg, const uint8_t *name, char *path)
+{
+   int rc = -EINVAL;
+   if(name < msg->payload + msg->paysize)
+      rc = session_path(msg->session, msg->csd, name, path, FSPATH_MAX);
+
+   if(rc == -EBADF) {
+      econet_send_error(msg, FSERR_CHANNEL, "Channel");
+      return false;
+   }
+   if(rc < 0) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return false;
+   }
+   return true;
+}
+
+//------------------------------------------------------------
+// Find the file for a LOAD. Loads of commands (FC_LOADCOMMAND)
+// look in the library if the file isn't in the CSD.
+// Sends an error reply and returns false if it isn't found.
+static bool
+find_load_path(NetFSMsg *msg, char *path)
+{
+   if(!get_path(msg, msg->payload, path)) return false;
+
+   int type = pathcache_lookup(path);
+   if(type == PC_MISSING && msg->function_code == FC_LOADCOMMAND &&
+         session_path(msg->session, msg->lib, msg->payload, path, FSPATH_MAX) >= 0)
+      type = pathcache_lookup(path);
+
+   if(type == PC_MISSING || type == PC_DIR) {
+      econet_send_errno(msg, -ENOENT);
+      return false;
+   }
+   return true;
+}
+
+//------------------------------------------------------------
+// Send count bytes from offset in the file to the client's data port,
+// padding with zeros past end of file since the client expects
+// exactly the amount it asked for. Each block is read from disc
+// while the previous one is still being sent. Nothing is being sent
+// before the first block, so that's read straight into the econet
+// transmit buffer instead of being copied there.
+// Returns the number of bytes that came from the file, or <0
+// if the client stopped listening.
+static int32_t
+stream_to_client(NetFSMsg *msg, int fd, uint32_t offset, uint32_t count)
+{
+   uint32_t sent = 0;
+   uint32_t from_file = 0;
+   bool eof = false;
+   uint8_t *xfer_buf = msg->worker->buf;
+
+   while(sent < count) {
+      size_t blksize = count - sent;
+      if(blksize > ECONET_MAX_PAYLOAD) blksize = ECONET_MAX_PAYLOAD;
+
+      uint8_t *buf = sent == 0 ? econet_get_txbuf(msg) : NULL;
+      if(buf == NULL) buf = xfer_buf;
+
+      ssize_t got = 0;
+      if(!eof) {
+         got = pread(fd, buf, blksize, offset + from_file);
+         if(got < 0) got = 0;
+         if(got < blksize) eof = true;
+      }
+      if(got < blksize)
+         memset(buf + got, 0, blksize - got);
+
+      int rc;
+      if(buf == xfer_buf) {
+         rc = econet_send_wait(msg);
+         if(rc == 0) rc = econet_send_async(msg, msg->urd, xfer_buf, blksize);
+      }
+      else
+         rc = econet_send_txbuf(msg, msg->urd, blksize);
+      if(rc < 0) return rc;
+
+      sent += blksize;
+      from_file += got;
+   }
+
+   int rc = econet_send_wait(msg);
+   if(rc < 0) return rc;
+
+   return from_file;
+}
+
+//------------------------------------------------------------
+// Receive count bytes from the client and write them to the file
+// at offset.
+// The data still has to be received if the write fails, so the
+// client doesn't hang; *write_err records the failure.
+// Returns the number of bytes received, or <0 if the client went
+// away.
+static int32_t
+stream_from_client(NetFSMsg *msg, int fd, uint32_t offset, uint32_t count,
+      int *write_err)
+{
+   uint32_t received = 0;
+   uint8_t ack = 0;
+   uint8_t *xfer_buf = msg->worker->buf;
+   *write_err = 0;
+
+   while(received < count) {
+      ssize_t got = econet_recv_data(msg, xfer_buf, NETFS_RX_BLOCKSZ + 2,
+            NETFS_DATA_TIMEOUT);
+      if(got <= 0) {
+         printf("bulk: data from %d.%d timed out\n",
+               msg->reply_net, msg->reply_station);
+         return -ETIMEDOUT;
+      }
+
+      if(got > count - received) got = count - received;
+
+      if(!*write_err) {
+         ssize_t written = pwrite(fd, xfer_buf + 2, got, offset + received);
+         if(written < 0)
+            *write_err = -errno;
+         else if(written < got)
+            *write_err = -ENOSPC;
+      }
+
+      received += got;
+
+      // the final reply acknowledges the last block
+      if(received < count) {
+         int rc = econet_send_port(msg, msg->urd, &ack, 1);
+         if(rc < 0) return rc;
+      }
+   }
+
+   return received;
+}
+
+//------------------------------------------------------------
+// FC_LOAD / FC_LOADCOMMAND
+// Request: filename
+// Reply: load(4), exec(4), size(3), access, date(2), then the data
+// is sent to the data port, followed by a final reply.
+void
+bulk_load(NetFSMsg *msg)
+{
+   char path[FSPATH_MAX];
+   uint8_t reply[16];
+   struct stat st;
+
+   if(!find_load_path(msg, path)) return;
+
+   int fd = open(path, O_RDONLY);
+   if(fd < 0) {
+      econet_send_errno(msg, -errno);
+      return;
+   }
+
+   if(fstat(fd, &st) < 0) {
+      econet_send_errno(msg, -errno);
+      close(fd);
+      return;
+   }
+
+   // FAT has nowhere to keep load and exec addresses
+   reply[0] = 0;
+   reply[1] = 0;
+   put_le32(reply + 2, DEFAULT_LOADEXEC);
+   put_le32(reply + 6, DEFAULT_LOADEXEC);
+   put_le24(reply + 10, st.st_size);
+   reply[13] = DEFAULT_ACCESS;
+   reply[14] = 0;
+   reply[15] = 0;
+   econet_send(msg, reply, sizeof(reply));
+
+   int32_t rc = stream_to_client(msg, fd, 0, st.st_size);
+   close(fd);
+   if(rc < 0) return;
+
+   econet_send(msg, reply, 2);
+}
+
+//------------------------------------------------------------
+// FC_SAVE
+// Request: load(4), exec(4), size(3), filename
+// Reply: data port, max block size(2). After the data has been
+// received: access, date(2).
+void
+bulk_save(NetFSMsg *msg)
+{
+   char path[FSPATH_MAX];
+   uint8_t reply[5];
+
+   if(msg->paysize < 12) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return;
+   }
+
+   uint32_t size = get_le24(msg->payload + 8);
+   if(!get_path(msg, msg->payload + 11, path)) return;
+
+   int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC);
+   if(fd < 0) {
+      econet_send_errno(msg, -errno);
+      return;
+   }
+   pathcache_invalidate(path);
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = msg->worker->data_port;
+   reply[3] = NETFS_RX_BLOCKSZ & 0xff;
+   reply[4] = NETFS_RX_BLOCKSZ >> 8;
+   econet_send(msg, reply, sizeof(reply));
+
+   int write_err;
+   int32_t rc = stream_from_client(msg, fd, 0, size, &write_err);
+   close(fd);
+   dircache_invalidate_parent(path);
+   if(rc < 0) return;
+
+   if(write_err < 0) {
+      econet_send_errno(msg, write_err);
+      return;
+   }
+
+   reply[2] = DEFAULT_ACCESS;
+   reply[3] = 0;
+   reply[4] = 0;
+   econet_send(msg, reply, sizeof(reply));
+}
+
+//------------------------------------------------------------
+// FC_OPEN
+// Request: must exist flag, read only flag, filename
+// Reply: handle
+void
+bulk_open(NetFSMsg *msg)
+{
+   char path[FSPATH_MAX];
+   uint8_t reply[3];
+
+   if(msg->paysize < 3) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return;
+   }
+
+   bool must_exist = msg->payload[0];
+   bool read_only = msg->payload[1];
+   if(!get_path(msg, msg->payload + 2, path)) return;
+
+   // O_CREAT truncates, so only use it if the file isn't there
+   bool missing = pathcache_lookup(path) == PC_MISSING;
+   if(missing && (must_exist || read_only)) {
+      econet_send_errno(msg, -ENOENT);
+      return;
+   }
+
+   int fd = open(path, missing ? O_RDWR|O_CREAT : (read_only ? O_RDONLY : O_RDWR));
+   if(fd < 0) {
+      econet_send_errno(msg, -errno);
+      return;
+   }
+   if(missing) {
+      pathcache_invalidate(path);
+      dircache_invalidate_parent(path);
+   }
+
+   int handle = session_alloc_file(msg->session, fd);
+   if(handle < 0) {
+      close(fd);
+      econet_send_errno(msg, handle);
+      return;
+   }
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = handle;
+   econet_send(msg, reply, sizeof(reply));
+}
+
+//------------------------------------------------------------
+// FC_CLOSE
+// Request: handle, or 0 to close everything.
+void
+bulk_close(NetFSMsg *msg)
+{
+   uint8_t reply[2] = { 0, 0 };
+   uint8_t handle = msg->paysize > 0 ? msg->payload[0] : 0;
+
+   if(handle == 0) {
+      session_close_files(msg->session);
+   }
+   else {
+      int fd = session_file(msg->session, handle);
+      if(fd < 0) {
+         econet_send_error(msg, FSERR_CHANNEL, "Channel");
+         return;
+      }
+      close(fd);
+      session_free_file(msg->session, handle);
+   }
+
+   econet_send(msg, reply, sizeof(reply));
+}
+
+//------------------------------------------------------------
+// Validate a GETBYTES/PUTBYTES request and get the handle's
+// sequential pointer, which is moved to the offset if one's given.
+// Request: handle, use pointer flag, count(3), offset(3)
+// Returns the fd, or -1 if an error reply has been sent.
+static int
+start_random_access(NetFSMsg *msg, uint32_t *count, uint32_t **ptr)
+{
+   if(msg->paysize < 8) {
+      econet_send_error(msg, FSERR_CHANNEL, "Channel");
+      return -1;
+   }
+
+   int fd = session_file(msg->session, msg->payload[0]);
+   if(fd < 0) {
+      econet_send_error(msg, FSERR_CHANNEL, "Channel");
+      return -1;
+   }
+
+   bool use_ptr = msg->payload[1];
+   *count = get_le24(msg->payload + 2);
+   *ptr = session_file_ptr(msg->session, msg->payload[0]);
+
+   if(!use_ptr)
+      **ptr = get_le24(msg->payload + 5);
+   return fd;
+}
+
+//------------------------------------------------------------
+// FC_GETBYTES
+// Reply: an empty reply, then the data is sent to the data port,
+// then a final reply: EOF flag, bytes actually read (3).
+void
+bulk_getbytes(NetFSMsg *msg)
+{
+   uint8_t reply[6];
+   uint32_t count;
+   uint32_t *ptr;
+
+   int fd = start_random_access(msg, &count, &ptr);
+   if(fd < 0) return;
+
+   reply[0] = 0;
+   reply[1] = 0;
+   econet_send(msg, reply, 2);
+
+   int32_t got = stream_to_client(msg, fd, *ptr, count);
+   if(got < 0) return;
+   *ptr += got;
+
+   reply[2] = got < count ? 0x80 : 0;
+   put_le24(reply + 3, got);
+   econet_send(msg, reply, sizeof(reply));
+}
+
+//------------------------------------------------------------
+// FC_PUTBYTES
+// Reply: data port, max block size(2). After the data has been
+// received: zero, bytes written (3).
+void
+bulk_putbytes(NetFSMsg *msg)
+{
+   uint8_t reply[6];
+   uint32_t count;
+   uint32_t *ptr;
+
+   int fd = start_random_access(msg, &count, &ptr);
+   if(fd < 0) return;
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = msg->worker->data_port;
+   reply[3] = NETFS_RX_BLOCKSZ & 0xff;
+   reply[4] = NETFS_RX_BLOCKSZ >> 8;
+   econet_send(msg, reply, 5);
+
+   int write_err;
+   int32_t got = stream_from_client(msg, fd, *ptr, count, &write_err);
+
+   // the file's length may have changed, and only the fd is known
+   dircache_invalidate_all();
+   if(got < 0) return;
+   *ptr += got;
+
+   if(write_err < 0) {
+      econet_send_errno(msg, write_err);
+      return;
+   }
+
+   reply[2] = 0;
+   put_le24(reply + 3, got);
+   econet_send(msg, reply, sizeof(reply));
+}
@@ -0,0 +1,21 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include "message.h"
+
+// Largest block we ask clients to send during SAVE/PUTBYTES. Kept
+// well under the 2K receive ring, which is shared with all other
+// traffic on the network.
+#define NETFS_RX_BLOCKSZ   1024
+
+// How long to wait for the next block of data from a client (ms)
+#define NETFS_DATA_TIMEOUT 5000
+
+void bulk_load(NetFSMsg *msg);
+void bulk_save(NetFSMsg *msg);
+void bulk_open(NetFSMsg *msg);
+void bulk_close(NetFSMsg *msg);
+void bulk_getbytes(NetFSMsg *msg);
+void bulk_putbytes(NetFSMsg *msg);
+
+#endif
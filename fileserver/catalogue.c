@@ -0,0 +1,330 @@
+/*
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// catalogue.c: directory listings - EXAMINE, and the requests a
+// client makes for the heading of a *CAT. Listings are served from
+// the snapshots kept by dircache.c.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/econet.h>
+#include <sys/statfs.h>
+
+#include "message.h"
+#include "dircache.h"
+#include "catalogue.h"
+
+// EXAMINE formats
+#define EXAMINE_ALL        0        // CatEntry, machine readable
+#define EXAMINE_LONGTXT    1        // all the information as text
+#define EXAMINE_NAME       2        // name length, then the name
+#define EXAMINE_SHORTTXT   3        // name and access as text
+
+#define EXAMINE_HDR        4        // command, result, count, cycle
+#define TEXT_END           0x80     // follows the text formats
+
+//------------------------------------------------------------
+// Get the directory named in a request. No name at all means the
+// CSD. Sends an error reply and returns false if it's not valid.
+static bool
+get_dir_path(NetFSMsg *msg, const uint8_t *name, char *path)
+{
+   int rc = -EINVAL;
+
+   if(name < msg->payload + msg->paysize) {
+      const uint8_t *p = name;
+      while(*p == ' ') p++;
+
+      if(*p == 0x0d || *p == 0) {
+         const char *csd = session_dir(msg->session, msg->csd);
+         rc = csd ? 0 : -EBADF;
+         if(csd) strcpy(path, csd);
+      }
+      else {
+         rc = session_path(msg->session, msg->csd, name, path, FSPATH_MAX);
+      }
+   }
+
+   if(rc == -EBADF) {
+      econet_send_error(msg, FSERR_CHANNEL, "Channel");
+      return false;
+   }
+   if(rc < 0) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return false;
+   }
+   return true;
+}
+
+// The Acorn name of a directory: its last component, or $ for the root
+static void
+dir_name(char *dest, const char *path)
+{
+   const char *leaf = strrchr(path, '/');
+   leaf = leaf ? leaf + 1 : path;
+   fat_to_acorn_name(dest, *leaf ? leaf : "$");
+}
+
+// Access as text, e.g. WR/r or D/
+static void
+access_str(char *dest, uint8_t access)
+{
+   if(access & ACCESS_DIR) *dest++ = 'D';
+   if(access & ACCESS_LOCKED) *dest++ = 'L';
+   if(access & ACCESS_OWNER_W) *dest++ = 'W';
+   if(access & ACCESS_OWNER_R) *dest++ = 'R';
+   *dest++ = '/';
+   if(access & ACCESS_PUBLIC_W) *dest++ = 'w';
+   if(access & ACCESS_PUBLIC_R) *dest++ = 'r';
+   *dest = 0;
+}
+
+static uint32_t
+get_le(const uint8_t *ptr, int len)
+{
+   uint32_t val = 0;
+   while(len--) val = val << 8 | ptr[len];
+   return val;
+}
+
+static void
+put_le(uint8_t *ptr, uint32_t val, int len)
+{
+   while(len--) {
+      *ptr++ = val;
+      val >>= 8;
+   }
+}
+
+// Format an entry as text for EXAMINE_LONGTXT or EXAMINE_SHORTTXT,
+// including the terminating NUL. Returns the length, or 0 if it
+// doesn't fit.
+static size_t
+format_text(uint8_t *dest, size_t space, const CatEntry *ent, bool long_form)
+{
+   char access[8];
+   int len;
+
+   access_str(access, ent->access);
+   if(long_form)
+      len = snprintf((char *)dest, space, "%-10.10s %08lX %08lX   %06lX   %-6s",
+            ent->name, (unsigned long)get_le(ent->load, 4),
+            (unsigned long)get_le(ent->exec, 4),
+            (unsigned long)get_le(ent->size, 3), access);
+   else
+      len = snprintf((char *)dest, space, "%-10.10s %-6s", ent->name, access);
+
+   return len + 1 <= space ? len + 1 : 0;
+}
+
+//------------------------------------------------------------
+// FC_EXAMINE
+// Request: format, first entry, number of entries, directory name
+// Reply: number of entries, cycle number, then the entries in the
+// format asked for.
+void
+cat_examine(NetFSMsg *msg)
+{
+   uint8_t *reply = msg->worker->buf;
+   char path[FSPATH_MAX];
+   int err;
+
+   if(msg->paysize < 4) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return;
+   }
+
+   uint8_t format = msg->payload[0];
+   uint8_t start = msg->payload[1];
+   uint8_t count = msg->payload[2];
+   if(!get_dir_path(msg, msg->payload + 3, path)) return;
+
+   DirSnapshot *snap = dircache_get(path, &err);
+   if(snap == NULL) {
+      econet_send_errno(msg, err);
+      return;
+   }
+
+   if(start > snap->count) start = snap->count;
+   if(count > snap->count - start) count = snap->count - start;
+
+   // leave room for the terminator of the text formats
+   size_t space = ECONET_MAX_PAYLOAD - EXAMINE_HDR - 1;
+   size_t len = EXAMINE_HDR;
+   int n = 0;
+
+   switch(format) {
+      case EXAMINE_ALL:
+         if(count > space / sizeof(CatEntry)) count = space / sizeof(CatEntry);
+         n = count;
+         memcpy(reply + len, snap->entries + start, n * sizeof(CatEntry));
+         len += n * sizeof(CatEntry);
+         break;
+
+      case EXAMINE_NAME:
+         for(n = 0; n < count && space >= ACORN_NAME_LEN + 1; n++) {
+            reply[len++] = ACORN_NAME_LEN;
+            memcpy(reply + len, snap->entries[start + n].name, ACORN_NAME_LEN);
+            len += ACORN_NAME_LEN;
+            space -= ACORN_NAME_LEN + 1;
+         }
+         break;
+
+      case EXAMINE_LONGTXT:
+      case EXAMINE_SHORTTXT:
+         for(n = 0; n < count; n++) {
+            size_t entlen = format_text(reply + len, space,
+                  &snap->entries[start + n], format == EXAMINE_LONGTXT);
+            if(entlen == 0) break;
+            len += entlen;
+            space -= entlen;
+         }
+         reply[len++] = TEXT_END;
+         break;
+
+      default:
+         econet_send_error(msg, FSERR_BAD_COMMAND, "Bad command");
+         return;
+   }
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = n;
+   reply[3] = snap->cycle;
+   econet_send(msg, reply, len);
+}
+
+//------------------------------------------------------------
+// FC_READ_OBJINFO
+// Only arg 6 (directory name, access and cycle number), which the
+// client uses for the heading of a *CAT, is supported.
+void
+cat_read_objinfo(NetFSMsg *msg)
+{
+   uint8_t *reply = msg->worker->buf;
+   char path[FSPATH_MAX];
+   int err;
+
+   if(msg->paysize < 1 || msg->payload[0] != 6) {
+      econet_send_error(msg, FSERR_BAD_COMMAND, "Bad command");
+      return;
+   }
+   if(!get_dir_path(msg, msg->payload + 1, path)) return;
+
+   DirSnapshot *snap = dircache_get(path, &err);
+   if(snap == NULL) {
+      econet_send_errno(msg, err);
+      return;
+   }
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = ACORN_NAME_LEN;
+   dir_name((char *)reply + 3, path);
+   reply[3 + ACORN_NAME_LEN] = 0;           // owner access
+   reply[4 + ACORN_NAME_LEN] = snap->cycle;
+   econet_send(msg, reply, 5 + ACORN_NAME_LEN);
+}
+
+//------------------------------------------------------------
+// FC_READ_USERENV
+// Reply: disc name length, disc name, CSD name, LIB name, all
+// padded with spaces.
+void
+cat_read_userenv(NetFSMsg *msg)
+{
+   uint8_t *reply = msg->worker->buf;
+   Session *s = msg->session;
+   const char *csd = session_dir(s, msg->csd);
+   const char *lib = session_dir(s, msg->lib);
+   uint8_t *ptr = reply + 3;
+
+   reply[0] = 0;
+   reply[1] = 0;
+   reply[2] = DISC_NAME_LEN;
+
+   memset(ptr, ' ', DISC_NAME_LEN);
+   memcpy(ptr, DISC_NAME, strlen(DISC_NAME));
+   ptr += DISC_NAME_LEN;
+
+   dir_name((char *)ptr, csd ? csd : "");
+   ptr += ACORN_NAME_LEN;
+   dir_name((char *)ptr, lib ? lib : "");
+   ptr += ACORN_NAME_LEN;
+
+   econet_send(msg, reply, ptr - reply);
+}
+
+//------------------------------------------------------------
+// Free space. The kernel keeps the free cluster count up to date,
+// so these don't scan the disc. There's one disc and no quotas, so
+// the disc or user name in the request is ignored.
+static bool
+get_freespace(NetFSMsg *msg, uint64_t *freebytes, uint64_t *sizebytes)
+{
+   struct statfs st;
+   if(statfs("/", &st) < 0) {
+      econet_send_errno(msg, -errno);
+      return false;
+   }
+
+   *freebytes = (uint64_t)st.f_bfree * st.f_bsize;
+   *sizebytes = (uint64_t)st.f_blocks * st.f_bsize;
+   return true;
+}
+
+// FC_READ_FSFREESPACE
+// Reply: free space and disc size, 3 bytes each, in 256 byte sectors.
+void
+cat_read_discfree(NetFSMsg *msg)
+{
+   uint8_t *reply = msg->worker->buf;
+   uint64_t freebytes, sizebytes;
+   if(!get_freespace(msg, &freebytes, &sizebytes)) return;
+
+   freebytes /= FS_SECTOR_SIZE;
+   sizebytes /= FS_SECTOR_SIZE;
+   reply[0] = 0;
+   reply[1] = 0;
+   put_le(reply + 2, freebytes > 0xffffff ? 0xffffff : freebytes, 3);
+   put_le(reply + 5, sizebytes > 0xffffff ? 0xffffff : sizebytes, 3);
+   econet_send(msg, reply, 8);
+}
+
+// FC_ACORN_READ_FREESPACE
+// Reply: the user's free space, 4 bytes, in bytes.
+void
+cat_read_userfree(NetFSMsg *msg)
+{
+   uint8_t *reply = msg->worker->buf;
+   uint64_t freebytes, sizebytes;
+   if(!get_freespace(msg, &freebytes, &sizebytes)) return;
+
+   reply[0] = 0;
+   reply[1] = 0;
+   put_le(reply + 2, freebytes > 0xffffffff ? 0xffffffff : freebytes, 4);
+   econet_send(msg, reply, 6);
+}
@@ -0,0 +1,16 @@
+#ifndef CATALOGUE_H
+#define CATALOGUE_H
+
+#include "message.h"
+
+#define DISC_NAME          "FILESTICK"
+#define DISC_NAME_LEN      16
+#define FS_SECTOR_SIZE     256      // unit of disc free space
+
+void cat_examine(NetFSMsg *msg);
+void cat_read_objinfo(NetFSMsg *msg);
+void cat_read_userenv(NetFSMsg *msg);
+void cat_read_discfree(NetFSMsg *msg);
+void cat_read_userfree(NetFSMsg *msg);
+
+#endif
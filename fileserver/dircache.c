@@ -0,0 +1,195 @@
+/*
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// dircache.c: catalogue snapshots for *CAT and EXAMINE.
+//
+// Clients list a directory a window of entries at a time, so reading
+// the directory afresh for each request would read it from the start
+// every time. Instead the whole directory is read once into a snapshot
+// of ready made catalogue entries, and each window is copied out of
+// that. Anything that changes a directory must invalidate it.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/dirent.h>
+
+#include "dircache.h"
+
+#define DEFAULT_LOADEXEC   0xff     // FAT doesn't store them
+#define FILE_ACCESS        (ACCESS_OWNER_R|ACCESS_OWNER_W|ACCESS_PUBLIC_R|ACCESS_PUBLIC_W)
+
+static DirSnapshot snapshots[DIRCACHE_DIRS];
+static uint32_t use_count;
+static uint8_t next_cycle;
+
+//------------------------------------------------------------
+void
+dircache_init()
+{
+   memset(snapshots, 0, sizeof(snapshots));
+}
+
+static uint32_t
+path_hash(const char *path)
+{
+   uint32_t hash = 2166136261u;
+   while(*path) {
+      hash ^= toupper((unsigned char)*path++);
+      hash *= 16777619;
+   }
+   return hash;
+}
+
+static int
+cmp_entry(const void *a, const void *b)
+{
+   return strncasecmp(((const CatEntry *)a)->name, ((const CatEntry *)b)->name,
+         ACORN_NAME_LEN);
+}
+
+// Read a directory into a snapshot
+static int
+read_snapshot(DirSnapshot *snap, const char *path)
+{
+   struct dirent d;
+
+   int dh = opendir(path);
+   if(dh < 0) return -errno;
+
+   snap->count = 0;
+   while(snap->count < DIRCACHE_MAX && _readdir(dh, &d) >= 0 && d.d_name[0]) {
+      if(snap->count % 16 == 0) {
+         CatEntry *grown = realloc(snap->entries, (snap->count + 16) * sizeof(CatEntry));
+         if(grown == NULL) {
+            closedir(dh);
+            return -ENOMEM;
+         }
+         snap->entries = grown;
+      }
+
+      CatEntry *ent = &snap->entries[snap->count++];
+      memset(ent, 0, sizeof(CatEntry));
+      fat_to_acorn_name(ent->name, d.d_name);
+      memset(ent->load, DEFAULT_LOADEXEC, sizeof(ent->load));
+      memset(ent->exec, DEFAULT_LOADEXEC, sizeof(ent->exec));
+      ent->access = d.d_isdir ? ACCESS_DIR : FILE_ACCESS;
+      if(!d.d_isdir) {
+         ent->size[0] = d.d_size;
+         ent->size[1] = d.d_size >> 8;
+         ent->size[2] = d.d_size >> 16;
+      }
+   }
+   closedir(dh);
+
+   qsort(snap->entries, snap->count, sizeof(CatEntry), cmp_entry);
+   return 0;
+}
+
+//------------------------------------------------------------
+// Get the snapshot of a directory, reading the directory if there
+// isn't one. Returns NULL, with *err set, if it can't be read.
+DirSnapshot *
+dircache_get(const char *path, int *err)
+{
+   uint32_t hash = path_hash(path);
+   DirSnapshot *victim = &snapshots[0];
+
+   for(int i = 0; i < DIRCACHE_DIRS; i++) {
+      DirSnapshot *snap = &snapshots[i];
+      if(snap->valid && snap->hash == hash && !strcasecmp(snap->path, path)) {
+         snap->last_used = ++use_count;
+         return snap;
+      }
+
+      if(!victim->valid) continue;
+      if(!snap->valid || snap->last_used < victim->last_used) victim = snap;
+   }
+
+   if(strlen(path) >= FSPATH_MAX) {
+      *err = -ENAMETOOLONG;
+      return NULL;
+   }
+
+   victim->valid = false;
+   *err = read_snapshot(victim, path);
+   if(*err < 0) return NULL;
+
+   victim->valid = true;
+   victim->hash = hash;
+   victim->last_used = ++use_count;
+   victim->cycle = next_cycle++;
+   strcpy(victim->path, path);
+   return victim;
+}
+
+//------------------------------------------------------------
+// Drop a directory's snapshot, and those of any directories in it.
+void
+dircache_invalidate(const char *path)
+{
+   size_t len = strlen(path);
+
+   for(int i = 0; i < DIRCACHE_DIRS; i++) {
+      DirSnapshot *snap = &snapshots[i];
+      if(snap->valid && !strncasecmp(snap->path, path, len) &&
+            (snap->path[len] == 0 || snap->path[len] == '/'))
+         snap->valid = false;
+   }
+}
+
+// Drop the snapshot of the directory an object is in, e.g. when it's
+// created, deleted or written to.
+void
+dircache_invalidate_parent(const char *path)
+{
+   char parent[FSPATH_MAX];
+
+   const char *slash = strrchr(path, '/');
+   if(slash == NULL) {
+      dircache_invalidate_all();    // relative to the process's cwd
+      return;
+   }
+
+   size_t len = slash - path;
+   if(len == 0) len = 1;            // in the root
+   if(len >= sizeof(parent)) return;
+
+   memcpy(parent, path, len);
+   parent[len] = 0;
+   for(int i = 0; i < DIRCACHE_DIRS; i++) {
+      DirSnapshot *snap = &snapshots[i];
+      if(snap->valid && !strcasecmp(snap->path, parent))
+         snap->valid = false;
+   }
+}
+
+void
+dircache_invalidate_all()
+{
+   for(int i = 0; i < DIRCACHE_DIRS; i++)
+      snapshots[i].valid = false;
+}
@@ -0,0 +1,47 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fspath.h"
+
+#define DIRCACHE_DIRS      4        // directories snapshotted at once
+#define DIRCACHE_MAX       255      // entries; EXAMINE numbers them with a byte
+
+// A catalogue entry, laid out as EXAMINE arg 0 sends it
+typedef struct {
+   char           name[ACORN_NAME_LEN];   // padded with spaces
+   uint8_t        load[4];
+   uint8_t        exec[4];
+   uint8_t        access;
+   uint8_t        date[2];
+   uint8_t        sin[3];
+   uint8_t        size[3];
+} __attribute__((packed)) CatEntry;
+
+typedef struct {
+   bool           valid;
+   uint32_t       hash;
+   uint32_t       last_used;
+   uint8_t        cycle;            // changes whenever the snapshot is rebuilt
+   uint16_t       count;
+   char           path[FSPATH_MAX];
+   CatEntry       *entries;         // sorted by name
+} DirSnapshot;
+
+// Access byte bits
+#define ACCESS_PUBLIC_R    0x01
+#define ACCESS_PUBLIC_W    0x02
+#define ACCESS_OWNER_R     0x04
+#define ACCESS_OWNER_W     0x08
+#define ACCESS_LOCKED      0x10
+#define ACCESS_DIR         0x20
+
+void  dircache_init();
+DirSnapshot *dircache_get(const char *path, int *err);
+void  dircache_invalidate(const char *path);
+void  dircache_invalidate_parent(const char *path);
+void  dircache_invalidate_all();
+
+#endif
@@ -0,0 +1,106 @@
+/*
+;Copyright (c) 2024 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// fspath.c: translate Acorn style object names, as sent by clients,
+// into paths that FatFS understands.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fspath.h"
+
+#define IS_TERMINATOR(c)   ((c) == 0 || (c) == 0x0d || (c) == ' ')
+
+//------------------------------------------------------------
+// Convert an Acorn pathname (terminated by CR, space or NUL) to a
+// FAT path. '$' (or '&') is the root, '.' separates components,
+// '^' is the parent and '@' the current directory. A '/' within a
+// name is the Acorn convention for a FAT '.', e.g. README/TXT.
+// Returns the length of the result, or a negative errno.
+int
+acorn_to_fat_path(char *dest, size_t destsize, const uint8_t *src)
+{
+   size_t len = 0;
+   bool need_sep = false;
+
+   while(*src == ' ') src++;
+   if(IS_TERMINATOR(*src)) return -EINVAL;
+
+   while(!IS_TERMINATOR(*src)) {
+      const uint8_t *end = src;
+      while(!IS_TERMINATOR(*end) && *end != '.') end++;
+
+      size_t complen = end - src;
+      if(complen == 0) return -EINVAL;
+
+      if(complen == 1 && (*src == '$' || *src == '&')) {
+         // root is only valid as the first component
+         if(len > 0) return -EINVAL;
+         dest[len++] = '/';
+      }
+      else {
+         if(need_sep) {
+            if(len + 1 >= destsize) return -ENAMETOOLONG;
+            dest[len++] = '/';
+         }
+
+         if(complen == 1 && *src == '^') {
+            if(len + 2 >= destsize) return -ENAMETOOLONG;
+            dest[len++] = '.';
+            dest[len++] = '.';
+         }
+         else if(complen == 1 && *src == '@') {
+            if(len + 1 >= destsize) return -ENAMETOOLONG;
+            dest[len++] = '.';
+         }
+         else {
+            if(len + complen >= destsize) return -ENAMETOOLONG;
+            for(size_t i = 0; i < complen; i++)
+               dest[len++] = src[i] == '/' ? '.' : src[i];
+         }
+         need_sep = true;
+      }
+
+      src = end;
+      if(*src == '.') src++;
+   }
+
+   dest[len] = 0;
+   return len;
+}
+
+//------------------------------------------------------------
+// Convert a FAT name to an Acorn one for a catalogue: a '.' becomes
+// '/', and the name is truncated and padded with spaces to
+// ACORN_NAME_LEN. The result isn't terminated.
+void
+fat_to_acorn_name(char *dest, const char *src)
+{
+   int i;
+   for(i = 0; i < ACORN_NAME_LEN && src[i]; i++)
+      dest[i] = src[i] == '.' ? '/' : src[i];
+   for(; i < ACORN_NAME_LEN; i++)
+      dest[i] = ' ';
+}
@@ -0,0 +1,12 @@
+#ifndef FSPATH_H
+#define FSPATH_H
+#include <stdint.h>
+#include <stddef.h>
+
+#define FSPATH_MAX      128
+#define ACORN_NAME_LEN  10
+
+int acorn_to_fat_path(char *dest, size_t destsize, const uint8_t *src);
+void fat_to_acorn_name(char *dest, const char *src);
+
+#endif
@@ -26,10 +26,16 @@
 #include <stdio.h>
 
 #include "message.h"
+#include "pathcache.h"
+#include "dircache.h"
 
 int
 main(int argc, char **argv)
 {
+   session_init();
+   pathcache_init();
+   dircache_init();
+
    printf("Initializing econet...\n");
    econet_init(254);
 
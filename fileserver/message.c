@@ -22,18 +22,26 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/ioctl.h>
 #include <sys/econet.h>
+#include <sys/task.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "message.h"
 #include "starcmd.h"
+#include "bulk.h"
+#include "catalogue.h"
 
 static int econet_fd;
-static uint8_t econet_buf[2048];
+static Worker workers[NETFS_WORKERS];
+static uint8_t worker_stack[NETFS_WORKERS - 1][NETFS_WORKER_STACK]
+   __attribute__((aligned(16)));
 
 static void econet_handle_message(NetFSMsg *msg);
 
@@ -52,60 +60,366 @@ econet_init(uint8_t station)
    rc = ioctl(econet_fd, ECONET_SET_RECV_PORT | NETFS_PORT);
    if(rc < 0) return rc;
 
+   // Each worker has an fd listening on its own data port, so bulk
+   // data arriving during SAVE/PUTBYTES doesn't get mixed up with new
+   // requests or another worker's data. They're non blocking so bulk
+   // data can be sent while the next block is read from disc, and
+   // other workers can run while a send is waiting for the line.
+   for(int i = 0; i < NETFS_WORKERS; i++) {
+      Worker *w = &workers[i];
+      w->data_port = NETFS_DATA_PORT - i;
+      w->data_fd = open("/dev/econet", O_RDWR|O_NONBLOCK);
+      if(w->data_fd < 0) return w->data_fd;
+
+      rc = ioctl(w->data_fd, ECONET_SET_RECV_PORT | w->data_port);
+      if(rc < 0) return rc;
+   }
+
    printf("Econet initialized, station: %d\n", station);
    return 0;
 }
 
 //------------------------------------------------------------
-// Wait for messages and dispatch them.
-void
-econet_msgloop()
+// Returns true if another worker is still busy with the station. A
+// client can send its next request as soon as it has the reply, before
+// the worker that sent the reply has finished.
+static bool
+station_busy(uint8_t net, uint8_t station)
+{
+   for(int i = 0; i < NETFS_WORKERS; i++) {
+      if(workers[i].station == station && workers[i].net == net)
+         return true;
+   }
+   return false;
+}
+
+//------------------------------------------------------------
+// Requests that wait on the network for bulk data. Their frames would
+// hold up the receive ring for the whole transfer.
+static bool
+request_is_bulk(uint8_t function_code)
+{
+   switch(function_code) {
+      case FC_SAVE:
+      case FC_LOAD:
+      case FC_LOADCOMMAND:
+      case FC_GETBYTES:
+      case FC_PUTBYTES:
+         return true;
+      default:
+         return false;
+   }
+}
+
+//------------------------------------------------------------
+// Copy a request out of the receive ring into the worker's buffer, NUL
+// terminated, and release it. Returns the length copied, or -1 if a
+// new frame ran over it while it was being copied.
+static ssize_t
+econet_copy_request(Worker *w, const struct econet_rxview *view,
+      size_t rxbytes)
 {
-   ssize_t rxbytes;
-   NetFSMsg msg; 
+   if(rxbytes > sizeof(w->request) - 1) rxbytes = sizeof(w->request) - 1;
+   size_t first = view->len < rxbytes ? view->len : rxbytes;
+   memcpy(w->request, view->data, first);
+   if(view->wrap) memcpy(w->request + first, view->wrap, rxbytes - first);
+   w->request[rxbytes] = 0;
+
+   if(ioctl(econet_fd, ECONET_RELEASE_RX | view->id) < 0) return -1;
+   return rxbytes;
+}
+
+//------------------------------------------------------------
+// Get the next request. It's used where it is in the econet receive
+// ring, and released once it's been handled. It's copied out instead
+// if it wraps round the end of the ring, if it doesn't end in a CR so
+// text fields need a NUL terminator, or if it's a bulk transfer.
+// Returns the frame's length.
+static ssize_t
+econet_get_request(Worker *w, struct econet_rxview *view,
+      const uint8_t **frame)
+{
+   ssize_t rxbytes = ioctl(econet_fd, ECONET_GET_RXVIEW, view);
+   if(rxbytes <= 0) return rxbytes;
+
+   if(view->wrap == NULL && rxbytes >= 7 &&
+         view->data[rxbytes - 1] == 0x0d && !request_is_bulk(view->data[3])) {
+      *frame = view->data;
+      return rxbytes;
+   }
+
+   *frame = w->request;
+   return econet_copy_request(w, view, rxbytes);
+}
+
+//------------------------------------------------------------
+// Take requests and handle them, one at a time. The workers share
+// econet_fd, and each holds the request it's working on.
+static void
+worker_loop(void *arg)
+{
+   Worker *w = arg;
+   struct econet_rxview view;
+   const uint8_t *frame;
+   NetFSMsg msg;
 
    while(1) {
-      rxbytes = read(econet_fd, econet_buf, sizeof(econet_buf));
+      ssize_t rxbytes = econet_get_request(w, &view, &frame);
       printf("read msg: %d bytes\n", rxbytes);
 
-      if(rxbytes < 7) continue;
-
-      msg.reply_net = *(econet_buf + 1);
-      msg.reply_station = *econet_buf;
-      msg.reply_port = *(econet_buf + 2);
-      msg.function_code = *(econet_buf + 3);
-      msg.urd = *(econet_buf + 4);
-      msg.csd = *(econet_buf + 5);
-      msg.lib = *(econet_buf + 6);
-      msg.paysize = rxbytes - 7;
-      msg.payload = econet_buf + 7;
-     
-      // guarantee null terminator for strings 
-      *(econet_buf + rxbytes) = 0;
-
-      econet_handle_message(&msg);
+      if(rxbytes >= 7) {
+         msg.reply_net = frame[1];
+         msg.reply_station = frame[0];
+         msg.reply_port = frame[2];
+         msg.function_code = frame[3];
+         msg.urd = frame[4];
+         msg.csd = frame[5];
+         msg.lib = frame[6];
+         msg.paysize = rxbytes - 7;
+         msg.payload = (uint8_t *)frame + 7;
+         msg.worker = w;
+
+         // keep each station's requests in order; the previous one
+         // might have logged it on or off. That could take a while, so
+         // don't hold up the ring meanwhile.
+         if(station_busy(msg.reply_net, msg.reply_station)) {
+            if(frame != w->request) {
+               frame = w->request;
+               rxbytes = econet_copy_request(w, &view, rxbytes);
+               if(rxbytes < 0) continue;
+               msg.paysize = rxbytes - 7;
+               msg.payload = w->request + 7;
+            }
+            while(station_busy(msg.reply_net, msg.reply_station))
+               task_yield();
+         }
+         msg.session = session_find(msg.reply_net, msg.reply_station);
+
+         w->net = msg.reply_net;
+         w->station = msg.reply_station;
+         econet_handle_message(&msg);
+         w->station = 0;
+      }
+
+      // the request's part of the receive ring can now be reused
+      if(rxbytes > 0 && frame != w->request)
+         ioctl(econet_fd, ECONET_RELEASE_RX | view.id);
    }
 }
 
+//------------------------------------------------------------
+// Start the workers and wait for messages. The calling task becomes
+// worker 0.
+void
+econet_msgloop()
+{
+   for(int i = 1; i < NETFS_WORKERS; i++) {
+      if(task_create(worker_loop, &workers[i], worker_stack[i - 1],
+               NETFS_WORKER_STACK) < 0)
+         printf("econet_msgloop: couldn't start worker %d\n", i);
+   }
+   worker_loop(&workers[0]);
+}
+
+//---------------------------------------------------------------
+// Start sending a frame to a port on the source station, from the
+// worker's fd. If another worker is using the transmitter or has
+// claimed its buffer, let it run until it's done.
+static int
+econet_start_send(NetFSMsg *origin, uint8_t port,
+      const struct iovec *iov, int iovcnt)
+{
+   int fd = origin->worker->data_fd;
+   struct econet_addr dest;
+   dest.port = port;
+   dest.net = origin->reply_net;
+   dest.station = origin->reply_station;
+
+   int rc = ioctl(fd, ECONET_SET_SEND_ADDR, &dest);
+   if(rc < 0) return rc;
+
+   ssize_t bytes;
+   while((bytes = writev(fd, iov, iovcnt)) < 0 &&
+         (errno == EAGAIN || errno == EBUSY))
+      task_yield();
+
+   return bytes < 0 ? bytes : 0;
+}
+
 //---------------------------------------------------------------
 // Send a message to the source.
 void
 econet_send(NetFSMsg *origin, uint8_t *msg, size_t msgsize)
 {
+   econet_send_port(origin, origin->reply_port, msg, msgsize);
+}
+
+//---------------------------------------------------------------
+// Send a message made of several parts to the source, as one frame.
+void
+econet_sendv(NetFSMsg *origin, const struct iovec *iov, int iovcnt)
+{
+   if(econet_start_send(origin, origin->reply_port, iov, iovcnt) < 0 ||
+         econet_send_wait(origin) < 0)
+      printf("econet_sendv: write failed\n");
+}
+
+//---------------------------------------------------------------
+// Send a message to a specific port on the source station, e.g.
+// the data port nominated by the client for a LOAD.
+int
+econet_send_port(NetFSMsg *origin, uint8_t port, uint8_t *msg, size_t msgsize)
+{
+   struct iovec iov = { .iov_base = msg, .iov_len = msgsize };
+
+   int rc = econet_start_send(origin, port, &iov, 1);
+   if(rc == 0) rc = econet_send_wait(origin);
+   if(rc < 0) printf("econet_send: write failed\n");
+   return rc;
+}
+
+//---------------------------------------------------------------
+// Start sending a block of bulk data to a port on the source station
+// without waiting for the handshake to finish. The data is copied out
+// before this returns so the buffer can be reused straight away.
+// Only one block can be in flight: call econet_send_wait() first.
+int
+econet_send_async(NetFSMsg *origin, uint8_t port, uint8_t *msg, size_t msgsize)
+{
+   struct iovec iov = { .iov_base = msg, .iov_len = msgsize };
+   return econet_start_send(origin, port, &iov, 1);
+}
+
+//---------------------------------------------------------------
+// Get the econet transmit buffer, so a block for the data port can be
+// built in place rather than copied there by econet_send_async().
+// Nothing may be in flight. Returns NULL if the buffer isn't free.
+uint8_t *
+econet_get_txbuf(NetFSMsg *origin)
+{
+   uint8_t *buf;
+   int rc;
+   while((rc = ioctl(origin->worker->data_fd, ECONET_GET_TXBUF, &buf)) < 0 &&
+         (errno == EAGAIN || errno == EBUSY))
+      task_yield();
+
+   return rc < 0 ? NULL : buf;
+}
+
+// Start sending the block in the transmit buffer, as
+// econet_send_async() does. The buffer stays claimed while waiting for
+// the line, but other workers can still get on with reading the disc.
+// If the send fails, the buffer is given up.
+int
+econet_send_txbuf(NetFSMsg *origin, uint8_t port, size_t msgsize)
+{
+   int fd = origin->worker->data_fd;
    struct econet_addr dest;
-   dest.port = origin->reply_port;
+   dest.port = port;
    dest.net = origin->reply_net;
    dest.station = origin->reply_station;
 
-   int rc = ioctl(econet_fd, ECONET_SET_SEND_ADDR, &dest);
+   int rc = ioctl(fd, ECONET_SET_SEND_ADDR, &dest);
+   if(rc >= 0) {
+      while((rc = ioctl(fd, ECONET_TX_COMMIT | msgsize)) < 0 && errno == EAGAIN)
+         task_yield();
+   }
+
    if(rc < 0) {
-      printf("econet_send: ioctl failed\n");
-      return;
+      ioctl(fd, ECONET_TX_COMMIT | 0);
+      return rc;
+   }
+   return 0;
+}
+
+//---------------------------------------------------------------
+// Wait for the frame last sent from the worker's fd to be delivered.
+// Returns 0 on success, or <0 if the client stopped listening.
+int
+econet_send_wait(NetFSMsg *origin)
+{
+   int fd = origin->worker->data_fd;
+   struct pollfd pfd;
+   pfd.fd = fd;
+   pfd.events = POLLOUT;
+   pfd.revents = 0;
+
+   if(poll(&pfd, 1, NETFS_SEND_TIMEOUT) <= 0) return -1;
+
+   if(ioctl(fd, ECONET_GET_TXSTATUS) < 0) {
+      printf("econet_send_wait: send failed\n");
+      return -1;
+   }
+   return 0;
+}
+
+//---------------------------------------------------------------
+// Send an error reply: command code 0, the error number, then the
+// message terminated by CR.
+void
+econet_send_error(NetFSMsg *origin, uint8_t err, const char *text)
+{
+   uint8_t hdr[2] = { 0x00, err };
+   struct iovec iov[3] = {
+      { .iov_base = hdr,            .iov_len = sizeof(hdr) },
+      { .iov_base = (char *)text,   .iov_len = strlen(text) },
+      { .iov_base = "\r",           .iov_len = 1 }
+   };
+   econet_sendv(origin, iov, 3);
+}
+
+//---------------------------------------------------------------
+// Send the error reply that corresponds to a failed file operation.
+void
+econet_send_errno(NetFSMsg *origin, int err)
+{
+   switch(err) {
+      case -ENOENT:
+         econet_send_error(origin, FSERR_NOT_FOUND, "Not found");
+         break;
+      case -ENOSPC:
+         econet_send_error(origin, FSERR_DISC_FULL, "Disc full");
+         break;
+      case -EMFILE:
+         econet_send_error(origin, FSERR_TOO_MANY_OPEN, "Too many open files");
+         break;
+      case -EEXIST:
+         econet_send_error(origin, FSERR_EXISTS, "Already exists");
+         break;
+      case -ENOTEMPTY:
+         econet_send_error(origin, FSERR_DIR_NOT_EMPTY, "Dir. not empty");
+         break;
+      default:
+         econet_send_error(origin, FSERR_DISC_FAULT, "Disc fault");
    }
+}
+
+//---------------------------------------------------------------
+// Receive a block of bulk data from the source station on the
+// worker's data port. Frames from other stations are dropped. The 2 byte source
+// address precedes the data, so the data starts at buf + 2.
+// Returns the number of data bytes, 0 on timeout, or <0 on error.
+ssize_t
+econet_recv_data(NetFSMsg *origin, uint8_t *buf, size_t bufsize, int timeout)
+{
+   struct pollfd pfd;
+   pfd.fd = origin->worker->data_fd;
+   pfd.events = POLLIN;
+
+   while(1) {
+      pfd.revents = 0;
+      int rc = poll(&pfd, 1, timeout);
+      if(rc < 0) return rc;
+      if(rc == 0) return 0;
+
+      ssize_t rxbytes = read(pfd.fd, buf, bufsize);
+      if(rxbytes < 0) return rxbytes;
+      if(rxbytes < 2) continue;
 
-   ssize_t bytes = write(econet_fd, msg, msgsize);
-   if(bytes < 0) {
-      printf("econet_send: write failed\n");
+      if(buf[0] == origin->reply_station && buf[1] == origin->reply_net)
+         return rxbytes - 2;
+
+      printf("dropped data from %d.%d\n", buf[1], buf[0]);
    }
 }
 
@@ -114,10 +428,53 @@ econet_send(NetFSMsg *origin, uint8_t *msg, size_t msgsize)
 static void
 econet_handle_message(NetFSMsg *msg)
 {
+   // Only the command line (for *I AM) works before logging on
+   if(msg->session == NULL && msg->function_code != FC_COMMANDLINE) {
+      econet_send_error(msg, FSERR_WHO_ARE_YOU, "Who are you?");
+      return;
+   }
+
    switch(msg->function_code) {
       case FC_COMMANDLINE:
          handle_starcmd(msg);
          break;
+      case FC_SAVE:
+         bulk_save(msg);
+         break;
+      case FC_LOAD:
+      case FC_LOADCOMMAND:
+         bulk_load(msg);
+         break;
+      case FC_OPEN:
+         bulk_open(msg);
+         break;
+      case FC_CLOSE:
+         bulk_close(msg);
+         break;
+      case FC_GETBYTES:
+         bulk_getbytes(msg);
+         break;
+      case FC_PUTBYTES:
+         bulk_putbytes(msg);
+         break;
+      case FC_EXAMINE:
+         cat_examine(msg);
+         break;
+      case FC_READ_OBJINFO:
+         cat_read_objinfo(msg);
+         break;
+      case FC_READ_USERENV:
+         cat_read_userenv(msg);
+         break;
+      case FC_READ_FSFREESPACE:
+         cat_read_discfree(msg);
+         break;
+      case FC_ACORN_READ_FREESPACE:
+         cat_read_userfree(msg);
+         break;
+      case FC_LOGOFF:
+         cmd_bye(msg);
+         break;
       default:
          printf("station %d.%d sent unknown function code %d\n",
                msg->reply_net, msg->reply_station, msg->function_code);
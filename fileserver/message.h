@@ -1,8 +1,31 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/econet.h>
 
-#define NETFS_PORT   0x99
+#include "session.h"
+
+#define NETFS_PORT         0x99
+#define NETFS_DATA_PORT    0x97     // bulk data for SAVE/PUTBYTES, worker 0
+#define NETFS_SEND_TIMEOUT 1000     // ms to wait for a bulk block to go
+#define NETFS_REQUEST_COPY 272      // header and the longest command line
+#define NETFS_WORKERS      3        // stations that can be served at once
+#define NETFS_WORKER_STACK 7168
+
+// FS error numbers
+#define FSERR_DIR_NOT_EMPTY   0xb4
+#define FSERR_TOO_MANY_USERS  0xb8
+#define FSERR_WHO_ARE_YOU     0xbf
+#define FSERR_TOO_MANY_OPEN   0xc0
+#define FSERR_EXISTS          0xc4
+#define FSERR_DISC_FULL       0xc6
+#define FSERR_DISC_FAULT      0xc7
+#define FSERR_BAD_NAME        0xcc
+#define FSERR_NOT_FOUND       0xd6
+#define FSERR_CHANNEL         0xde
+#define FSERR_BAD_COMMAND     0xfe
 
 typedef enum {
    FC_COMMANDLINE = 0,     // 0
@@ -41,6 +64,18 @@ typedef enum {
 } FunctionCode;
 
 
+// Each request is handled by a worker task. A worker has its own
+// econet fd for replies and bulk data, listening on its own data port
+// (NETFS_DATA_PORT - index), and its own buffers, so a long SAVE from
+// one station doesn't hold up a *CAT from another.
+typedef struct {
+   int            data_fd;
+   uint8_t        data_port;
+   uint8_t        net, station;  // station being served, 0 when idle
+   uint8_t        request[NETFS_REQUEST_COPY + 1];  // copied out of the ring
+   uint8_t        buf[ECONET_MAX_PAYLOAD + 2];  // bulk data, or a reply
+} Worker;
+
 typedef struct {
    uint8_t        reply_net;
    uint8_t        reply_station;
@@ -49,12 +84,23 @@ typedef struct {
    uint8_t        urd;           // User Root Directory handle
    uint8_t        csd;           // Current directory handle
    uint8_t        lib;           // Library directory handle
+   Session        *session;      // NULL if the station isn't logged on
    uint16_t       paysize;       // Payload size
    uint8_t        *payload;
+   Worker         *worker;       // task handling the request
 } NetFSMsg;
 
 int   econet_init(uint8_t station);
 void  econet_msgloop();
 void  econet_send(NetFSMsg *origin, uint8_t *msg, size_t msgsize);
+void  econet_sendv(NetFSMsg *origin, const struct iovec *iov, int iovcnt);
+int   econet_send_port(NetFSMsg *origin, uint8_t port, uint8_t *msg, size_t msgsize);
+int   econet_send_async(NetFSMsg *origin, uint8_t port, uint8_t *msg, size_t msgsize);
+int   econet_send_wait(NetFSMsg *origin);
+uint8_t *econet_get_txbuf(NetFSMsg *origin);
+int   econet_send_txbuf(NetFSMsg *origin, uint8_t port, size_t msgsize);
+void  econet_send_error(NetFSMsg *origin, uint8_t err, const char *text);
+void  econet_send_errno(NetFSMsg *origin, int err);
+ssize_t econet_recv_data(NetFSMsg *origin, uint8_t *buf, size_t bufsize, int timeout);
 
 #endif
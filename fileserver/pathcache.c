@@ -0,0 +1,131 @@
+/*
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// pathcache.c: remembers what's at the FAT paths that requests
+// resolve to, so repeated lookups don't go back to FatFS, which has
+// to scan each directory along the path matching long names.
+//
+// Most lookups that miss are for things that aren't there: a command
+// run from the library is looked for in the CSD first, every time.
+// So files that don't exist are cached as well as those that do.
+//
+// Entries are found by a hash of the path (case insensitive, like
+// FAT) and a new entry replaces whatever was in its slot. Anything
+// that creates or removes objects must invalidate their paths. Paths
+// come from session_path(), so each object has only one.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "fspath.h"
+#include "pathcache.h"
+
+typedef struct {
+   uint32_t       hash;
+   uint8_t        type;             // PC_ type, 0 if the slot is empty
+   char           path[FSPATH_MAX];
+} PathEntry;
+
+static PathEntry cache[PATHCACHE_SIZE];
+static PathCacheStats stats;
+
+//------------------------------------------------------------
+void
+pathcache_init()
+{
+   memset(cache, 0, sizeof(cache));
+   memset(&stats, 0, sizeof(stats));
+}
+
+// FNV-1a, ignoring case
+static uint32_t
+path_hash(const char *path)
+{
+   uint32_t hash = 2166136261u;
+   while(*path) {
+      hash ^= toupper((unsigned char)*path++);
+      hash *= 16777619;
+   }
+   return hash;
+}
+
+//------------------------------------------------------------
+// Find out what's at a path: PC_FILE, PC_DIR or PC_MISSING, or
+// a negative errno if it couldn't be found out.
+int
+pathcache_lookup(const char *path)
+{
+   uint32_t hash = path_hash(path);
+   PathEntry *ent = &cache[hash & (PATHCACHE_SIZE - 1)];
+
+   if(ent->type && ent->hash == hash && !strcasecmp(ent->path, path)) {
+      stats.hits++;
+      return ent->type;
+   }
+   stats.misses++;
+
+   struct stat st;
+   int type;
+   if(stat(path, &st) < 0) {
+      if(errno != ENOENT) return -errno;
+      type = PC_MISSING;
+   }
+   else {
+      type = S_ISDIR(st.st_mode) ? PC_DIR : PC_FILE;
+   }
+
+   if(strlen(path) < FSPATH_MAX) {
+      ent->hash = hash;
+      ent->type = type;
+      strcpy(ent->path, path);
+   }
+   return type;
+}
+
+//------------------------------------------------------------
+// Forget a path and, if it's a directory, everything in it.
+void
+pathcache_invalidate(const char *path)
+{
+   size_t len = strlen(path);
+
+   for(int i = 0; i < PATHCACHE_SIZE; i++) {
+      PathEntry *ent = &cache[i];
+      if(ent->type && !strncasecmp(ent->path, path, len) &&
+            (ent->path[len] == 0 || ent->path[len] == '/')) {
+         ent->type = 0;
+         stats.invalidations++;
+      }
+   }
+}
+
+const PathCacheStats *
+pathcache_stats()
+{
+   return &stats;
+}
@@ -0,0 +1,24 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stdint.h>
+
+#define PATHCACHE_SIZE  32       // entries, a power of 2
+
+// What's at a path
+#define PC_MISSING      1
+#define PC_FILE         2
+#define PC_DIR          3
+
+typedef struct {
+   uint32_t       hits;
+   uint32_t       misses;
+   uint32_t       invalidations;
+} PathCacheStats;
+
+void  pathcache_init();
+int   pathcache_lookup(const char *path);
+void  pathcache_invalidate(const char *path);
+const PathCacheStats *pathcache_stats();
+
+#endif
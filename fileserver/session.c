@@ -0,0 +1,267 @@
+/*
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// session.c: logged on stations. Each station that has done *I AM
+// has a session holding its user name and the directories and files
+// behind the handles it was given.
+//
+// Sessions are found from the station number through a table indexed
+// by station, with the (rare) stations of the same number on other
+// networks chained from there. Handles are small integers offset
+// from a base, so looking one up is an array index.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "session.h"
+
+#define ROOT_DIR     "/"
+#define LIBRARY_DIR  "/LIBRARY"
+
+static Session sessions[MAX_SESSIONS];
+static int8_t by_station[256];      // first session for each station number
+
+//------------------------------------------------------------
+// Initialize the session table
+void
+session_init()
+{
+   memset(sessions, 0, sizeof(sessions));
+   memset(by_station, -1, sizeof(by_station));
+}
+
+//------------------------------------------------------------
+// Find a station's session, or NULL if it isn't logged on.
+Session *
+session_find(uint8_t net, uint8_t station)
+{
+   for(int i = by_station[station]; i >= 0; i = sessions[i].next) {
+      if(sessions[i].net == net) return &sessions[i];
+   }
+   return NULL;
+}
+
+//------------------------------------------------------------
+// Log a station on, replacing any session it already has. The
+// URD and CSD start at the root and the LIB at $.LIBRARY. The user
+// name needn't be NUL terminated. Returns NULL if the table is full.
+Session *
+session_logon(uint8_t net, uint8_t station, const char *user, size_t userlen)
+{
+   Session *s = session_find(net, station);
+   if(s) session_logoff(s);
+
+   int slot;
+   for(slot = 0; slot < MAX_SESSIONS; slot++)
+      if(!sessions[slot].in_use) break;
+   if(slot == MAX_SESSIONS) return NULL;
+
+   s = &sessions[slot];
+   memset(s, 0, sizeof(Session));
+   s->in_use = true;
+   s->net = net;
+   s->station = station;
+   memcpy(s->user, user, userlen < USERNAME_MAX ? userlen : USERNAME_MAX);
+   for(int i = 0; i < SESSION_FILES; i++) s->files[i] = -1;
+
+   s->urd = session_alloc_dir(s, ROOT_DIR);
+   s->csd = session_alloc_dir(s, ROOT_DIR);
+   s->lib = session_alloc_dir(s, LIBRARY_DIR);
+
+   s->next = by_station[station];
+   by_station[station] = slot;
+   return s;
+}
+
+//------------------------------------------------------------
+// Log a station off, closing its files.
+void
+session_logoff(Session *s)
+{
+   int slot = s - sessions;
+
+   session_close_files(s);
+
+   int8_t *link = &by_station[s->station];
+   while(*link != slot) link = &sessions[*link].next;
+   *link = s->next;
+
+   s->in_use = false;
+}
+
+//------------------------------------------------------------
+// Give out a handle for a directory. Returns the handle, or
+// -EMFILE if the session has no free directory slots.
+int
+session_alloc_dir(Session *s, const char *path)
+{
+   if(strlen(path) >= FSPATH_MAX) return -ENAMETOOLONG;
+
+   for(int i = 0; i < SESSION_DIRS; i++) {
+      if(s->dirs[i][0] == 0) {
+         strcpy(s->dirs[i], path);
+         return DIR_HANDLE_BASE + i;
+      }
+   }
+   return -EMFILE;
+}
+
+//------------------------------------------------------------
+// The path of the directory behind a handle, or NULL if the
+// handle isn't valid.
+const char *
+session_dir(Session *s, uint8_t handle)
+{
+   unsigned slot = handle - DIR_HANDLE_BASE;
+   if(slot >= SESSION_DIRS || s->dirs[slot][0] == 0) return NULL;
+   return s->dirs[slot];
+}
+
+void
+session_free_dir(Session *s, uint8_t handle)
+{
+   unsigned slot = handle - DIR_HANDLE_BASE;
+   if(slot < SESSION_DIRS) s->dirs[slot][0] = 0;
+}
+
+//------------------------------------------------------------
+// Give out a handle for an open file. Returns the handle, or
+// -EMFILE if the session has no free file slots.
+int
+session_alloc_file(Session *s, int fd)
+{
+   for(int i = 0; i < SESSION_FILES; i++) {
+      if(s->files[i] < 0) {
+         s->files[i] = fd;
+         s->fileptrs[i] = 0;
+         return FILE_HANDLE_BASE + i;
+      }
+   }
+   return -EMFILE;
+}
+
+//------------------------------------------------------------
+// Map a file handle to its fd, or -1 if the handle isn't valid.
+int
+session_file(Session *s, uint8_t handle)
+{
+   unsigned slot = handle - FILE_HANDLE_BASE;
+   if(slot >= SESSION_FILES) return -1;
+   return s->files[slot];
+}
+
+// A file handle's sequential pointer. Files are read and written
+// with pread and pwrite at this, so the fd's own position isn't used.
+uint32_t *
+session_file_ptr(Session *s, uint8_t handle)
+{
+   unsigned slot = handle - FILE_HANDLE_BASE;
+   if(slot >= SESSION_FILES) return NULL;
+   return &s->fileptrs[slot];
+}
+
+// Forget a file handle. The caller closes the fd.
+void
+session_free_file(Session *s, uint8_t handle)
+{
+   unsigned slot = handle - FILE_HANDLE_BASE;
+   if(slot < SESSION_FILES) s->files[slot] = -1;
+}
+
+void
+session_close_files(Session *s)
+{
+   for(int i = 0; i < SESSION_FILES; i++) {
+      if(s->files[i] >= 0) {
+         close(s->files[i]);
+         s->files[i] = -1;
+      }
+   }
+}
+
+//------------------------------------------------------------
+// Remove . and .. components from an absolute path, in place, so
+// each object has one name (which the caches rely on). .. in the
+// root stays in the root. Returns the new length.
+static int
+canonical_path(char *path)
+{
+   size_t len = 1;                  // the output, which never gets ahead of in
+   const char *in = path + 1;
+
+   while(*in) {
+      const char *end = strchr(in, '/');
+      if(end == NULL) end = in + strlen(in);
+      size_t complen = end - in;
+
+      if(complen == 2 && in[0] == '.' && in[1] == '.') {
+         while(len > 1 && path[len - 1] != '/') len--;
+         if(len > 1) len--;
+      }
+      else if(complen > 0 && !(complen == 1 && in[0] == '.')) {
+         if(len > 1) path[len++] = '/';
+         memmove(path + len, in, complen);
+         len += complen;
+      }
+      in = *end ? end + 1 : end;
+   }
+
+   path[len] = 0;
+   return len;
+}
+
+//------------------------------------------------------------
+// Translate an object name from a request into a FAT path. Names
+// starting at the root stand alone, anything else is relative to
+// the directory handle given (normally the CSD).
+// Returns the length of the path, -EBADF if the directory handle
+// isn't valid, or another negative errno if the name isn't.
+int
+session_path(Session *s, uint8_t dirhandle, const uint8_t *name,
+      char *dest, size_t destsize)
+{
+   char rel[FSPATH_MAX];
+
+   int len = acorn_to_fat_path(rel, sizeof(rel), name);
+   if(len < 0) return len;
+   if(rel[0] == '/') {
+      if(len >= destsize) return -ENAMETOOLONG;
+      strcpy(dest, rel);
+      return canonical_path(dest);
+   }
+
+   const char *dir = session_dir(s, dirhandle);
+   if(dir == NULL) return -EBADF;
+
+   size_t dirlen = strlen(dir);
+   bool need_sep = dir[dirlen - 1] != '/';
+   if(dirlen + need_sep + len >= destsize) return -ENAMETOOLONG;
+
+   memcpy(dest, dir, dirlen);
+   if(need_sep) dest[dirlen++] = '/';
+   strcpy(dest + dirlen, rel);
+   return canonical_path(dest);
+}
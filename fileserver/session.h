@@ -0,0 +1,51 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fspath.h"
+
+#define MAX_SESSIONS       16
+#define SESSION_DIRS       4        // URD, CSD, LIB and one spare
+#define SESSION_FILES      8
+#define DIR_HANDLE_BASE    1        // first directory handle given out
+#define FILE_HANDLE_BASE   0x20     // first file handle given out
+#define USERNAME_MAX       10
+
+// A logged on station. Handles index straight into the dirs and
+// files arrays, so a request's context is found without any search.
+typedef struct {
+   bool           in_use;
+   uint8_t        net;
+   uint8_t        station;
+   int8_t         next;             // next session with this station number
+   char           user[USERNAME_MAX + 1];
+   uint8_t        urd;
+   uint8_t        csd;
+   uint8_t        lib;
+   uint8_t        boot_opt;
+   char           dirs[SESSION_DIRS][FSPATH_MAX];  // empty if not in use
+   int            files[SESSION_FILES];            // fd, or -1
+   uint32_t       fileptrs[SESSION_FILES];         // sequential pointer (PTR#)
+} Session;
+
+void     session_init();
+Session  *session_find(uint8_t net, uint8_t station);
+Session  *session_logon(uint8_t net, uint8_t station, const char *user, size_t userlen);
+void     session_logoff(Session *s);
+
+int      session_alloc_dir(Session *s, const char *path);
+const char *session_dir(Session *s, uint8_t handle);
+void     session_free_dir(Session *s, uint8_t handle);
+
+int      session_alloc_file(Session *s, int fd);
+int      session_file(Session *s, uint8_t handle);
+uint32_t *session_file_ptr(Session *s, uint8_t handle);
+void     session_free_file(Session *s, uint8_t handle);
+void     session_close_files(Session *s);
+
+int      session_path(Session *s, uint8_t dirhandle, const uint8_t *name,
+                      char *dest, size_t destsize);
+
+#endif
@@ -28,83 +28,189 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "message.h"
+#include "pathcache.h"
+#include "dircache.h"
 #include "starcmd.h"
 
 #define MAXARGS   8
 
+#define IS_TERMINATOR(c)   ((c) == 0 || (c) == 0x0d)
+
+// An argument is a slice of the command line in the payload. It's
+// terminated by a space or CR rather than NUL.
+typedef struct {
+   const char  *ptr;
+   uint16_t    len;
+} CmdArg;
+
 typedef struct cmdtable {
-   char *cmd;
-   void (*cmdfunc)(NetFSMsg *msg, int argc, char **argv);
+   const char  *cmd;
+   uint8_t     minabbrev;     // shortest abbreviation, e.g. 3 for DEL.
+   void (*cmdfunc)(NetFSMsg *msg, int argc, CmdArg *argv);
 } CmdTable;
 
-static void cmd_i_am(NetFSMsg *msg, int argc, char **argv);
-static void cmd_echo(NetFSMsg *msg, int argc, char **argv);
+static void cmd_i_am(NetFSMsg *msg, int argc, CmdArg *argv);
+static void cmd_echo(NetFSMsg *msg, int argc, CmdArg *argv);
+static void cmd_bye_args(NetFSMsg *msg, int argc, CmdArg *argv);
+static void cmd_delete(NetFSMsg *msg, int argc, CmdArg *argv);
+static void cmd_cdir(NetFSMsg *msg, int argc, CmdArg *argv);
+static void cmd_stats(NetFSMsg *msg, int argc, CmdArg *argv);
 
-CmdTable commands[] = {
-   { .cmd = "i",     .cmdfunc = cmd_i_am },
-   { .cmd = "echo",  .cmdfunc = cmd_echo },
-   { .cmd = NULL }
+// Must be kept in alphabetical order: it's binary searched, and
+// the commands an abbreviation could stand for are adjacent.
+static const CmdTable commands[] = {
+   { .cmd = "BYE",    .minabbrev = 3, .cmdfunc = cmd_bye_args },
+   { .cmd = "CDIR",   .minabbrev = 2, .cmdfunc = cmd_cdir },
+   { .cmd = "DELETE", .minabbrev = 3, .cmdfunc = cmd_delete },
+   { .cmd = "ECHO",   .minabbrev = 4, .cmdfunc = cmd_echo },
+   { .cmd = "I",      .minabbrev = 1, .cmdfunc = cmd_i_am },
+   { .cmd = "STATS",  .minabbrev = 2, .cmdfunc = cmd_stats },
 };
+#define NUM_COMMANDS (sizeof(commands) / sizeof(CmdTable))
+
+//-------------------------------------------------------------
+// Compare a command name with the word typed, as strcasecmp would
+// if the word were NUL terminated.
+static int
+cmdcmp(const char *name, const char *word, size_t len)
+{
+   int rc = strncasecmp(name, word, len);
+   if(rc == 0 && name[len] != 0) rc = 1;
+   return rc;
+}
+
+// Find the command for a word, which is abbreviated if it was
+// followed by a '.'. An abbreviation is matched to the first
+// command it's a long enough prefix of.
+static const CmdTable *
+find_command(const char *word, size_t len, bool abbrev)
+{
+   size_t lo = 0, hi = NUM_COMMANDS;
+
+   while(lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if(cmdcmp(commands[mid].cmd, word, len) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for(; lo < NUM_COMMANDS; lo++) {
+      const CmdTable *c = &commands[lo];
+      if(strncasecmp(c->cmd, word, len)) break;
+      if(c->cmd[len] == 0) return c;
+      if(abbrev && len >= c->minabbrev) return c;
+   }
+   return NULL;
+}
+
+// Whether an argument is the given word, ignoring case
+static bool
+arg_is(const CmdArg *arg, const char *word)
+{
+   return arg->len == strlen(word) && !strncasecmp(arg->ptr, word, arg->len);
+}
 
 //-------------------------------------------------------------
-//
+// Split the command line into the command word and its arguments
+// and run the command. Nothing is copied; the arguments point into
+// the payload.
 void
 handle_starcmd(NetFSMsg *msg)
 {
-   char *args[MAXARGS];
+   CmdArg args[MAXARGS];
    int argc = 0;
+   const char *ptr = (const char *)msg->payload;
+   const char *end = ptr + msg->paysize;
 
-   if(msg->paysize > 0) {
-      char *ptr = strtok(msg->payload, " ");
-      while(ptr && argc < MAXARGS) {
-         args[argc] = ptr;
-         argc++;
-
-         ptr = strtok(NULL, " ");
-      }
-   }
+   while(ptr < end && *ptr == ' ') ptr++;
+   const char *word = ptr;
+   while(ptr < end && !IS_TERMINATOR(*ptr) && *ptr != ' ' && *ptr != '.') ptr++;
 
-   if(argc > 0) {
-      CmdTable *cptr = commands;
-      bool handled = false;
-      while(cptr->cmd != NULL) {
-         if(!strcasecmp(cptr->cmd, args[0])) {
-            if(cptr->cmdfunc == NULL) break;
+   size_t len = ptr - word;
+   bool abbrev = ptr < end && *ptr == '.';
+   if(abbrev) ptr++;
 
-            cptr->cmdfunc(msg, argc, args);
-            handled = true;
-            break;
-         }
+   const CmdTable *cmd = len ? find_command(word, len, abbrev) : NULL;
+   if(cmd == NULL) {
+      econet_send_error(msg, FSERR_BAD_COMMAND, "Bad command");
+      return;
+   }
 
-         cptr++;
-      }
+   args[argc].ptr = word;
+   args[argc++].len = len;
+   while(argc < MAXARGS) {
+      while(ptr < end && *ptr == ' ') ptr++;
+      if(ptr == end || IS_TERMINATOR(*ptr)) break;
 
-      if(!handled) {
-         printf("cmd not handled\n");
-      }
+      const char *arg = ptr;
+      while(ptr < end && !IS_TERMINATOR(*ptr) && *ptr != ' ') ptr++;
+      args[argc].ptr = arg;
+      args[argc++].len = ptr - arg;
    }
+
+   cmd->cmdfunc(msg, argc, args);
 }
 
 //-------------------------------------------------------------
 // Star commands
+// *I AM user [password], or *I. user [password]
+// There's no password file yet, so anyone can log on as anyone.
 static void
-cmd_i_am(NetFSMsg *msg, int argc, char **argv)
+cmd_i_am(NetFSMsg *msg, int argc, CmdArg *argv)
 {
-   // test 
+   if(argc >= 3 && arg_is(&argv[1], "AM")) {
+      argc--;
+      argv++;
+   }
+   if(argc < 2) {
+      econet_send_error(msg, FSERR_BAD_COMMAND, "Bad command");
+      return;
+   }
+
+   Session *s = session_logon(msg->reply_net, msg->reply_station,
+         argv[1].ptr, argv[1].len);
+   if(s == NULL) {
+      econet_send_error(msg, FSERR_TOO_MANY_USERS, "Too many users");
+      return;
+   }
+
    uint8_t iambuf[6];
    iambuf[0] = 0x05;    // I AM
    iambuf[1] = 0x00;    // Result code
-   iambuf[2] = 3;       // URD
-   iambuf[3] = 5;       // CSD
-   iambuf[4] = 6;       // LIB
-   iambuf[5] = 0;       // boot opts
+   iambuf[2] = s->urd;
+   iambuf[3] = s->csd;
+   iambuf[4] = s->lib;
+   iambuf[5] = s->boot_opt;
    econet_send(msg, iambuf, sizeof(iambuf));
 }
 
+// *BYE, or FC_LOGOFF: close the station's files and log it off
+void
+cmd_bye(NetFSMsg *msg)
+{
+   uint8_t reply[2] = { 0, 0 };
+
+   if(msg->session == NULL) {
+      econet_send_error(msg, FSERR_WHO_ARE_YOU, "Who are you?");
+      return;
+   }
+   session_logoff(msg->session);
+   econet_send(msg, reply, sizeof(reply));
+}
+
+static void
+cmd_bye_args(NetFSMsg *msg, int argc, CmdArg *argv)
+{
+   cmd_bye(msg);
+}
+
 static void
-cmd_echo(NetFSMsg *msg, int argc, char **argv)
+cmd_echo(NetFSMsg *msg, int argc, CmdArg *argv)
 {
    uint8_t buf[64];
    buf[0] = 0x00;       // no action, cmd complete
@@ -113,3 +219,77 @@ cmd_echo(NetFSMsg *msg, int argc, char **argv)
    econet_send(msg, buf, 8);
 }
 
+//-------------------------------------------------------------
+// Get the path named by a command's argument, sending an error
+// reply if there isn't one or the station isn't logged on.
+static bool
+get_arg_path(NetFSMsg *msg, int argc, CmdArg *argv, char *path)
+{
+   if(msg->session == NULL) {
+      econet_send_error(msg, FSERR_WHO_ARE_YOU, "Who are you?");
+      return false;
+   }
+   if(argc < 2 ||
+         session_path(msg->session, msg->csd, (const uint8_t *)argv[1].ptr, path, FSPATH_MAX) < 0) {
+      econet_send_error(msg, FSERR_BAD_NAME, "Bad name");
+      return false;
+   }
+   return true;
+}
+
+// Send a command's result or an error reply
+static void
+send_result(NetFSMsg *msg, int rc)
+{
+   uint8_t reply[2] = { 0, 0 };
+
+   if(rc < 0)
+      econet_send_errno(msg, rc);
+   else
+      econet_send(msg, reply, sizeof(reply));
+}
+
+// *DELETE name
+static void
+cmd_delete(NetFSMsg *msg, int argc, CmdArg *argv)
+{
+   char path[FSPATH_MAX];
+   if(!get_arg_path(msg, argc, argv, path)) return;
+
+   int rc = unlink(path) < 0 ? -errno : 0;
+   pathcache_invalidate(path);
+   dircache_invalidate(path);
+   dircache_invalidate_parent(path);
+   send_result(msg, rc);
+}
+
+// *CDIR name
+static void
+cmd_cdir(NetFSMsg *msg, int argc, CmdArg *argv)
+{
+   char path[FSPATH_MAX];
+   if(!get_arg_path(msg, argc, argv, path)) return;
+
+   int rc = mkdir(path, 0777) < 0 ? -errno : 0;
+   pathcache_invalidate(path);
+   dircache_invalidate_parent(path);
+   send_result(msg, rc);
+}
+
+// *STATS: the fileserver's cache counters. Command code 4 (as for
+// *INFO) has the client print the text.
+static void
+cmd_stats(NetFSMsg *msg, int argc, CmdArg *argv)
+{
+   uint8_t buf[80];
+   const PathCacheStats *pc = pathcache_stats();
+
+   buf[0] = 0x04;
+   buf[1] = 0x00;
+   int len = snprintf((char *)buf + 2, sizeof(buf) - 3, "Paths: %lu hits %lu misses %lu invalidated",
+         (unsigned long)pc->hits, (unsigned long)pc->misses,
+         (unsigned long)pc->invalidations);
+   if(len > sizeof(buf) - 4) len = sizeof(buf) - 4;
+   buf[len + 2] = 0x0d;
+   econet_send(msg, buf, len + 3);
+}
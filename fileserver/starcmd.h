@@ -4,6 +4,7 @@
 #include "message.h"
 
 void handle_starcmd(NetFSMsg *msg);
+void cmd_bye(NetFSMsg *msg);
 
 #endif
 
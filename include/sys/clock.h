@@ -0,0 +1,48 @@
+#ifndef SYS_CLOCK_H
+#define SYS_CLOCK_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+// The clock counts CPU cycles from reset. There's no real time clock,
+// so CLOCK_REALTIME (and gettimeofday) is the time since reset too.
+// clock_gettime and gettimeofday read the cycle counter directly,
+// which user mode is allowed to do, so they don't need a system call.
+
+#define CPU_CLOCK_HZ       12000000 // rate of the cycle counter
+
+// newlib only defines these when it thinks there are POSIX timers
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME     ((clockid_t)1)
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC    ((clockid_t)4)
+#endif
+
+int clock_gettime(clockid_t clk, struct timespec *ts);
+
+#endif
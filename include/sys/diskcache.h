@@ -0,0 +1,41 @@
+#ifndef SYS_DISKCACHE_H
+#define SYS_DISKCACHE_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <stdint.h>
+
+// Sector cache statistics
+struct diskcache_stats {
+   uint32_t       hits;
+   uint32_t       misses;
+   uint32_t       writebacks;    // dirty sectors written back to the device
+   uint32_t       bypassed;      // sectors in multi-sector transfers, uncached
+   uint32_t       slots;         // size of the cache in sectors
+   uint32_t       dirty;         // sectors waiting to be written back
+};
+
+int diskcache_stats(struct diskcache_stats *stats);
+
+#endif
@@ -41,6 +41,23 @@ struct econet_state {
    uint32_t       tx_buf_end;
    uint32_t       tx_status;
    uint32_t       timeout_state;
+   uint32_t       monitor_frames;
+   uint32_t       rx_queued;        // bytes queued or held in the ring
+   uint32_t       rx_refused;       // scouts refused, receive queue full
+   uint32_t       rx_overrun;       // queued or held frames overwritten
+};
+
+// A received frame in place in the receive ring, from
+// ECONET_GET_RXVIEW. The frame is the source station and net, then
+// the payload. If it wraps round the end of the ring, the rest of it
+// is at wrap. It's taken off the fd's queue, so another reader of the
+// fd gets the next frame, and stays valid until ECONET_RELEASE_RX | id.
+struct econet_rxview {
+   uint32_t       id;
+   const uint8_t  *data;
+   uint32_t       len;
+   const uint8_t  *wrap;            // NULL if the frame doesn't wrap
+   uint32_t       wraplen;
 };
 #endif
 
@@ -49,12 +66,22 @@ struct econet_state {
 #define ECONET_SET_SEND_ADDR  0x03000000
 #define ECONET_SET_MONITOR    0x04000000
 #define ECONET_SET_CLKTERM    0x05000000
+#define ECONET_SET_NONBLOCK   0x06000000     // arg 1 = writes return at once
+#define ECONET_RELEASE_RX     0x07000000     // arg = id of a ECONET_GET_RXVIEW frame
+#define ECONET_TX_COMMIT      0x08000000     // arg = length, send the ECONET_GET_TXBUF frame
 
 #define ECONET_GET_ADDR       0x81000000
 #define ECONET_GET_CLKTERM    0x85000000
+#define ECONET_GET_TXSTATUS   0x86000000     // result of the last write
+#define ECONET_GET_RXVIEW     0x87000000     // ptr = struct econet_rxview
+#define ECONET_GET_TXBUF      0x88000000     // ptr = uint8_t *, returns its size
 
 #define ECONET_DBG_BUF        0xF0000000
 
+// Largest payload a single write can carry: the 2K transmit buffer
+// also holds the scout frame and the data frame's address header.
+#define ECONET_MAX_PAYLOAD    2036
+
 // Low-level states
 #define ECONET_STATE_WAITSCOUT   0
 #define ECONET_STATE_WAITDATA    1
@@ -0,0 +1,53 @@
+#ifndef SYS_PROF_H
+#define SYS_PROF_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Sampling profiler, /dev/prof. Every timer tick (1ms) the interrupted
+// pc is counted in a histogram covering an address range, of user or
+// kernel code or both. Reading /dev/prof gives the histogram as 16 bit
+// counts, one for each 1 << shift bytes from lo. Counts stop at 0xFFFF.
+
+#include <stdint.h>
+
+#define PROF_START            0x01000000     // ptr = struct prof_range, or NULL for all memory
+#define PROF_STOP             0x02000000
+#define PROF_GET_STATUS       0x81000000     // ptr = struct prof_status
+
+struct prof_range {
+   uint32_t       lo;
+   uint32_t       hi;
+};
+
+struct prof_status {
+   uint32_t       running;
+   uint32_t       lo;
+   uint32_t       shift;         // log2 of the bytes per bucket
+   uint32_t       buckets;
+   uint32_t       samples;       // ticks sampled
+   uint32_t       outside;       // of those, ones outside the range
+   uint32_t       hz;            // sampling rate
+};
+
+#endif
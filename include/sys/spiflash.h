@@ -0,0 +1,40 @@
+#ifndef SYS_SPIFLASH_H
+#define SYS_SPIFLASH_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <stdint.h>
+
+// SPI flash device ioctls
+#define SPIFLASH_GET_STATS    0x81000000     // ptr = struct spiflash_stats
+
+// Counters for writes to the flash chip
+struct spiflash_stats {
+   uint32_t       erases;           // 4k sector erases issued
+   uint32_t       erases_avoided;   // block writes that needed no erase
+   uint32_t       pages_programmed;
+   uint32_t       pages_skipped;    // unchanged or blank pages not programmed
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SYS_TASK_H
+#define SYS_TASK_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <stddef.h>
+
+// Cooperative tasks. A task runs until it blocks in a system call
+// (e.g. reading from econet or poll), yields or exits, and then
+// another task that's ready gets to run.
+
+#define TASK_MAX           4        // including the program's main task
+#define TASK_KSTACK_SIZE   3072     // top of each task's stack used by the kernel
+
+// Start a task running fn(arg) on a stack of size bytes, which must be
+// at least twice TASK_KSTACK_SIZE. The stack and its size must be
+// multiples of 16 bytes. Returns the task number, or -1 with errno
+// set. The stack must stay allocated until the task ends.
+int task_create(void (*fn)(void *), void *arg, void *stack, size_t size);
+
+// Let other tasks run
+int task_yield(void);
+
+// End the calling task, which happens anyway when fn returns
+int task_exit(void);
+
+#endif
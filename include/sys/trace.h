@@ -0,0 +1,93 @@
+#ifndef SYS_TRACE_H
+#define SYS_TRACE_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Kernel trace events, read from /dev/trace. Each record is stamped
+// with the low 32 bits of the cycle counter (CPU_CLOCK_HZ, sys/clock.h).
+// Events come in classes which can be turned on and off: the class of
+// an event is its id >> 4.
+//
+// Events with an _END partner mark the start of something that takes
+// time, and the _END one marks when it finished.
+
+#define TRACE_CLASS(ev)       (1 << (((ev) & 0x7f) >> 4))
+#define TRACE_END             0x80
+
+#define TRACE_ECONET_RX       0x00     // a = handshake state, b = frame length
+#define TRACE_ECONET_TIMEOUT  0x01     // a = handshake state
+#define TRACE_SYSCALL         0x10     // a = syscall number, b = first arg
+#define TRACE_SYSCALL_END     0x90     // a = syscall number, b = return value
+#define TRACE_DISK_READ       0x20     // a = sector, b = drive << 16 | count
+#define TRACE_DISK_READ_END   0xA0     // a = result
+#define TRACE_DISK_WRITE      0x21     // a = sector, b = drive << 16 | count
+#define TRACE_DISK_WRITE_END  0xA1     // a = result
+#define TRACE_FLASH_ERASE     0x30     // a = address
+#define TRACE_FLASH_ERASE_END 0xB0
+#define TRACE_FLASH_PROGRAM   0x31     // a = address, b = length
+#define TRACE_FLASH_PROGRAM_END 0xB1
+#define TRACE_TASK_SWITCH     0x40     // a = from task, b = to task
+#define TRACE_TASK_CREATE     0x41     // a = new task
+#define TRACE_TASK_EXIT       0x42     // a = task
+
+#define TRACE_ECONET          TRACE_CLASS(TRACE_ECONET_RX)
+#define TRACE_SYSCALLS        TRACE_CLASS(TRACE_SYSCALL)
+#define TRACE_DISK            TRACE_CLASS(TRACE_DISK_READ)
+#define TRACE_FLASH           TRACE_CLASS(TRACE_FLASH_ERASE)
+#define TRACE_SCHED           TRACE_CLASS(TRACE_TASK_SWITCH)
+#define TRACE_ALL             0xff
+
+// Trace device ioctls
+#define TRACE_SET_MASK        0x01000000     // arg = classes to record
+#define TRACE_CLEAR           0x02000000     // throw away what's been recorded
+#define TRACE_GET_STATUS      0x81000000     // ptr = struct trace_status
+
+#ifndef ASM
+#include <stdint.h>
+
+struct trace_rec {
+   uint32_t       cycle;
+   uint32_t       event;
+   uint32_t       a;
+   uint32_t       b;
+};
+
+struct trace_status {
+   uint32_t       mask;
+   uint32_t       queued;        // records waiting to be read
+   uint32_t       lost;          // records overwritten before being read
+};
+
+// A saved trace is this header followed by the records
+#define TRACE_FILE_MAGIC      0x43525446     // "FTRC"
+
+struct trace_file_header {
+   uint32_t       magic;
+   uint32_t       clock_hz;
+   uint32_t       lost;
+   uint32_t       reserved;
+};
+#endif
+
+#endif
@@ -53,8 +53,13 @@ CmdTable commands[] = {
    {  .cmd = "mkdir",      .cmdfunc = i_mkdir },
    {  .cmd = "cd",         .cmdfunc = i_chdir },
    {  .cmd = "rm",         .cmdfunc = i_rm },
+   {  .cmd = "cp",         .cmdfunc = i_cp },
    {  .cmd = "poke",       .cmdfunc = i_poke },
    {  .cmd = "peek",       .cmdfunc = i_peek },
+   {  .cmd = "cachestat",  .cmdfunc = i_cachestat },
+   {  .cmd = "flashstat",  .cmdfunc = i_flashstat },
+   {  .cmd = "trace",      .cmdfunc = i_trace },
+   {  .cmd = "prof",       .cmdfunc = i_prof },
    {  .cmd = NULL }
 };
 
@@ -80,6 +85,7 @@ int cli(int fd)
          printf("Unable to read from fd %d\n", fd);
          return -1;
       }
+      if(bytes == 0) break;      // end of input
 
       parse_cmd(raw_cmdbuf);
    }
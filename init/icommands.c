@@ -35,6 +35,12 @@
 #include <sys/console.h>
 #include <sys/dirent.h>
 #include <sys/stat.h>
+#include <sys/diskcache.h>
+#include <sys/spiflash.h>
+#include <sys/sendfile.h>
+#include <sys/clock.h>
+#include <sys/trace.h>
+#include <sys/prof.h>
 #include <syscall.h>
 #include <errno.h>
 
@@ -44,7 +50,11 @@
 
 void i_ebreak(int argc, char **argv)
 {
+#ifdef SIMULATOR
+   __builtin_trap();
+#else
    asm("ebreak");
+#endif
 }
 
 // ----------------------------------------------------------------------------
@@ -199,4 +209,280 @@ void i_rm(int argc, char **argv)
    }
 }
 
+// Copy a file, e.g. from SD to flash. The kernel moves the data,
+// so it doesn't pass through here.
+void i_cp(int argc, char **argv)
+{
+   if(argc != 3) {
+      printf("usage: cp <from> <to>\n");
+      return;
+   }
+
+   struct stat st;
+   if(stat(argv[1], &st) < 0) {
+      perror(argv[1]);
+      return;
+   }
+
+   int in = open(argv[1], O_RDONLY);
+   if(in < 0) {
+      perror(argv[1]);
+      return;
+   }
+   int out = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0666);
+   if(out < 0) {
+      perror(argv[2]);
+      close(in);
+      return;
+   }
+
+   off_t copied = 0;
+   while(copied < st.st_size) {
+      ssize_t rc = sendfile(out, in, &copied, st.st_size - copied);
+      if(rc < 0) {
+         perror("sendfile");
+         break;
+      }
+      if(rc == 0) break;
+   }
+
+   close(out);
+   close(in);
+   printf("%ld bytes copied\n", (long)copied);
+}
+
+// -------------------------------------------------------
+// Disk cache statistics
+void i_cachestat(int argc, char **argv)
+{
+   struct diskcache_stats st;
+
+   if(diskcache_stats(&st) < 0) {
+      perror("diskcache_stats");
+      return;
+   }
+
+   printf("hits:       %lu\n", st.hits);
+   printf("misses:     %lu\n", st.misses);
+   printf("writebacks: %lu\n", st.writebacks);
+   printf("bypassed:   %lu\n", st.bypassed);
+   printf("dirty:      %lu/%lu\n", st.dirty, st.slots);
+}
+
+// -------------------------------------------------------
+// SPI flash write statistics
+void i_flashstat(int argc, char **argv)
+{
+   struct spiflash_stats st;
+
+   int fd = open("/dev/spiflash", O_RDONLY);
+   if(fd < 0) {
+      perror("open");
+      return;
+   }
+   int rc = ioctl(fd, SPIFLASH_GET_STATS, &st);
+   close(fd);
+   if(rc < 0) {
+      perror("ioctl");
+      return;
+   }
+
+   printf("erases:         %lu\n", st.erases);
+   printf("erases avoided: %lu\n", st.erases_avoided);
+   printf("pages written:  %lu\n", st.pages_programmed);
+   printf("pages skipped:  %lu\n", st.pages_skipped);
+}
+
+// -------------------------------------------------------
+// Kernel trace: show what's been recorded, choose which classes of
+// event are recorded, or save the records to a file to be turned
+// into a timeline on the host (tools/trace2json.c).
+static void trace_usage(void)
+{
+   printf("usage: trace [mask <hex> | clear | save <file>]\n");
+   printf("mask bits: %02x econet, %02x syscalls, %02x disk, %02x flash, %02x sched\n",
+         TRACE_ECONET, TRACE_SYSCALLS, TRACE_DISK, TRACE_FLASH, TRACE_SCHED);
+}
+
+static void trace_save(int fd, const char *filename)
+{
+   struct trace_status st;
+   struct trace_rec recs[16];
+
+   if(ioctl(fd, TRACE_GET_STATUS, &st) < 0) {
+      perror("ioctl");
+      return;
+   }
+
+   int out = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+   if(out < 0) {
+      perror(filename);
+      return;
+   }
+
+   struct trace_file_header hdr = {
+      .magic = TRACE_FILE_MAGIC,
+      .clock_hz = CPU_CLOCK_HZ,
+      .lost = st.lost
+   };
+   long count = 0;
+   if(write(out, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+      ssize_t rc;
+      while((rc = read(fd, recs, sizeof(recs))) > 0) {
+         if(write(out, recs, rc) != rc) {
+            perror("write");
+            break;
+         }
+         count += rc / sizeof(struct trace_rec);
+      }
+   }
+   else {
+      perror("write");
+   }
 
+   close(out);
+   printf("%ld records saved, %lu lost\n", count, (unsigned long)st.lost);
+}
+
+void i_trace(int argc, char **argv)
+{
+   int fd = open("/dev/trace", O_RDONLY);
+   if(fd < 0) {
+      perror("open");
+      return;
+   }
+
+   if(argc == 1) {
+      struct trace_status st;
+      if(ioctl(fd, TRACE_GET_STATUS, &st) < 0) {
+         perror("ioctl");
+      }
+      else {
+         printf("mask:   %02lx\n", (unsigned long)st.mask);
+         printf("queued: %lu\n", (unsigned long)st.queued);
+         printf("lost:   %lu\n", (unsigned long)st.lost);
+      }
+   }
+   else if(argc == 3 && !strcmp(argv[1], "mask")) {
+      char *end;
+      unsigned long mask = strtoul(argv[2], &end, 16);
+      if(*end || mask > TRACE_ALL)
+         trace_usage();
+      else if(ioctl(fd, TRACE_SET_MASK | mask) < 0)
+         perror("ioctl");
+   }
+   else if(argc == 2 && !strcmp(argv[1], "clear")) {
+      if(ioctl(fd, TRACE_CLEAR) < 0)
+         perror("ioctl");
+   }
+   else if(argc == 3 && !strcmp(argv[1], "save")) {
+      trace_save(fd, argv[2]);
+   }
+   else {
+      trace_usage();
+   }
+
+   close(fd);
+}
+
+// -------------------------------------------------------
+// Sampling profiler: start it over an address range (all of memory
+// by default), stop it, and dump the histogram to the console or a
+// file, for tools/profsym.py to put names to.
+static void prof_usage(void)
+{
+   printf("usage: prof [start [<lo> <hi>] | stop | dump [<file>]]\n");
+}
+
+static void prof_dump(int fd, const char *filename)
+{
+   struct prof_status st;
+   if(ioctl(fd, PROF_GET_STATUS, &st) < 0) {
+      perror("ioctl");
+      return;
+   }
+
+   int out = 1;
+   fflush(stdout);
+   if(filename) {
+      out = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+      if(out < 0) {
+         perror(filename);
+         return;
+      }
+   }
+
+   char line[64];
+   int len = snprintf(line, sizeof(line), "prof %08lx %lu %lu %lu %lu\n",
+         (unsigned long)st.lo, (unsigned long)st.shift, (unsigned long)st.hz,
+         (unsigned long)st.samples, (unsigned long)st.outside);
+   write(out, line, len);
+
+   uint16_t counts[64];
+   uint32_t addr = st.lo;
+   ssize_t rc;
+   while((rc = read(fd, counts, sizeof(counts))) > 0) {
+      for(int i = 0; i < rc / sizeof(uint16_t); i++) {
+         if(counts[i]) {
+            len = snprintf(line, sizeof(line), "%08lx %u\n",
+                  (unsigned long)addr, counts[i]);
+            write(out, line, len);
+         }
+         addr += 1 << st.shift;
+      }
+   }
+
+   if(filename) close(out);
+}
+
+void i_prof(int argc, char **argv)
+{
+   int fd = open("/dev/prof", O_RDONLY);
+   if(fd < 0) {
+      perror("open");
+      return;
+   }
+
+   if(argc == 1) {
+      struct prof_status st;
+      if(ioctl(fd, PROF_GET_STATUS, &st) < 0) {
+         perror("ioctl");
+      }
+      else {
+         printf("%s, %lu samples, %lu outside %08lx-%08lx\n",
+               st.running ? "running" : "stopped",
+               (unsigned long)st.samples, (unsigned long)st.outside,
+               (unsigned long)st.lo,
+               (unsigned long)(st.lo + (st.buckets << st.shift)));
+      }
+   }
+   else if(!strcmp(argv[1], "start") && (argc == 2 || argc == 4)) {
+      struct prof_range range;
+      struct prof_range *rp = NULL;
+      if(argc == 4) {
+         char *end1, *end2;
+         range.lo = strtoul(argv[2], &end1, 16);
+         range.hi = strtoul(argv[3], &end2, 16);
+         if(*end1 || *end2) {
+            prof_usage();
+            close(fd);
+            return;
+         }
+         rp = &range;
+      }
+      if(ioctl(fd, PROF_START, rp) < 0)
+         perror("ioctl");
+   }
+   else if(argc == 2 && !strcmp(argv[1], "stop")) {
+      if(ioctl(fd, PROF_STOP) < 0)
+         perror("ioctl");
+   }
+   else if(!strcmp(argv[1], "dump") && argc <= 3) {
+      prof_dump(fd, argc == 3 ? argv[2] : NULL);
+   }
+   else {
+      prof_usage();
+   }
+
+   close(fd);
+}
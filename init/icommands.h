@@ -11,6 +11,11 @@ void i_configure(int argc, char **argv);
 void i_mkdir(int argc, char **argv);
 void i_chdir(int argc, char **argv);
 void i_rm(int argc, char **argv);
+void i_cp(int argc, char **argv);
+void i_cachestat(int argc, char **argv);
+void i_flashstat(int argc, char **argv);
+void i_trace(int argc, char **argv);
+void i_prof(int argc, char **argv);
 
 #endif
 
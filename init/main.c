@@ -53,6 +53,10 @@ main(int argc, char **argv)
             printf("errno = %d\n", e);
          }
 
+         // the SD card is optional, its files are on drive 1:
+         if(mount("sd", "", "fatfs", 0, NULL) == 0)
+            printf("Mounted SD card\n");
+
          if(run_script("boot.rc") == -1) {
             printf("No boot.rc file\n");
          }
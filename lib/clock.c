@@ -0,0 +1,80 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/clock.h>
+
+#define SYS_CLOCK_GETTIME  113
+
+// The cycle counter can be read in user mode, so the time doesn't
+// need a system call. cycleh is read either side of cycle in case
+// cycle wraps in between.
+static uint64_t
+read_cycles(void)
+{
+   uint32_t hi, lo, hi2;
+   do {
+      asm volatile("csrr %0, cycleh" : "=r"(hi));
+      asm volatile("csrr %0, cycle" : "=r"(lo));
+      asm volatile("csrr %0, cycleh" : "=r"(hi2));
+   } while(hi != hi2);
+
+   return (uint64_t)hi << 32 | lo;
+}
+
+int
+clock_gettime(clockid_t clk, struct timespec *ts)
+{
+   if(clk == CLOCK_MONOTONIC || clk == CLOCK_REALTIME) {
+      uint64_t cycles = read_cycles();
+      ts->tv_sec = cycles / CPU_CLOCK_HZ;
+      ts->tv_nsec = (cycles % CPU_CLOCK_HZ) * 1000000000 / CPU_CLOCK_HZ;
+      return 0;
+   }
+
+   // let the kernel decide about any other clock
+   register uint32_t          syscall  asm("a7") = SYS_CLOCK_GETTIME;
+   register clockid_t         _clk     asm("a0") = clk;
+   register struct timespec   *_ts     asm("a1") = ts;
+   register int               _rc      asm("a0");
+   asm volatile("ecall"
+         : "=r"(_rc)
+         : "r"(_clk), "r"(_ts), "r"(syscall)
+         : "memory");
+   if(_rc < 0) {
+      errno = -_rc;
+      return -1;
+   }
+   return 0;
+}
+
+int
+gettimeofday(struct timeval *tv, void *tz)
+{
+   uint64_t cycles = read_cycles();
+   tv->tv_sec = cycles / CPU_CLOCK_HZ;
+   tv->tv_usec = (cycles % CPU_CLOCK_HZ) / (CPU_CLOCK_HZ / 1000000);
+   return 0;
+}
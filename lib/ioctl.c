@@ -48,9 +48,9 @@ int ioctl(int fd, unsigned long request, ...) {
          : "=r"(_rc)
          : "r"(_fd), "r"(_req), "r"(_ptr), "r"(syscall));
    if(_rc < 0) {
-      errno = _rc;
+      errno = -_rc;
       return -1;
    }
-   return 0;
+   return _rc;
 }
 
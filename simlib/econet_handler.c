@@ -1,8 +0,0 @@
-#include "udp_econet.h"
-
-
-int
-handle_scout(uint8_t *rxbuf)
-{
-   
-}
@@ -0,0 +1,100 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// econet_stations.c: the station table, mapping econet stations to
+// UDP addresses. Shared by the simulator and host tools such as
+// netfs-bench, so they agree on where each station lives.
+
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <netdb.h>
+#include <errno.h>
+
+#include "udp_econet.h"
+
+// Read the econet configuration info in b-em format
+// (net, station, ip, port)
+static int
+parse_stn(char *buf, EconetStation *stn)
+{
+   static struct addrinfo hints = {
+      .ai_family = AF_INET,
+      .ai_socktype = SOCK_DGRAM,
+      .ai_flags = 0,
+      .ai_protocol = 0};
+
+   struct addrinfo *result;
+   char host[128];
+   int net, station, port;
+
+   if(sscanf(buf, "%d %d %127s %d", &net, &station, host, &port) != 4)
+      return 0;
+
+   if(station > 0 && station < 256 && net >= 0 && net < 256 && port > 0) {
+      int rc = getaddrinfo(host, NULL, &hints, &result);
+      if(rc != 0) {
+         fprintf(stderr, "unable to look up host %s\n", host);
+         return 0;
+      }
+
+      if(result->ai_family == AF_INET) {
+         struct sockaddr_in *sin = (struct sockaddr_in *)result->ai_addr;
+         memcpy(&stn->addr, sin, sizeof(struct sockaddr_in));
+         stn->addr.sin_port = htons(port);
+
+         stn->net = net;
+         stn->station = station;
+         stn->port = port;
+
+         freeaddrinfo(result);
+         return 1;
+      }
+
+      freeaddrinfo(result);
+   }
+
+   // not a valid config line
+   return 0;
+}
+
+//------------------------------------------------------------------
+// Read the station table from a configuration file.
+int
+sim_read_stations(const char *cfgfile, EconetStation *table, int max)
+{
+   char buf[128];
+   int count = 0;
+
+   FILE *stream = fopen(cfgfile, "r");
+   if(!stream) return -1;
+
+   memset(table, 0, sizeof(EconetStation) * max);
+   while(count < max && fgets(buf, sizeof(buf), stream)) {
+      if(isdigit(buf[0]))
+         count += parse_stn(buf, &table[count]);
+   }
+   fclose(stream);
+   return count;
+}
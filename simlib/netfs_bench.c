@@ -0,0 +1,672 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+
+// netfs_bench.c: NetFS load generator. Runs a number of simulated
+// client stations against a fileserver (normally fileserver-sim), each
+// running a script of NetFS operations in a loop, then reports the
+// throughput and latency for each function code.
+//
+// Client stations are taken from the station table in order, skipping
+// the fileserver, so the fileserver's table must list them too. Each
+// one has its own UDP socket and performs the four way handshake
+// itself, like a BBC with no one else on its network.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/select.h>
+
+#include "udp_econet.h"
+
+#define NETFS_PORT      0x99     // fileserver command port
+#define REPLY_PORT      0x90     // where we ask for replies
+#define DATA_PORT       0x92     // where we ask for LOAD/GETBYTES data
+#define ACK_PORT        0x93     // where we ask for SAVE block acks
+
+#define FC_SAVE         0x01
+#define FC_LOAD         0x02
+#define FC_EXAMINE      0x03
+#define FC_OPEN         0x06
+#define FC_CLOSE        0x07
+#define FC_GETBYTES     0x0a
+#define FC_READ_OBJINFO 0x12
+#define FC_READ_USERENV 0x15
+#define FC_COUNT        0x21
+
+#define EXAMINE_COUNT   16       // entries asked for per EXAMINE
+#define MAX_OPS         32
+
+typedef enum {
+   OP_IAM,
+   OP_CAT,
+   OP_SAVE,
+   OP_LOAD,
+   OP_GETBYTES
+} BenchOp;
+
+static const char *op_names[] = { "iam", "cat", "save", "load", "getbytes" };
+
+static const char *fc_names[FC_COUNT] = {
+   [0x00] = "commandline",
+   [FC_SAVE] = "save",
+   [FC_LOAD] = "load",
+   [FC_EXAMINE] = "examine",
+   [FC_OPEN] = "open",
+   [FC_CLOSE] = "close",
+   [FC_GETBYTES] = "getbytes",
+   [FC_READ_OBJINFO] = "read objinfo",
+   [FC_READ_USERENV] = "read userenv",
+};
+
+// Latency samples for one function code, in microseconds
+typedef struct {
+   uint32_t    *samples;
+   size_t      count;
+   size_t      size;
+   uint32_t    errors;
+} FCStats;
+
+typedef struct {
+   EconetStation  *stn;
+   pthread_t      thread;
+   int            sockfd;
+   uint8_t        urd, csd, lib;
+   char           filename[16];
+   uint64_t       bytes;
+   uint32_t       refused;       // scouts not acked, retried
+   FCStats        stats[FC_COUNT];
+} Client;
+
+static EconetStation stations[MAX_STATIONS];
+static EconetStation *server;
+static BenchOp script[MAX_OPS];
+static int script_len;
+static uint64_t deadline;
+static int reply_timeout = 1000;
+static uint32_t file_size = 16384;
+static uint32_t block_size = 512;
+static int getbytes_count = 16;
+
+static uint64_t
+now_us()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint32_t
+get_le24(const uint8_t *ptr)
+{
+   return ptr[0] | ptr[1] << 8 | ptr[2] << 16;
+}
+
+static void
+put_le24(uint8_t *ptr, uint32_t val)
+{
+   ptr[0] = val;
+   ptr[1] = val >> 8;
+   ptr[2] = val >> 16;
+}
+
+//------------------------------------------------------------
+// Record how long a request took
+static void
+record(Client *c, uint8_t fc, uint64_t start, bool ok)
+{
+   FCStats *st = &c->stats[fc];
+   if(!ok) {
+      st->errors++;
+      return;
+   }
+
+   if(st->count == st->size) {
+      st->size = st->size ? st->size * 2 : 1024;
+      st->samples = realloc(st->samples, st->size * sizeof(uint32_t));
+      if(st->samples == NULL) {
+         perror("netfs-bench");
+         exit(1);
+      }
+   }
+   st->samples[st->count++] = now_us() - start;
+}
+
+//------------------------------------------------------------
+// Frame level I/O, following udp_econet.c's frame format.
+
+// Send a frame to the fileserver
+static void
+send_frame(Client *c, const uint8_t *body, size_t len)
+{
+   uint8_t frame[MAX_ECONET_BUF];
+
+   frame[0] = server->station;
+   frame[1] = server->net;
+   frame[2] = c->stn->station;
+   frame[3] = c->stn->net;
+   memcpy(frame + FRAME_HDR_LEN, body, len);
+   sendto(c->sockfd, frame, len + FRAME_HDR_LEN, 0,
+         (const struct sockaddr *)&server->addr, sizeof(server->addr));
+}
+
+// Wait for a frame from the fileserver, until the time given (us).
+// Returns its length, or 0 on timeout.
+static ssize_t
+recv_frame(Client *c, uint8_t *buf, size_t size, uint64_t until)
+{
+   while(1) {
+      uint64_t now = now_us();
+      if(now >= until) return 0;
+
+      fd_set rfds;
+      struct timeval tv = { (until - now) / 1000000, (until - now) % 1000000 };
+      FD_ZERO(&rfds);
+      FD_SET(c->sockfd, &rfds);
+      if(select(c->sockfd + 1, &rfds, NULL, NULL, &tv) <= 0) continue;
+
+      ssize_t len = recv(c->sockfd, buf, size, 0);
+      if(len < FRAME_HDR_LEN) continue;
+      if(buf[2] == server->station && buf[3] == server->net)
+         return len;
+   }
+}
+
+// Send data to a port on the fileserver. A scout that isn't acked
+// (the fileserver's queue is full) is retried, as the NFS ROM does,
+// until the reply timeout. Returns false if it couldn't be sent.
+static bool
+tx(Client *c, uint8_t port, const uint8_t *data, size_t len)
+{
+   uint8_t frame[MAX_ECONET_BUF];
+   uint8_t scout[2] = { 0x80, port };
+   uint64_t until = now_us() + reply_timeout * 1000;
+
+   while(1) {
+      send_frame(c, scout, sizeof(scout));
+      ssize_t got = recv_frame(c, frame, sizeof(frame), now_us() + SIM_ACK_TIMEOUT * 1000);
+      if(got == FRAME_HDR_LEN) break;
+
+      c->refused++;
+      if(now_us() >= until) return false;
+      usleep(1000);
+   }
+
+   send_frame(c, data, len);
+   return recv_frame(c, frame, sizeof(frame), now_us() + SIM_ACK_TIMEOUT * 1000)
+      == FRAME_HDR_LEN;
+}
+
+// Receive data sent by the fileserver to one of our ports.
+// Returns the number of bytes, or -1 on timeout.
+static ssize_t
+rx(Client *c, uint8_t port, uint8_t *buf, size_t size)
+{
+   uint8_t frame[MAX_ECONET_BUF];
+   uint64_t until = now_us() + reply_timeout * 1000;
+   uint8_t ack = 0;
+
+   while(1) {
+      ssize_t got = recv_frame(c, frame, sizeof(frame), until);
+      if(got == 0) return -1;
+      if(got == SCOUT_LEN && (frame[4] & 0x80) && frame[5] == port) break;
+   }
+   send_frame(c, &ack, 0);
+
+   ssize_t got = recv_frame(c, frame, sizeof(frame), now_us() + SIM_ACK_TIMEOUT * 1000);
+   if(got < FRAME_HDR_LEN) return -1;
+   send_frame(c, &ack, 0);
+
+   got -= FRAME_HDR_LEN;
+   if(got > size) got = size;
+   memcpy(buf, frame + FRAME_HDR_LEN, got);
+   return got;
+}
+
+//------------------------------------------------------------
+// NetFS requests
+
+// Send a request and wait for its reply. The urd slot is passed
+// separately since bulk transfers use it for a port number.
+// Returns the reply length, or -1 if there was no reply or the
+// fileserver returned an error.
+static ssize_t
+request(Client *c, uint8_t fc, uint8_t urd, const void *payload, size_t len,
+      uint8_t *reply, size_t replysize)
+{
+   uint8_t msg[MAX_ECONET_BUF];
+
+   msg[0] = REPLY_PORT;
+   msg[1] = fc;
+   msg[2] = urd;
+   msg[3] = c->csd;
+   msg[4] = c->lib;
+   memcpy(msg + 5, payload, len);
+   if(!tx(c, NETFS_PORT, msg, len + 5)) return -1;
+
+   ssize_t got = rx(c, REPLY_PORT, reply, replysize);
+   if(got < 2 || reply[1] != 0) return -1;
+   return got;
+}
+
+// Receive count bytes of bulk data on our data port
+static bool
+recv_bulk(Client *c, uint32_t count)
+{
+   uint8_t buf[MAX_ECONET_BUF];
+   uint32_t got = 0;
+
+   while(got < count) {
+      ssize_t len = rx(c, DATA_PORT, buf, sizeof(buf));
+      if(len <= 0) return false;
+      got += len;
+   }
+   c->bytes += got;
+   return true;
+}
+
+// Build a filename request field
+static size_t
+put_name(uint8_t *buf, const char *name)
+{
+   size_t len = strlen(name);
+   memcpy(buf, name, len);
+   buf[len] = 0x0d;
+   return len + 1;
+}
+
+//------------------------------------------------------------
+// Scripted operations. Each returns false if it failed part way.
+
+// *I AM, with all the handles zero
+static bool
+op_iam(Client *c)
+{
+   uint8_t reply[16];
+   char cmd[32];
+   uint64_t start = now_us();
+
+   c->urd = c->csd = c->lib = 0;
+   snprintf(cmd, sizeof(cmd), "I AM BENCH%d\r", c->stn->station);
+   ssize_t got = request(c, 0, 0, cmd, strlen(cmd), reply, sizeof(reply));
+   record(c, 0, start, got >= 6);
+   if(got < 6) return false;
+
+   c->urd = reply[2];
+   c->csd = reply[3];
+   c->lib = reply[4];
+   return true;
+}
+
+// *CAT: read the directory's info, the user environment, then
+// EXAMINE until the whole directory has been listed.
+static bool
+op_cat(Client *c)
+{
+   uint8_t req[8];
+   uint8_t reply[MAX_ECONET_BUF];
+   uint64_t start = now_us();
+
+   req[0] = 6;          // access and cycle number of dir
+   size_t len = 1 + put_name(req + 1, "");
+   bool ok = request(c, FC_READ_OBJINFO, c->urd, req, len, reply, sizeof(reply)) >= 0;
+   record(c, FC_READ_OBJINFO, start, ok);
+   if(!ok) return false;
+
+   start = now_us();
+   ok = request(c, FC_READ_USERENV, c->urd, NULL, 0, reply, sizeof(reply)) >= 0;
+   record(c, FC_READ_USERENV, start, ok);
+   if(!ok) return false;
+
+   uint8_t entry = 0;
+   while(1) {
+      req[0] = 3;       // object names and formats
+      req[1] = entry;
+      req[2] = EXAMINE_COUNT;
+      len = 3 + put_name(req + 3, "");
+
+      start = now_us();
+      ssize_t got = request(c, FC_EXAMINE, c->urd, req, len, reply, sizeof(reply));
+      record(c, FC_EXAMINE, start, got >= 3);
+      if(got < 3) return false;
+
+      c->bytes += got;
+      if(reply[2] < EXAMINE_COUNT) return true;
+      entry += reply[2];
+   }
+}
+
+// SAVE file_size bytes to the station's own file
+static bool
+op_save(Client *c)
+{
+   uint8_t req[32];
+   uint8_t reply[8];
+   uint8_t block[MAX_ECONET_BUF];
+   uint64_t start = now_us();
+
+   memset(req, 0xff, 8);         // load and exec addresses
+   put_le24(req + 8, file_size);
+   size_t len = 11 + put_name(req + 11, c->filename);
+
+   bool ok = request(c, FC_SAVE, ACK_PORT, req, len, reply, sizeof(reply)) >= 5;
+   if(ok) {
+      uint8_t data_port = reply[2];
+      uint32_t blksize = reply[3] | reply[4] << 8;
+      uint32_t sent = 0;
+
+      if(blksize == 0 || blksize > sizeof(block)) blksize = sizeof(block);
+      memset(block, c->stn->station, sizeof(block));
+
+      while(ok && sent < file_size) {
+         uint32_t count = file_size - sent;
+         if(count > blksize) count = blksize;
+
+         ok = tx(c, data_port, block, count);
+         sent += count;
+
+         // each block but the last is acked, the final reply acks that
+         if(ok && sent < file_size)
+            ok = rx(c, ACK_PORT, reply, sizeof(reply)) >= 0;
+      }
+
+      if(ok) {
+         ssize_t got = rx(c, REPLY_PORT, reply, sizeof(reply));
+         ok = got >= 2 && reply[1] == 0;
+      }
+      if(ok) c->bytes += file_size;
+   }
+
+   record(c, FC_SAVE, start, ok);
+   return ok;
+}
+
+// LOAD the station's own file
+static bool
+op_load(Client *c)
+{
+   uint8_t req[32];
+   uint8_t reply[16];
+   uint64_t start = now_us();
+
+   size_t len = put_name(req, c->filename);
+   bool ok = request(c, FC_LOAD, DATA_PORT, req, len, reply, sizeof(reply)) >= 13;
+   if(ok) ok = recv_bulk(c, get_le24(reply + 10));
+   if(ok) ok = rx(c, REPLY_PORT, reply, sizeof(reply)) >= 2 && reply[1] == 0;
+
+   record(c, FC_LOAD, start, ok);
+   return ok;
+}
+
+// OPEN the station's file, GETBYTES blocks from it working through
+// the file, then CLOSE it.
+static bool
+op_getbytes(Client *c)
+{
+   uint8_t req[32];
+   uint8_t reply[16];
+   uint64_t start = now_us();
+
+   req[0] = 1;          // must exist
+   req[1] = 1;          // read only
+   size_t len = 2 + put_name(req + 2, c->filename);
+   bool ok = request(c, FC_OPEN, c->urd, req, len, reply, sizeof(reply)) >= 3;
+   record(c, FC_OPEN, start, ok);
+   if(!ok) return false;
+
+   uint8_t handle = reply[2];
+   uint32_t offset = 0;
+   for(int i = 0; ok && i < getbytes_count; i++) {
+      req[0] = handle;
+      req[1] = 0;       // use the offset given
+      put_le24(req + 2, block_size);
+      put_le24(req + 5, offset);
+
+      start = now_us();
+      ok = request(c, FC_GETBYTES, DATA_PORT, req, 8, reply, sizeof(reply)) >= 0;
+      if(ok) ok = recv_bulk(c, block_size);
+      if(ok) ok = rx(c, REPLY_PORT, reply, sizeof(reply)) >= 6 && reply[1] == 0;
+      record(c, FC_GETBYTES, start, ok);
+
+      offset += block_size;
+      if(offset >= file_size) offset = 0;
+   }
+
+   start = now_us();
+   bool closed = request(c, FC_CLOSE, c->urd, &handle, 1, reply, sizeof(reply)) >= 0;
+   record(c, FC_CLOSE, start, closed);
+   return ok && closed;
+}
+
+static void *
+client_thread(void *ptr)
+{
+   Client *c = ptr;
+
+   while(now_us() < deadline) {
+      for(int i = 0; i < script_len && now_us() < deadline; i++) {
+         switch(script[i]) {
+            case OP_IAM:      op_iam(c);        break;
+            case OP_CAT:      op_cat(c);        break;
+            case OP_SAVE:     op_save(c);       break;
+            case OP_LOAD:     op_load(c);       break;
+            case OP_GETBYTES: op_getbytes(c);   break;
+         }
+      }
+   }
+   return NULL;
+}
+
+//------------------------------------------------------------
+// Results
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of sorted samples, in ms
+static double
+percentile(const FCStats *st, double p)
+{
+   size_t rank = (size_t)(p * st->count + 0.999999);
+   if(rank < 1) rank = 1;
+   return st->samples[rank - 1] / 1000.0;
+}
+
+static void
+report(Client *clients, int nclients, double secs)
+{
+   uint64_t bytes = 0;
+   uint32_t refused = 0;
+   FCStats total[FC_COUNT];
+
+   memset(total, 0, sizeof(total));
+   for(int i = 0; i < nclients; i++) {
+      bytes += clients[i].bytes;
+      refused += clients[i].refused;
+
+      for(int fc = 0; fc < FC_COUNT; fc++) {
+         FCStats *from = &clients[i].stats[fc];
+         FCStats *to = &total[fc];
+         to->errors += from->errors;
+         if(from->count == 0) continue;
+
+         to->samples = realloc(to->samples, (to->count + from->count) * sizeof(uint32_t));
+         memcpy(to->samples + to->count, from->samples, from->count * sizeof(uint32_t));
+         to->count += from->count;
+      }
+   }
+
+   uint64_t ops = 0;
+   for(int fc = 0; fc < FC_COUNT; fc++) ops += total[fc].count;
+
+   printf("%d stations, %.1f s: %.1f ops/s, %.1f KB/s, %u scouts refused\n\n",
+         nclients, secs, ops / secs, bytes / secs / 1024, refused);
+   printf("fc    %-14s %8s %7s %9s %9s %9s %9s\n",
+         "function", "ops", "errors", "ops/s", "p50 ms", "p99 ms", "p999 ms");
+
+   for(int fc = 0; fc < FC_COUNT; fc++) {
+      FCStats *st = &total[fc];
+      if(st->count == 0 && st->errors == 0) continue;
+
+      printf("0x%02x  %-14s %8zu %7u %9.1f", fc, fc_names[fc] ? fc_names[fc] : "?",
+            st->count, st->errors, st->count / secs);
+      if(st->count) {
+         qsort(st->samples, st->count, sizeof(uint32_t), cmp_u32);
+         printf(" %9.2f %9.2f %9.2f", percentile(st, 0.5), percentile(st, 0.99),
+               percentile(st, 0.999));
+      }
+      printf("\n");
+      free(st->samples);
+   }
+}
+
+//------------------------------------------------------------
+static void
+usage(int status)
+{
+   fprintf(status ? stderr : stdout,
+      "usage: netfs-bench [options] [op...]\n"
+      "  -c file   station table (default %s)\n"
+      "  -s stn    fileserver station, [net.]station (default 254)\n"
+      "  -n count  number of client stations (default 1)\n"
+      "  -t secs   how long to run (default 10)\n"
+      "  -z bytes  file size for SAVE and LOAD (default 16384)\n"
+      "  -b bytes  block size for GETBYTES (default 512)\n"
+      "  -g count  GETBYTES per getbytes op (default 16)\n"
+      "  -w ms     reply timeout (default 1000)\n"
+      "  -h        show this help\n"
+      "ops: iam cat save load getbytes, run in a loop by every station\n"
+      "(default: iam cat save load getbytes)\n", "econet.cfg");
+   exit(status);
+}
+
+static bool
+parse_op(const char *name)
+{
+   for(int op = 0; op < sizeof(op_names) / sizeof(op_names[0]); op++) {
+      if(!strcasecmp(name, op_names[op])) {
+         if(script_len == MAX_OPS) return false;
+         script[script_len++] = op;
+         return true;
+      }
+   }
+   return false;
+}
+
+int
+main(int argc, char **argv)
+{
+   const char *cfgfile = "econet.cfg";
+   int srv_net = 0, srv_station = 254;
+   int nclients = 1;
+   int secs = 10;
+   int opt;
+
+   while((opt = getopt(argc, argv, "c:s:n:t:z:b:g:w:h")) != -1) {
+      switch(opt) {
+         case 'c': cfgfile = optarg; break;
+         case 's':
+            if(sscanf(optarg, "%d.%d", &srv_net, &srv_station) != 2) {
+               srv_net = 0;
+               srv_station = atoi(optarg);
+            }
+            break;
+         case 'n': nclients = atoi(optarg); break;
+         case 't': secs = atoi(optarg); break;
+         case 'z': file_size = atoi(optarg); break;
+         case 'b': block_size = atoi(optarg); break;
+         case 'g': getbytes_count = atoi(optarg); break;
+         case 'w': reply_timeout = atoi(optarg); break;
+         case 'h': usage(0);
+         default: usage(1);
+      }
+   }
+
+   for(int i = optind; i < argc; i++) {
+      if(!parse_op(argv[i])) usage(1);
+   }
+   if(script_len == 0) {
+      for(int op = OP_IAM; op <= OP_GETBYTES; op++) script[script_len++] = op;
+   }
+
+   if(nclients < 1 || secs < 1 || block_size < 1 || block_size > 0xffffff ||
+         file_size > 0xffffff)
+      usage(1);
+
+   int count = sim_read_stations(cfgfile, stations, MAX_STATIONS);
+   if(count < 0) {
+      perror(cfgfile);
+      return 1;
+   }
+
+   Client *clients = calloc(nclients, sizeof(Client));
+   int found = 0;
+   for(int i = 0; i < count; i++) {
+      if(stations[i].net == srv_net && stations[i].station == srv_station)
+         server = &stations[i];
+      else if(found < nclients)
+         clients[found++].stn = &stations[i];
+   }
+
+   if(server == NULL) {
+      fprintf(stderr, "fileserver %d.%d isn't in %s\n", srv_net, srv_station, cfgfile);
+      return 1;
+   }
+   if(found < nclients) {
+      fprintf(stderr, "%s only has %d client stations\n", cfgfile, found);
+      return 1;
+   }
+
+   for(int i = 0; i < nclients; i++) {
+      Client *c = &clients[i];
+      c->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+      if(c->sockfd < 0 ||
+            bind(c->sockfd, (struct sockaddr *)&c->stn->addr, sizeof(c->stn->addr)) < 0) {
+         fprintf(stderr, "station %d.%d: %s\n", c->stn->net, c->stn->station,
+               strerror(errno));
+         return 1;
+      }
+      snprintf(c->filename, sizeof(c->filename), "BENCH%d", c->stn->station);
+   }
+
+   uint64_t start = now_us();
+   deadline = start + (uint64_t)secs * 1000000;
+   for(int i = 0; i < nclients; i++)
+      pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+   for(int i = 0; i < nclients; i++)
+      pthread_join(clients[i].thread, NULL);
+
+   report(clients, nclients, (now_us() - start) / 1000000.0);
+   return 0;
+}
@@ -22,11 +22,13 @@
 ;THE SOFTWARE.
 */
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <sys/select.h>
 
 #include "console.h"
 #include "fd.h"
@@ -38,6 +40,8 @@ static FDfunction cons_func = {
    .fd_lseek = NULL,
    .fd_fstat = console_fstat,
    .fd_close = NULL,
+   .fd_ioctl = console_ioctl,
+   .fd_peek  = console_peek,
 };
 
 //------------------------------------------------------------------
@@ -56,7 +60,33 @@ ssize_t console_read(int fd, void *buf, size_t count) {
 //------------------------------------------------------------------
 // Write to the system console.
 ssize_t console_write(int fd, const void *buf, size_t count) {
-   return write(0, buf, count);
+   return write(1, buf, count);
+}
+
+//------------------------------------------------------------------
+// Kernel console output, e.g. hexdump. This goes through stdio
+// like printk so the two stay in order.
+void serial_putc(uint8_t ch) {
+   putchar(ch);
+}
+
+//------------------------------------------------------------------
+// Is there anything to read? The host doesn't say how much, so
+// report one byte if there's anything at all.
+ssize_t console_peek(int fd) {
+   fd_set rfds;
+   struct timeval tv = { 0, 0 };
+
+   FD_ZERO(&rfds);
+   FD_SET(0, &rfds);
+   return select(1, &rfds, NULL, NULL, &tv) > 0 ? 1 : 0;
+}
+
+//------------------------------------------------------------------
+// The host terminal is left alone, so console modes are accepted
+// and ignored.
+int console_ioctl(int fd, unsigned long request, void *ptr) {
+   return 0;
 }
 
 //------------------------------------------------------------------
@@ -0,0 +1,127 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// sim_dir.c: directory handles for the simulator, reading host
+// directories under the simulator's root.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+// The host's struct dirent has the same name as the FileStick one,
+// so the FileStick one is renamed here.
+#define dirent    fs_dirent
+#define opendir   fs_opendir
+#define closedir  fs_closedir
+#define readdir   fs_readdir
+#include <sys/dirent.h>
+#undef dirent
+#undef opendir
+#undef closedir
+#undef readdir
+#include <dirent.h>
+
+#include "simulator.h"
+
+#define MAX_DHND     8
+
+static DIR *dhnd[MAX_DHND];
+static char dhnd_path[MAX_DHND][PATH_MAX];
+
+//--------------------------------------------------
+// Do any required initialization.
+void init_dirs() 
+{
+   for(int i = 0; i < MAX_DHND; i++)
+      dhnd[i] = NULL;
+}
+
+//-------------------------------------------------
+// Allocate a directory handle and open a dir.
+int SYS_opendir(const char *path)
+{
+   int i;
+
+   for(i = 0; i < MAX_DHND; i++) {
+      if(dhnd[i] == NULL) break;
+   }
+   if(i == MAX_DHND) return -ENFILE;
+
+   // FatFS takes an empty path as the current directory
+   if(*path == 0) path = ".";
+   const char *hostpath = sim_path(dhnd_path[i], sizeof(dhnd_path[i]), path);
+   if(hostpath != dhnd_path[i])
+      strncpy(dhnd_path[i], hostpath, sizeof(dhnd_path[i]) - 1);
+
+   dhnd[i] = opendir(dhnd_path[i]);
+   if(dhnd[i] == NULL) return -errno;
+   return i;
+}
+
+//------------------------------------------------
+// Close dir and deallocate handle
+int SYS_closedir(int dh)
+{
+   if(dh < 0 || dh >= MAX_DHND) return -EMFILE;
+   if(dhnd[dh] == NULL) return -EBADF;
+
+   closedir(dhnd[dh]);
+   dhnd[dh] = NULL;
+   return 0;
+}
+
+//------------------------------------------------
+// Read a dir. Like FatFS, the end of the directory is an entry with
+// an empty name. "." and ".." are skipped as FatFS doesn't return them.
+int SYS_readdir(int dh, struct fs_dirent *d)
+{
+   if(dh < 0 || dh >= MAX_DHND) return -EMFILE;
+   if(dhnd[dh] == NULL) return -EBADF;
+
+   struct dirent *ent;
+   do {
+      errno = 0;
+      ent = readdir(dhnd[dh]);
+   } while(ent && (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")));
+
+   if(ent == NULL) {
+      d->d_name[0] = 0;
+      return -errno;
+   }
+
+   char path[PATH_MAX];
+   struct stat st;
+   snprintf(path, sizeof(path), "%s/%s", dhnd_path[dh], ent->d_name);
+   if(stat(path, &st) < 0) memset(&st, 0, sizeof(st));
+
+   strncpy(d->d_name, ent->d_name, sizeof(d->d_name) - 1);
+   d->d_name[sizeof(d->d_name) - 1] = 0;
+   d->d_isdir = S_ISDIR(st.st_mode);
+   d->d_size = st.st_size;
+   return 0;
+}
@@ -22,23 +22,65 @@
 ;THE SOFTWARE.
 */
 
+// sim_econet.c: econet driver for the simulator. This follows
+// raw_econet.c, with udp_econet.c standing in for the hardware and
+// the receive ISR.
+
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
-#include <sys/errno.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
-#include "console.h"
+#include "simulator.h"
 #include "fd.h"
 #include "raw_econet.h"
-#include "sysdefs.h"
+#include "wait.h"
+#include "udp_econet.h"      // struct iovec comes with the host's socket headers
 #include <sys/econet.h>
 
 #include "printk.h"
 
-// Internal functions
-static int econet_set_rx_port(int fd, uint8_t port);     // sets recvfrom port
-static int econet_set_addr(uint16_t netstation);         // sets our net and station number
-static int econet_set_tx_addr(int fd, struct econet_addr *dest);
+// Frames that have been acked but not yet read. The real driver
+// describes them by their place in the receive ring; here they're
+// copied out of the datagram.
+struct sim_rxq {
+   uint32_t       head;
+   uint32_t       count;
+   size_t         offset;                    // already read from the head
+   size_t         len[ECONET_RXQ_DEPTH];
+   uint8_t        *frame[ECONET_RXQ_DEPTH];
+};
+
+static struct sim_rxq rx_queues[MAX_FILE_DESCRIPTORS];
+
+// Frames given out by ECONET_GET_RXVIEW, until ECONET_RELEASE_RX
+struct sim_rxhold {
+   uint8_t        *frame;                    // NULL if the slot is free
+   size_t         len;
+   int            fd;
+};
+
+static struct sim_rxhold rx_held[ECONET_RXHOLD_COUNT];
+static uint8_t port_list[256];               // fd + 1 listening on each port
+static struct econet_state state_val;
+
+static uint8_t fd_rx_portmap[MAX_FILE_DESCRIPTORS];
+static struct econet_addr fd_tx_destmap[MAX_FILE_DESCRIPTORS];
+
+// Result of the last write on each fd: 0, -EINPROGRESS while the
+// handshake is under way, or the error it failed with.
+static int fd_tx_result[MAX_FILE_DESCRIPTORS];
+static int tx_owner = -1;        // fd whose frame is being sent
+static int txbuf_owner = -1;     // fd composing a frame with ECONET_GET_TXBUF
+
+// Stands in for the payload area of the hardware transmit buffer
+static uint8_t txbuf[ECONET_MAX_PAYLOAD];
+
+static uint16_t econet_address;
+static uint16_t econet_clkterm;
 
 static FDfunction econet_func = {
    .fd_read = econet_read,
@@ -46,17 +88,43 @@ static FDfunction econet_func = {
    .fd_lseek = NULL,
    .fd_fstat = NULL,
    .fd_ioctl = econet_ioctl,
-   .fd_close = econet_close
+   .fd_close = econet_close,
+   .fd_peek  = econet_peek,
+   .fd_poll  = econet_poll,
+   .fd_writev = econet_writev,
+   .fd_sendfile = econet_sendfile
 };
 
+// Internal functions
+static int econet_set_rx_port(int fd, uint8_t port);     // sets recvfrom port
+static int econet_set_addr(uint16_t netstation);         // sets our net and station number
+static int econet_set_tx_addr(int fd, struct econet_addr *dest);
+static int econet_set_nonblock(int fd, bool nonblock);
+static void econet_tx_reap();
+static void econet_rxq_reset(int fd);
+static int econet_rx_wait(int fd);
+static void econet_rx_consume(struct sim_rxq *q, size_t count);
+static int econet_get_rxview(int fd, struct econet_rxview *view);
+static int econet_release_rx(int fd, int id);
+static int econet_tx_acquire(int fd);
+static ssize_t econet_tx_send(int fd, const void *ptr, size_t count, bool wait_idle);
+static int econet_get_txbuf(int fd, uint8_t **bufp);
+static ssize_t econet_tx_commit(int fd, size_t count);
+
 void
 econet_init()
 {
+   memset(fd_rx_portmap, 0, sizeof(fd_rx_portmap));
+   memset(fd_tx_destmap, 0, sizeof(fd_tx_destmap));
+   memset(port_list, 0, sizeof(port_list));
+   econet_address = 0;
 }
 
 int 
 econet_open(const char *devname, int flags, mode_t mode, FD *fd)
 {
+   fd->fdfunc = &econet_func;
+   fd_tx_result[fd->fd] = 0;
    return 0;
 }
 
@@ -70,8 +138,46 @@ int econet_ioctl(int fd, unsigned long request, void *ptr) {
          return econet_set_rx_port(fd, request & 0xFF);
       case ECONET_SET_SEND_ADDR:
          return econet_set_tx_addr(fd, ptr);
+      case ECONET_SET_MONITOR:
+         // there's no line to monitor
+         return (request & 0xFF) ? -EOPNOTSUPP : 0;
+      case ECONET_SET_CLKTERM:
+         econet_clkterm = request & 0xFFFF;
+         return 0;
+      case ECONET_SET_NONBLOCK:
+         return econet_set_nonblock(fd, request & 0xFF);
+      case ECONET_RELEASE_RX:
+         return econet_release_rx(fd, request & 0xFF);
+      case ECONET_TX_COMMIT:
+         return econet_tx_commit(fd, request & 0xFFFF);
+      case ECONET_GET_ADDR:
+         {
+            uint8_t *nsta = (uint8_t *)ptr;
+            *nsta = econet_address;
+            return 0;
+         }
+      case ECONET_GET_CLKTERM:
+         {
+            uint16_t *clkt = (uint16_t *)ptr;
+            *clkt = econet_clkterm;
+            return 0;
+         }
+      case ECONET_GET_TXSTATUS:
+         {
+            // an error is only reported once
+            econet_tx_reap();
+            int rc = fd_tx_result[fd];
+            if(rc != -EINPROGRESS) fd_tx_result[fd] = 0;
+            return rc;
+         }
+      case ECONET_GET_RXVIEW:
+         return econet_get_rxview(fd, ptr);
+      case ECONET_GET_TXBUF:
+         return econet_get_txbuf(fd, ptr);
       case ECONET_DBG_BUF:
-         //memcpy(ptr, (uint8_t *)&econet_state_val, sizeof(struct econet_state));
+         sim_lock();
+         memcpy(ptr, &state_val, sizeof(struct econet_state));
+         sim_unlock();
          return 0;
       default:
          printk("econet_ioctl: bad request\n");
@@ -81,53 +187,441 @@ int econet_ioctl(int fd, unsigned long request, void *ptr) {
    return -EINVAL;
 }
 
-ssize_t econet_read
-(int fd, void *ptr, size_t count) 
+//------------------------------------------------------------------
+// Called from the receive thread when a scout arrives for a port.
+// Only ack it if someone's listening and there's room for the data.
+bool
+econet_rx_accept(uint8_t port)
+{
+   bool accept = false;
+
+   sim_lock();
+   int fd = port_list[port] - 1;
+   if(fd >= 0) {
+      // there's no ring here, so go by the number of bytes queued
+      if(rx_queues[fd].count < ECONET_RXQ_DEPTH &&
+            state_val.rx_queued + ECONET_RXQ_RESERVE <= ECONET_RXBUFSZ)
+         accept = true;
+      else
+         state_val.rx_refused++;
+   }
+   sim_unlock();
+   return accept;
+}
+
+//------------------------------------------------------------------
+// Called from the receive thread with the data frame (source address
+// then the payload) following a scout that was accepted.
+void
+econet_rx_deliver(uint8_t port, const uint8_t *frame, size_t len)
 {
+   uint8_t *copy = malloc(len);
+   if(copy == NULL) return;
+   memcpy(copy, frame, len);
+
+   sim_lock();
+   int fd = port_list[port] - 1;
+   if(fd < 0 || rx_queues[fd].count == ECONET_RXQ_DEPTH) {
+      // port closed since the scout
+      sim_unlock();
+      free(copy);
+      return;
+   }
+
+   struct sim_rxq *q = &rx_queues[fd];
+
+   uint32_t tail = (q->head + q->count) % ECONET_RXQ_DEPTH;
+   q->frame[tail] = copy;
+   q->len[tail] = len;
+   q->count++;
+   state_val.rx_queued += len;
+   sim_unlock();
+
+   sim_signal(WAIT_ECONET_RX);
+}
+
+ssize_t econet_read(int fd, void *ptr, size_t count) {
+   int rc = econet_rx_wait(fd);
+   if(rc < 0)
+      return rc;
+
+   struct sim_rxq *q = &rx_queues[fd];
+   uint8_t *frame = q->frame[q->head];
+   size_t len = q->len[q->head] - q->offset;
+   size_t copy_sz = len > count ? count : len;
+   memcpy(ptr, frame + q->offset, copy_sz);
+
+   econet_rx_consume(q, copy_sz);
+   sim_unlock();
+
+   return copy_sz;
+}
+
+// Wait for a frame to be queued for an fd. On success, returns with
+// the lock held.
+static int econet_rx_wait(int fd) {
+   if(!fd_rx_portmap[fd])
+      return -EINVAL;
+
+   struct sim_rxq *q = &rx_queues[fd];
+   sim_lock();
+   while(q->count == 0) {
+      sim_unlock();
+      if(get_fdentry(fd)->flags & O_NONBLOCK)
+         return -EAGAIN;
+      wait_event(WAIT_ECONET_RX);
+      sim_lock();
+   }
+   return 0;
+}
+
+// Use up bytes from the start of the oldest frame, removing it from
+// the queue once it's all gone. Called with the lock held.
+static void econet_rx_consume(struct sim_rxq *q, size_t count) {
+   size_t len = q->len[q->head] - q->offset;
+
+   state_val.rx_queued -= count;
+   if(count < len) {
+      q->offset += count;
+   }
+   else {
+      free(q->frame[q->head]);
+      q->offset = 0;
+      q->head = (q->head + 1) % ECONET_RXQ_DEPTH;
+      q->count--;
+   }
+}
+
+// Take the oldest frame off the fd's queue and hold it for the caller.
+// Frames are kept in their own buffers here, so they never wrap.
+static int econet_get_rxview(int fd, struct econet_rxview *view) {
+   int rc = econet_rx_wait(fd);
+   if(rc < 0)
+      return rc;
+
+   int id;
+   for(id = 0; id < ECONET_RXHOLD_COUNT && rx_held[id].frame; id++);
+   if(id == ECONET_RXHOLD_COUNT) {
+      sim_unlock();
+      return -EBUSY;
+   }
+
+   struct sim_rxq *q = &rx_queues[fd];
+   struct sim_rxhold *h = &rx_held[id];
+   h->frame = q->frame[q->head];
+   h->len = q->len[q->head] - q->offset;
+   h->fd = fd;
+   view->id = id;
+   view->data = h->frame + q->offset;
+   view->len = h->len;
+   view->wrap = NULL;
+   view->wraplen = 0;
+
+   q->offset = 0;
+   q->head = (q->head + 1) % ECONET_RXQ_DEPTH;
+   q->count--;
+   sim_unlock();
+   return view->len;
+}
+
+// Frames aren't overwritten here, so a release never fails with EIO.
+static int econet_release_rx(int fd, int id) {
+   if(id >= ECONET_RXHOLD_COUNT)
+      return -ENOENT;
+
+   struct sim_rxhold *h = &rx_held[id];
+   sim_lock();
+   if(h->frame == NULL || h->fd != fd) {
+      sim_unlock();
+      return -ENOENT;
+   }
+   state_val.rx_queued -= h->len;
+   free(h->frame);
+   h->frame = NULL;
+   sim_unlock();
    return 0;
 }
 
+ssize_t econet_peek(int fd)
+{
+   uint8_t port = fd_rx_portmap[fd];
+   if(!port)
+      return -EINVAL;
+
+   struct sim_rxq *q = &rx_queues[fd];
+   sim_lock();
+   ssize_t len = q->count ? q->len[q->head] - q->offset : 0;
+   sim_unlock();
+   return len;
+}
+
+// Readiness for poll: POLLIN when a frame is queued, POLLOUT when
+// this fd has no frame still being sent, POLLERR when its last write
+// failed and the error hasn't been collected with ECONET_GET_TXSTATUS.
+short econet_poll(int fd)
+{
+   short revents = 0;
+
+   if(econet_peek(fd) > 0)
+      revents |= POLLIN;
+
+   econet_tx_reap();
+   if(fd_tx_result[fd] != -EINPROGRESS)
+      revents |= POLLOUT;
+   if(fd_tx_result[fd] < 0 && fd_tx_result[fd] != -EINPROGRESS)
+      revents |= POLLERR;
+
+   return revents;
+}
+
+// If a frame was being sent and the handshake has finished, record
+// the result against the fd that sent it.
+static void econet_tx_reap() {
+   if(tx_owner < 0) return;
+
+   int rc = sim_econet_tx_status();
+   if(rc == -EINPROGRESS) return;
+
+   fd_tx_result[tx_owner] = rc;
+   tx_owner = -1;
+}
+
 ssize_t 
 econet_write(int fd, const void *ptr, size_t count) 
 {
+   // Validate the size
+   if(count > ECONET_MAX_PAYLOAD) return -EMSGSIZE;
+
+   // Validate that there is a valid destination
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   // the transmit buffer is in use
+   if(txbuf_owner >= 0 && txbuf_owner != fd) return -EBUSY;
+
+   return econet_tx_send(fd, ptr, count, false);
+}
+
+// Gather the buffers into one frame, as the hardware driver does in
+// its transmit buffer
+ssize_t
+econet_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+   size_t count = 0;
+   for(int i = 0; i < iovcnt; i++)
+      count += iov[i].iov_len;
+   if(count > ECONET_MAX_PAYLOAD) return -EMSGSIZE;
+
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   if(txbuf_owner >= 0 && txbuf_owner != fd) return -EBUSY;
+
+   uint8_t *ptr = txbuf;
+   for(int i = 0; i < iovcnt; i++) {
+      memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+      ptr += iov[i].iov_len;
+   }
+   return econet_tx_send(fd, txbuf, count, false);
+}
+
+// Read up to a frame's worth from in_fd straight into the transmit
+// buffer and send it, one frame per call as on the hardware.
+ssize_t
+econet_sendfile(int fd, int in_fd, off_t *offset, size_t count)
+{
+   if(count > ECONET_MAX_PAYLOAD) count = ECONET_MAX_PAYLOAD;
+   if(count == 0) return 0;
+
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0) return rc;
+
+   txbuf_owner = fd;
+   ssize_t got;
+   if(offset != NULL)
+      got = SYS_pread(in_fd, txbuf, count, *offset);
+   else
+      got = SYS_read(in_fd, txbuf, count);
+   if(got <= 0) {
+      txbuf_owner = -1;
+      return got;
+   }
+
+   ssize_t sent = econet_tx_send(fd, txbuf, got, true);
+   if(sent > 0 && offset != NULL)
+      *offset += sent;
+   return sent;
+}
+
+static ssize_t
+econet_tx_send(int fd, const void *ptr, size_t count, bool wait_idle)
+{
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   bool nonblock = get_fdentry(fd)->flags & O_NONBLOCK;
+
+   // wait until the transmitter is idle, collecting the previous
+   // frame's result first since it may have been sent from another fd
+   int rc;
+   while(1) {
+      econet_tx_reap();
+      rc = tx_owner < 0 ? sim_econet_tx_start(dest, ptr, count) : -EAGAIN;
+      if(rc != -EAGAIN) break;
+      if(nonblock && !wait_idle) return -EAGAIN;
+      wait_event(WAIT_ECONET_TX);
+   }
+   if(rc < 0) return rc;
+
+   tx_owner = fd;
+   txbuf_owner = -1;
+   fd_tx_result[fd] = -EINPROGRESS;
+
+   if(nonblock)
+      return count;
+
+   do {
+      wait_event(WAIT_ECONET_TX);
+      econet_tx_reap();
+   } while(fd_tx_result[fd] == -EINPROGRESS);
+
+   rc = fd_tx_result[fd];
+   fd_tx_result[fd] = 0;
+   if(rc < 0)
+      return rc;
+
+   return count;
+}
+
+// As on the hardware, the buffer is only free once the last frame
+// has been sent.
+static int
+econet_tx_acquire(int fd)
+{
+   if(txbuf_owner >= 0 && txbuf_owner != fd) return -EBUSY;
+
+   bool nonblock = get_fdentry(fd)->flags & O_NONBLOCK;
+   while(sim_econet_tx_status() == -EINPROGRESS) {
+      if(nonblock) return -EAGAIN;
+      wait_event(WAIT_ECONET_TX);
+   }
    return 0;
 }
 
+static int
+econet_get_txbuf(int fd, uint8_t **bufp)
+{
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0) return rc;
+
+   txbuf_owner = fd;
+   *bufp = txbuf;
+   return ECONET_MAX_PAYLOAD;
+}
+
+static ssize_t
+econet_tx_commit(int fd, size_t count)
+{
+   if(txbuf_owner != fd)
+      return -EINVAL;
+
+   if(count == 0 || count > ECONET_MAX_PAYLOAD || fd_tx_destmap[fd].station == 0) {
+      txbuf_owner = -1;
+      if(count == 0) return 0;
+      return count > ECONET_MAX_PAYLOAD ? -EMSGSIZE : -EDESTADDRREQ;
+   }
+
+   return econet_tx_send(fd, txbuf, count, false);
+}
+
 int econet_close(int fd) {
-   /*
+   if(txbuf_owner == fd)
+      txbuf_owner = -1;
+
    uint8_t port = fd_rx_portmap[fd];
+   sim_lock();
    if(port) {
-      econet_port_list[port] = 0;
+      port_list[port] = 0;
       fd_rx_portmap[fd] = 0;
-   }*/
+   }
+   sim_unlock();
+   econet_rxq_reset(fd);
    return 0;
 }
 
 static int econet_set_rx_port(int fd, uint8_t port) {
-   /*
-   // TODO: error handling
+   sim_lock();
+   uint8_t old_port = fd_rx_portmap[fd];
+   if(old_port)
+      port_list[old_port] = 0;
+   sim_unlock();
+
+   econet_rxq_reset(fd);
+
+   sim_lock();
    fd_rx_portmap[fd] = port;
+   port_list[port] = fd + 1;
+   sim_unlock();
+   return 0;
+}
 
-   // indicates to the ISR that the port is being listened
-   econet_port_list[port] = fd;*/
+static int econet_set_nonblock(int fd, bool nonblock) {
+   FD *fd_ent = get_fdentry(fd);
+   if(nonblock)
+      fd_ent->flags |= O_NONBLOCK;
+   else
+      fd_ent->flags &= ~O_NONBLOCK;
    return 0;
 }
 
+// Discard any frames queued for an fd
+static void econet_rxq_reset(int fd) {
+   struct sim_rxq *q = &rx_queues[fd];
+
+   sim_lock();
+   while(q->count) {
+      state_val.rx_queued -= q->len[q->head] - q->offset;
+      free(q->frame[q->head]);
+      q->offset = 0;
+      q->head = (q->head + 1) % ECONET_RXQ_DEPTH;
+      q->count--;
+   }
+   q->head = 0;
+
+   for(int id = 0; id < ECONET_RXHOLD_COUNT; id++) {
+      struct sim_rxhold *h = &rx_held[id];
+      if(h->frame && h->fd == fd) {
+         state_val.rx_queued -= h->len;
+         free(h->frame);
+         h->frame = NULL;
+      }
+   }
+   sim_unlock();
+}
+
 static int econet_set_tx_addr(int fd, struct econet_addr *dest) {
-   /*
    fd_tx_destmap[fd].port = dest->port;
    fd_tx_destmap[fd].net = dest->net;
-   fd_tx_destmap[fd].station = dest->station;*/
+   fd_tx_destmap[fd].station = dest->station;
 
    return 0;
 }
 
 // netstation is MSB=network LSB=station
+// Setting the address binds the station's UDP port from the
+// configuration file.
 static int econet_set_addr(uint16_t netstation) {
-   /*
+   const char *cfg = getenv(SIM_ENV_ECONET);
+   if(cfg == NULL) cfg = SIM_DEFAULT_ECONET;
+
+   if(sim_config_econet(cfg, netstation >> 8, netstation & 0xFF) < 0) {
+      int rc = -errno;
+      device_log("econet: can't configure station %d.%d from %s: %s",
+            netstation >> 8, netstation & 0xFF, cfg, strerror(errno));
+      return rc;
+   }
+
    econet_address = netstation;
-   *addr_set = netstation;       // sets address in receiver hardware
-   */
    return 0;
 }
-
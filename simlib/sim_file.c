@@ -22,29 +22,35 @@
 ;THE SOFTWARE.
 */
 
-// file.c: for the simulator just wraps posix i/o
+// file.c: for the simulator just wraps posix i/o on files under the
+// simulator's root directory
 
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <string.h>
 #include <stdbool.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "filesystem.h"
 #include "fd.h"
+#include "simulator.h"
 
 static FDfunction fileio_func = {
    .fd_read          = fileio_read,
    .fd_write         = fileio_write,
    .fd_close         = fileio_close,
    .fd_lseek         = fileio_lseek,
-   .fd_fstat         = fileio_fstat
+   .fd_fstat         = fileio_fstat,
+   .fd_pread         = fileio_pread,
+   .fd_pwrite        = fileio_pwrite
 };
 
-int   real_fd[MAX_FD_COUNT];
+int   real_fd[MAX_FILE_DESCRIPTORS];
 
 void init_fileio()
 {
@@ -53,6 +59,7 @@ void init_fileio()
 
 int fileio_open(const char *path, int flags, mode_t mode)
 {
+   char hostpath[PATH_MAX];
    int fdnum;
    FD *fd = fd_alloc(&fdnum);
    if(!fd)
@@ -60,21 +67,23 @@ int fileio_open(const char *path, int flags, mode_t mode)
 
    fd->fdfunc = &fileio_func;
 
-   int rfd = open(path, flags, mode);
-   if(rfd) {
+   // FAT has no permissions, so callers often don't pass a mode
+   int rfd = open(sim_path(hostpath, sizeof(hostpath), path), flags, 0644);
+   if(rfd >= 0) {
+      fd->flags |= flags;
       real_fd[fdnum] = rfd;
       return fdnum;
    }
 
    fd_dealloc(fd);
-   return errno;
+   return -errno;
 }
 
 ssize_t fileio_read(int fd, void *buf, size_t count)
 {
    int rfd = real_fd[fd];
    ssize_t rc = read(rfd, buf, count);
-   if(rc < 0) return errno;
+   if(rc < 0) return -errno;
    return rc;
 }
 
@@ -82,14 +91,31 @@ ssize_t fileio_write(int fd, const void *buf, size_t count)
 {
    int rfd = real_fd[fd];
    ssize_t rc = write(rfd, buf, count);
-   if(rc < 0) return errno;
+   if(rc < 0) return -errno;
+   return rc;
+}
+
+ssize_t fileio_pread(int fd, void *buf, size_t count, off_t offset)
+{
+   int rfd = real_fd[fd];
+   ssize_t rc = pread(rfd, buf, count, offset);
+   if(rc < 0) return -errno;
+   return rc;
+}
+
+ssize_t fileio_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+   int rfd = real_fd[fd];
+   ssize_t rc = pwrite(rfd, buf, count, offset);
+   if(rc < 0) return -errno;
    return rc;
 }
 
 int fileio_close(int fd) {
    int rfd = real_fd[fd];
    int rc = close(rfd);
-   if(rc < 0) return errno;
+   real_fd[fd] = 0;
+   if(rc < 0) return -errno;
    return rc;
 }
 
@@ -97,7 +123,7 @@ off_t fileio_lseek(int fd, off_t offset, int whence)
 {
    int rfd = real_fd[fd];
    off_t rc = lseek(rfd, offset, whence);
-   if(rc < 0) return errno;
+   if(rc < 0) return -errno;
    return rc;
 }
 
@@ -105,7 +131,66 @@ int fileio_fstat(int fd, struct stat *statbuf)
 {
    int rfd = real_fd[fd];
    int rc = fstat(rfd, statbuf);
-   if(rc < 0) return errno;
+   if(rc < 0) return -errno;
    return rc;
 }
 
+//------------------------------------------------------------------
+// File operations by name (file_ops.c)
+int SYS_unlink(const char *pathname)
+{
+   char hostpath[PATH_MAX];
+   const char *p = sim_path(hostpath, sizeof(hostpath), pathname);
+
+   // FatFS f_unlink removes empty directories too
+   int rc = unlink(p);
+   if(rc < 0 && errno == EISDIR) rc = rmdir(p);
+   return rc < 0 ? -errno : 0;
+}
+
+int SYS_mkdir(const char *pathname, mode_t mode)
+{
+   char hostpath[PATH_MAX];
+   int rc = mkdir(sim_path(hostpath, sizeof(hostpath), pathname), 0755);
+   return rc < 0 ? -errno : 0;
+}
+
+int SYS_chdir(const char *pathname)
+{
+   char hostpath[PATH_MAX];
+   int rc = chdir(sim_path(hostpath, sizeof(hostpath), pathname));
+   return rc < 0 ? -errno : 0;
+}
+
+int SYS_stat(const char *pathname, struct stat *statbuf)
+{
+   char hostpath[PATH_MAX];
+   int rc = stat(sim_path(hostpath, sizeof(hostpath), pathname), statbuf);
+   return rc < 0 ? -errno : 0;
+}
+
+//------------------------------------------------------------------
+// There's only the host filesystem, so mounting always works
+int SYS_mount(const char *src, const char *target, const char *fstype,
+              unsigned long mountflags, const void *data)
+{
+   return 0;
+}
+
+int SYS_umount(const char *target)
+{
+   return 0;
+}
+
+int SYS_statfs(const char *path, struct statfs *buf)
+{
+   char hostpath[PATH_MAX];
+   struct statvfs st;
+   int rc = statvfs(sim_path(hostpath, sizeof(hostpath), path), &st);
+   if(rc < 0) return -errno;
+
+   buf->f_bsize = st.f_frsize;
+   buf->f_blocks = st.f_blocks > UINT32_MAX ? UINT32_MAX : st.f_blocks;
+   buf->f_bfree = st.f_bavail > UINT32_MAX ? UINT32_MAX : st.f_bavail;
+   return 0;
+}
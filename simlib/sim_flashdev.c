@@ -22,6 +22,11 @@
 ;THE SOFTWARE.
 */
 
+// sim_flashdev.c: the SPI flash for the simulator, kept in a host
+// image file. Parts of the image that haven't been written read as
+// erased flash (0xFF).
+
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -29,46 +34,130 @@
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/spiflash.h>
 
 #include "spi_flashdev.h"
 #include "fd.h"
-#include "sysdefs.h"
+#include "simulator.h"
+
+#define FLASH_SIZE   0x1000000
 
 static FDfunction spiflash_func = {
    .fd_read    = spiflash_read,
-   .fd_write   = NULL,
+   .fd_write   = spiflash_write,
    .fd_lseek   = spiflash_lseek,
    .fd_fstat   = spiflash_fstat,
-   .fd_close   = spiflash_close
+   .fd_close   = spiflash_close,
+   .fd_ioctl   = spiflash_ioctl,
+   .fd_pread   = spiflash_pread,
+   .fd_pwrite  = spiflash_pwrite
 };
 
-static uint32_t   fileptr = 0;
-static bool       is_open = false;
+static uint32_t   fileptr[MAX_FILE_DESCRIPTORS];
+static int        image_fd = -1;
+static int        open_count;
+static struct spiflash_stats stats;
+
+void spiflash_init(void)
+{
+}
 
 //------------------------------------------------------------------------
 // Open the SPI flash
-// TODO: simulator
 int spiflash_open(const char *devname, int flags, mode_t mode, FD *fd) {
-   return -ENOENT;
+   if(image_fd < 0) {
+      const char *image = getenv(SIM_ENV_FLASH);
+      if(image == NULL) image = SIM_DEFAULT_FLASH;
+
+      image_fd = open(image, O_RDWR|O_CREAT, 0644);
+      if(image_fd < 0) return -errno;
+   }
+
+   fd->fdfunc = &spiflash_func;
+   fileptr[fd->fd] = 0;
+   open_count++;
+   return 0;
 }
 
 //------------------------------------------------------------------------
 // Read
-// TODO: simulator
 ssize_t spiflash_read(int fd, void *buf, size_t count) {
-   return 0;
+   if(fileptr[fd] >= FLASH_SIZE) return 0;
+   if(fileptr[fd] + count > FLASH_SIZE) count = FLASH_SIZE - fileptr[fd];
+
+   ssize_t rc = pread(image_fd, buf, count, fileptr[fd]);
+   if(rc < 0) return -errno;
+
+   // beyond the end of the image is erased flash
+   memset((uint8_t *)buf + rc, 0xFF, count - rc);
+   fileptr[fd] += count;
+   return count;
+}
+
+//------------------------------------------------------------------------
+// Write
+ssize_t spiflash_write(int fd, const void *buf, size_t count) {
+   if(fileptr[fd] >= FLASH_SIZE) return -ENOSPC;
+   if(fileptr[fd] + count > FLASH_SIZE) count = FLASH_SIZE - fileptr[fd];
+
+   // fill any gap before the write with erased flash
+   off_t end = lseek(image_fd, 0, SEEK_END);
+   uint8_t erased[256];
+   memset(erased, 0xFF, sizeof(erased));
+   while(end >= 0 && end < fileptr[fd]) {
+      size_t gap = fileptr[fd] - end;
+      if(gap > sizeof(erased)) gap = sizeof(erased);
+      if(pwrite(image_fd, erased, gap, end) < 0) return -errno;
+      end += gap;
+   }
+
+   ssize_t rc = pwrite(image_fd, buf, count, fileptr[fd]);
+   if(rc < 0) return -errno;
+   fileptr[fd] += rc;
+   stats.pages_programmed += (rc + 255) / 256;
+   return rc;
+}
+
+//------------------------------------------------------------------------
+// Read and write at an offset
+ssize_t spiflash_pread(int fd, void *buf, size_t count, off_t offset) {
+   uint32_t saved = fileptr[fd];
+   fileptr[fd] = offset;
+   ssize_t rc = spiflash_read(fd, buf, count);
+   fileptr[fd] = saved;
+   return rc;
+}
+
+ssize_t spiflash_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+   uint32_t saved = fileptr[fd];
+   fileptr[fd] = offset;
+   ssize_t rc = spiflash_write(fd, buf, count);
+   fileptr[fd] = saved;
+   return rc;
 }
 
 //------------------------------------------------------------------------
 // Seek
-// TODO: simulator
 off_t spiflash_lseek(int fd, off_t offset, int whence) {
-   return 0;
+   switch(whence) {
+      case SEEK_SET:
+         fileptr[fd] = offset;
+         break;
+      case SEEK_CUR:
+         fileptr[fd] += offset;
+         break;
+      case SEEK_END:
+         fileptr[fd] = 0xFFFFFF + offset;
+         break;
+      default:
+         return -EINVAL;
+   }
+   return fileptr[fd];
 }
 
 //------------------------------------------------------------------------
 // Stat
-// FIXME: return size based on flash chip
 int spiflash_fstat(int fd, struct stat *statbuf) {
    memset(statbuf, 0, sizeof(struct stat));
    statbuf->st_mode = S_IFBLK | 0555;
@@ -78,10 +167,24 @@ int spiflash_fstat(int fd, struct stat *statbuf) {
    return 0;
 }
 
+//------------------------------------------------------------------------
+// ioctl
+int spiflash_ioctl(int fd, unsigned long request, void *ptr) {
+   switch(request) {
+      case SPIFLASH_GET_STATS:
+         if(ptr == NULL) return -EFAULT;
+         memcpy(ptr, &stats, sizeof(stats));
+         return 0;
+   }
+   return -EINVAL;
+}
+
 //------------------------------------------------------------------------
 // Close
 int spiflash_close(int fd) {
-   is_open = false;
+   if(--open_count == 0) {
+      close(image_fd);
+      image_fd = -1;
+   }
    return 0;
 }
-
@@ -24,57 +24,227 @@
 
 // Simulated syscall wrapper.
 // Essentially the interface between the simulator library and the program
-// under test.
+// under test. The system calls return a negative errno, which is turned
+// into -1 and errno as the FileStick's libc does.
 
+#include <stdio.h>
+#include <stdarg.h>
 #include <errno.h>
 #include "fd.h"
+#include "filesystem.h"
 #include "simulator.h"
+#include "task.h"
+#include <sys/diskcache.h>
+
+int SYS_poll(struct pollfd *fds, int nfds, int timeout);
+
+static int
+sim_result(int rc)
+{
+   if(rc < 0) {
+      errno = -rc;
+      return -1;
+   }
+   return rc;
+}
 
 ssize_t 
 SIM_write(int fd, const void *buf, size_t count)
 {
-   ssize_t rc = SYS_write(fd, buf, count);
-   if(rc < 0) errno = rc;
-   return rc;
+   return sim_result(SYS_write(fd, buf, count));
 }
 
 ssize_t
 SIM_read(int fd, void *buf, size_t count)
 {
-   ssize_t rc = SYS_read(fd, buf, count);
-   if(rc < 0) errno = rc;
-   return rc;
+   return sim_result(SYS_read(fd, buf, count));
+}
+
+ssize_t
+SIM_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+   return sim_result(SYS_writev(fd, iov, iovcnt));
+}
+
+ssize_t
+SIM_pread(int fd, void *buf, size_t count, off_t offset)
+{
+   return sim_result(SYS_pread(fd, buf, count, offset));
+}
+
+ssize_t
+SIM_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+   return sim_result(SYS_pwrite(fd, buf, count, offset));
+}
+
+ssize_t
+SIM_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+   return sim_result(SYS_sendfile(out_fd, in_fd, offset, count));
 }
 
 int
 SIM_fstat(int fd, struct stat *statbuf)
 {
-   int rc = SYS_fstat(fd, statbuf);
-   if(rc < 0) errno = rc;
-   return rc;
+   return sim_result(SYS_fstat(fd, statbuf));
 }
 
 off_t
 SIM_lseek(int fd, off_t offset, int whence)
 {
-   off_t rc= SYS_lseek(fd, offset, whence);
-   if(rc < 0) errno = rc;
+   off_t rc = SYS_lseek(fd, offset, whence);
+   if(rc < 0) {
+      errno = -rc;
+      return -1;
+   }
    return rc;
 }
 
 int
 SIM_close(int fd)
 {
-   int rc = SYS_close(fd);
-   if(rc < 0) errno = rc;
-   return rc;
+   return sim_result(SYS_close(fd));
 }
 
 int
-SIM_open(const char *pathname, int flags, mode_t mode)
+SIM_open(const char *pathname, int flags, ...)
 {
-   int rc = SYS_open(pathname, flags, mode);
-   if(rc < 0) errno = rc;
-   return rc;
+   mode_t mode = 0;
+   if(flags & O_CREAT) {
+      va_list args;
+      va_start(args, flags);
+      mode = va_arg(args, int);
+      va_end(args);
+   }
+   return sim_result(SYS_open(pathname, flags, mode));
+}
+
+int
+SIM_ioctl(int fd, unsigned long request, ...)
+{
+   va_list args;
+   va_start(args, request);
+   void *ptr = va_arg(args, void *);
+   va_end(args);
+
+   return sim_result(SYS_ioctl(fd, request, ptr));
+}
+
+int
+SIM_poll(struct pollfd *fds, int nfds, int timeout)
+{
+   return sim_result(SYS_poll(fds, nfds, timeout));
+}
+
+int
+SIM_stat(const char *pathname, struct stat *statbuf)
+{
+   return sim_result(SYS_stat(pathname, statbuf));
+}
+
+int
+SIM_unlink(const char *pathname)
+{
+   return sim_result(SYS_unlink(pathname));
+}
+
+int
+SIM_mkdir(const char *pathname, mode_t mode)
+{
+   return sim_result(SYS_mkdir(pathname, mode));
+}
+
+int
+SIM_chdir(const char *pathname)
+{
+   return sim_result(SYS_chdir(pathname));
 }
 
+int
+SIM_opendir(const char *name)
+{
+   return sim_result(SYS_opendir(name));
+}
+
+int
+SIM_closedir(int dhnd)
+{
+   return sim_result(SYS_closedir(dhnd));
+}
+
+int
+SIM__readdir(int dhnd, struct dirent *d)
+{
+   return sim_result(SYS_readdir(dhnd, d));
+}
+
+struct dirent *
+SIM_readdir(int dhnd)
+{
+   static struct dirent d;
+
+   int rc = SIM__readdir(dhnd, &d);
+   if(rc < 0 || d.d_name[0] == 0) return NULL;
+   return &d;
+}
+
+int
+SIM_mount(const char *source, const char *target, const char *filesystemtype,
+      unsigned long mountflags, const void *data)
+{
+   return sim_result(SYS_mount(source, target, filesystemtype, mountflags, data));
+}
+
+int
+SIM_umount(const char *target)
+{
+   return sim_result(SYS_umount(target));
+}
+
+int
+SIM_statfs(const char *path, struct statfs *buf)
+{
+   return sim_result(SYS_statfs(path, buf));
+}
+
+int
+SIM_task_create(void (*fn)(void *), void *arg, void *stack, size_t size)
+{
+   return sim_result(SYS_task_create(NULL, fn, arg, stack, size));
+}
+
+int
+SIM_task_yield(void)
+{
+   return sim_result(SYS_task_yield());
+}
+
+int
+SIM_task_exit(void)
+{
+   return sim_result(SYS_task_exit());
+}
+
+//------------------------------------------------------------------
+// Non-standard system calls (lib/syscall.h)
+ssize_t
+fd_peek(int fd)
+{
+   return sim_result(SYS_peek(fd));
+}
+
+int
+exec_elf(const char *cmdline)
+{
+   errno = ENOEXEC;
+   return -1;
+}
+
+int
+diskcache_stats(struct diskcache_stats *stats)
+{
+   // the host does the caching
+   memset(stats, 0, sizeof(struct diskcache_stats));
+   return 0;
+}
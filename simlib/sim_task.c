@@ -0,0 +1,171 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// sim_task.c: cooperative tasks for the simulator. Each task is a
+// host thread, but only the one holding the CPU runs: it's handed on
+// in turn when a task waits for an event, yields or exits, which is
+// where task.c switches tasks on the FileStick.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "simulator.h"
+#include "wait.h"
+#include "task.h"
+#include "trace.h"
+
+typedef struct {
+   bool           used;
+   uint32_t       pending;       // events signalled since it last took them
+   void           (*fn)(void *);
+   void           *arg;
+} SimTask;
+
+static SimTask tasks[TASK_MAX] = {
+   [TASK_MAIN] = { .used = true }
+};
+static __thread int self = TASK_MAIN;
+
+// The CPU is a ticket lock, so tasks get it in the order they asked.
+// The main thread starts off holding it.
+static pthread_mutex_t cpu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cpu_cond = PTHREAD_COND_INITIALIZER;
+static unsigned cpu_next_ticket = 1;
+static unsigned cpu_serving = 0;
+static int cpu_holder = TASK_MAIN;
+
+void
+sim_task_release()
+{
+   pthread_mutex_lock(&cpu_mutex);
+   cpu_serving++;
+   pthread_cond_broadcast(&cpu_cond);
+   pthread_mutex_unlock(&cpu_mutex);
+}
+
+void
+sim_task_acquire()
+{
+   pthread_mutex_lock(&cpu_mutex);
+   unsigned ticket = cpu_next_ticket++;
+   while(cpu_serving != ticket)
+      pthread_cond_wait(&cpu_cond, &cpu_mutex);
+   pthread_mutex_unlock(&cpu_mutex);
+
+   if(cpu_holder != self) {
+      trace_event(TRACE_TASK_SWITCH, cpu_holder, self);
+      cpu_holder = self;
+   }
+}
+
+// As task_collect_events and task_take_events, with sim_lock held
+void
+sim_task_collect(void)
+{
+   uint32_t events = wait_pending;
+   if(!events) return;
+
+   wait_pending = 0;
+   for(int i = 0; i < TASK_MAX; i++) {
+      if(tasks[i].used)
+         tasks[i].pending |= events;
+   }
+}
+
+uint32_t
+sim_task_take(uint32_t mask)
+{
+   uint32_t events = tasks[self].pending & mask;
+   tasks[self].pending &= ~events;
+   return events;
+}
+
+static void *
+sim_task_start(void *arg)
+{
+   self = (SimTask *)arg - tasks;
+   sim_task_acquire();
+   tasks[self].fn(tasks[self].arg);
+   SYS_task_exit();
+   return NULL;
+}
+
+//------------------------------------------------------------------
+// The stack isn't used, since the host thread has its own, but it's
+// checked as task.c does.
+int
+SYS_task_create(void *entry, void *fn, void *arg, void *stack, size_t size)
+{
+   if(stack == NULL || ((uintptr_t)stack | size) & 15 ||
+         size < TASK_KSTACK_SIZE * 2)
+      return -EINVAL;
+
+   int id;
+   for(id = 1; id < TASK_MAX; id++) {
+      if(!tasks[id].used)
+         break;
+   }
+   if(id == TASK_MAX)
+      return -EAGAIN;
+
+   SimTask *t = &tasks[id];
+   t->fn = fn;
+   t->arg = arg;
+   t->pending = 0;
+   t->used = true;
+
+   pthread_t thread;
+   if(pthread_create(&thread, NULL, sim_task_start, t) != 0) {
+      t->used = false;
+      return -EAGAIN;
+   }
+   pthread_detach(thread);
+
+   trace_event(TRACE_TASK_CREATE, id, 0);
+   return id;
+}
+
+int
+SYS_task_yield(void)
+{
+   sim_task_release();
+   sched_yield();
+   sim_task_acquire();
+   return 0;
+}
+
+int
+SYS_task_exit(void)
+{
+   if(self == TASK_MAIN)
+      return -EINVAL;
+
+   trace_event(TRACE_TASK_EXIT, self, 0);
+   tasks[self].used = false;
+   sim_task_release();
+   pthread_exit(NULL);
+}
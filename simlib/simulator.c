@@ -2,14 +2,176 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/clock.h>
 
 #include "simulator.h"
 #include "fd.h"
+#include "filesystem.h"
+#include "raw_econet.h"
+#include "wait.h"
+#include "ktimer.h"
+
+static char sim_root[PATH_MAX];
+static pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+volatile uint32_t wait_pending;
+
+static void *sim_timer_thread(void *arg);
+
+// Set up the simulated machine before the program's main() runs.
+// The filesystem root becomes the current directory, so relative
+// paths work as they would on the FileStick.
+static void __attribute__((constructor))
+sim_startup()
+{
+   sim_init();
+}
 
 void
 sim_init()
 {
+   const char *root = getenv(SIM_ENV_ROOT);
+   if(root == NULL) root = ".";
+   if(realpath(root, sim_root) == NULL || chdir(sim_root) < 0) {
+      perror(root);
+      exit(1);
+   }
+
    fd_init();
+   init_fileio();
+   init_dirs();
+   econet_init();
+
+   pthread_t timer;
+   pthread_create(&timer, NULL, sim_timer_thread, NULL);
+   pthread_detach(timer);
+}
+
+// Map a FileStick path to a host path. Absolute paths are relative
+// to the simulator's filesystem root. Paths on the SD card ("1:") are
+// in its sd subdirectory, and "0:" is the flash, the root itself.
+const char *
+sim_path(char *buf, size_t bufsize, const char *path)
+{
+   const char *drive = "";
+   if((path[0] == '0' || path[0] == '1') && path[1] == ':') {
+      if(path[0] == '1') drive = "/sd";
+      path += 2;
+      snprintf(buf, bufsize, "%s%s%s%s", sim_root, drive,
+            *path == '/' ? "" : "/", path);
+      return buf;
+   }
+
+   if(*path != '/') return path;
+   snprintf(buf, bufsize, "%s%s", sim_root, path);
+   return buf;
+}
+
+void
+sim_lock()
+{
+   pthread_mutex_lock(&sim_mutex);
+}
+
+void
+sim_unlock()
+{
+   pthread_mutex_unlock(&sim_mutex);
+}
+
+// Raise wait events, as the ISRs do on the real hardware
+void
+sim_signal(uint32_t events)
+{
+   pthread_mutex_lock(&sim_mutex);
+   wait_pending |= events;
+   pthread_cond_broadcast(&sim_cond);
+   pthread_mutex_unlock(&sim_mutex);
+}
+
+// and from kernel code, e.g. the kernel timers
+void
+wait_signal(uint32_t events)
+{
+   sim_signal(events);
+}
+
+uint64_t
+get_ms()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint32_t
+sim_cycle(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * CPU_CLOCK_HZ +
+      (uint64_t)now.tv_nsec * (CPU_CLOCK_HZ / 1000000) / 1000;
+}
+
+// The general purpose timer: a 1ms tick that signals WAIT_TIMER when
+// a kernel timer is due, as timer.s does.
+volatile uint32_t timer_count;
+
+static void *
+sim_timer_thread(void *arg)
+{
+   struct timespec next;
+   clock_gettime(CLOCK_MONOTONIC, &next);
+
+   while(1) {
+      next.tv_nsec += 1000000;
+      if(next.tv_nsec >= 1000000000) {
+         next.tv_sec++;
+         next.tv_nsec -= 1000000000;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+      timer_count++;
+      if(ktimer_expired()) sim_signal(WAIT_TIMER);
+   }
+   return NULL;
+}
+
+// Block until one of the events in mask is signalled. Like the
+// hardware timer tick, a 10ms timeout makes sure callers get to
+// recheck whatever they're waiting for. Other tasks and the kernel
+// timers run meanwhile.
+uint32_t
+wait_event(uint32_t mask)
+{
+   if(ktimer_expired()) ktimer_run();
+
+   sim_task_release();
+
+   struct timespec until;
+   clock_gettime(CLOCK_REALTIME, &until);
+   until.tv_nsec += 10000000;
+   if(until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+   }
+
+   pthread_mutex_lock(&sim_mutex);
+   sim_task_collect();
+   uint32_t events = sim_task_take(mask);
+   if(!events) {
+      pthread_cond_timedwait(&sim_cond, &sim_mutex, &until);
+      sim_task_collect();
+      events = sim_task_take(mask);
+   }
+   pthread_mutex_unlock(&sim_mutex);
+
+   sim_task_acquire();
+   if(ktimer_expired()) ktimer_run();
+   return events;
 }
 
 void
@@ -34,4 +196,3 @@ printk(const char *fmt, ...)
    vprintf(fmt, args);
    va_end(args);
 }
-
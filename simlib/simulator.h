@@ -6,34 +6,109 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <string.h>
 #include <stdbool.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+
+// Simulator configuration, from the environment
+#define SIM_ENV_ROOT       "FILESTICK_ROOT"     // directory used as the filesystem
+#define SIM_ENV_ECONET     "FILESTICK_ECONET"   // station map, net station host port
+#define SIM_ENV_FLASH      "FILESTICK_FLASH"    // image file for /dev/spiflash
+#define SIM_DEFAULT_ECONET "econet.cfg"
+#define SIM_DEFAULT_FLASH  "spiflash.img"
+
+struct dirent;
 
 void sim_init(void);
 void device_log(const char *fmt, ...);
+const char *sim_path(char *buf, size_t bufsize, const char *path);
+
+#ifdef SIMLIB
+// The simulated devices are driven by threads standing in for the
+// interrupt handlers. Their state is protected by one lock, and
+// sim_signal is the equivalent of an ISR raising a wait event.
+void sim_lock(void);
+void sim_unlock(void);
+void sim_signal(uint32_t events);
+
+// Tasks hand the CPU on with these (sim_task.c)
+void sim_task_release(void);
+void sim_task_acquire(void);
+void sim_task_collect(void);
+uint32_t sim_task_take(uint32_t mask);
+
+// The cycle counter, as if the host ran at CPU_CLOCK_HZ
+uint32_t sim_cycle(void);
+
+// The kernel's econet_init would clash with the fileserver's when
+// both are linked into one program.
+#define econet_init sim_econet_init
+#endif
 
 // Simulated system call interface
+struct iovec;
 ssize_t SIM_write(int fd, const void *buf, size_t count);
 ssize_t SIM_read(int fd, void *buf, size_t count);
+ssize_t SIM_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t SIM_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t SIM_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t SIM_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 int SIM_fstat(int fd, struct stat *statbuf);
 off_t SIM_lseek(int fd, off_t offset, int whence);
 int SIM_close(int fd);
-int SIM_open(const char *pathname, int flags, mode_t mode);
+int SIM_open(const char *pathname, int flags, ...);
+int SIM_ioctl(int fd, unsigned long request, ...);
+int SIM_poll(struct pollfd *fds, int nfds, int timeout);
+int SIM_stat(const char *pathname, struct stat *statbuf);
+int SIM_unlink(const char *pathname);
+int SIM_mkdir(const char *pathname, mode_t mode);
+int SIM_chdir(const char *pathname);
+int SIM_opendir(const char *name);
+int SIM_closedir(int dhnd);
+int SIM__readdir(int dhnd, struct dirent *d);
+struct dirent *SIM_readdir(int dhnd);
+int SIM_mount(const char *source, const char *target, const char *filesystemtype,
+      unsigned long mountflags, const void *data);
+int SIM_umount(const char *target);
+int SIM_statfs(const char *path, struct statfs *buf);
+int SIM_task_create(void (*fn)(void *), void *arg, void *stack, size_t size);
+int SIM_task_yield(void);
+int SIM_task_exit(void);
 
 // for programs using the simulator, define syscalls to
 // use the simlib wrapper.
 #ifndef SIMLIB    // not building the library
-#define write  SIM_write
-#define read   SIM_read
-#define fstat  SIM_fstat
-#define lseek  SIM_lseek
-#define close  SIM_close
-#define open   SIM_open
+#define write     SIM_write
+#define read      SIM_read
+#define writev    SIM_writev
+#define pread     SIM_pread
+#define pwrite    SIM_pwrite
+#define sendfile  SIM_sendfile
+#define fstat     SIM_fstat
+#define lseek     SIM_lseek
+#define close     SIM_close
+#define open      SIM_open
+#define ioctl     SIM_ioctl
+#define poll      SIM_poll
+#define stat(p,s) SIM_stat(p,s)
+#define unlink    SIM_unlink
+#define mkdir     SIM_mkdir
+#define chdir     SIM_chdir
+#define opendir   SIM_opendir
+#define closedir  SIM_closedir
+#define _readdir  SIM__readdir
+#define readdir   SIM_readdir
+#define mount     SIM_mount
+#define umount    SIM_umount
+#define statfs(p,b) SIM_statfs(p,b)
+#define task_create SIM_task_create
+#define task_yield  SIM_task_yield
+#define task_exit   SIM_task_exit
 #endif
 
 #endif
 
 #endif
-
@@ -1,26 +1,60 @@
+// udp_econet.c: simulated econet hardware.
+//
+// Stations are mapped to UDP addresses by a configuration file in
+// b-em format (net, station, host, port), the same way AUN maps them
+// to IP addresses. Unlike AUN, the scout and ack frames are sent too,
+// so a station that isn't listening on a port, or whose receive queue
+// is full, doesn't ack the scout just like on a real network.
+//
+// A receive thread plays the part of the receive ISR, and a transmit
+// thread performs the four way handshake for outgoing frames.
+
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
-#include <netdb.h>
+#include <sys/select.h>
+#include <time.h>
 #include <pthread.h>
 #include <errno.h>
 
 #include "udp_econet.h"
+#include "simulator.h"
+#include "wait.h"
 
-static int sockfd;      // our UDP socket fd
+static int sockfd = -1; // our UDP socket fd
 static EconetStation stations[MAX_STATIONS];
+static int station_count;
 static EconetStation *our = NULL;
 static pthread_t econet_thread;
+static pthread_t tx_thread;
+
+// Transmitter state, protected by tx_lock
+static pthread_mutex_t tx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_cond = PTHREAD_COND_INITIALIZER;
+static bool tx_pending;             // frame waiting for the tx thread
+static bool tx_busy;                // handshake in progress
+static bool tx_acked;               // ack received from tx_dest
+static int tx_result;
+static struct econet_addr tx_dest;
+static uint8_t tx_frame[MAX_ECONET_BUF];
+static size_t tx_len;
+
+static uint64_t
+now_ms()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-// create the UDP socket
+// create the UDP socket and bind it to our station's address
 static int
 sim_udp_init()
 {
-   struct sockaddr_in servaddr;   
+   struct sockaddr_in servaddr;
 
    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
    if(sockfd < 0) return sockfd;
@@ -30,83 +64,89 @@ sim_udp_init()
    servaddr.sin_addr.s_addr = our->addr.sin_addr.s_addr;
    servaddr.sin_port = htons(our->port);
 
+   if(bind(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+      close(sockfd);
+      sockfd = -1;
+      return -1;
+   }
    return 0;
 }
 
-// Read the econet configuration info in b-em format
-// (net, station, ip, port)
-static int
-parse_stn(char *buf, EconetStation *stn)
+// Find a station's UDP address
+static EconetStation *
+find_station(uint8_t net, uint8_t station)
 {
-   static struct addrinfo hints = {
-      .ai_family = AF_INET,
-      .ai_socktype = SOCK_DGRAM,
-      .ai_flags = 0,
-      .ai_protocol = 0};
-
-   struct addrinfo *result;
-   char host[128];
-   uint8_t net, station;
-   uint16_t port;
-
-   sscanf(buf, "%d %d %s %d\n", net, station, host, port);
-   if(station > 0 && strlen(host) > 0 && port > 0) {
-      int rc = getaddrinfo(host, "", &hints, &result);
-      if(rc != 0) {
-         fprintf(stderr, "unable to look up host %s\n", host);
-         return 0;
-      } 
-      
-      if(result->ai_family = AF_INET) {
-         struct sockaddr_in *sin = (struct sockaddr_in *)result->ai_addr;
-         memcpy(&stn->addr, sin, sizeof(struct sockaddr_in));
-
-         stn->net = net;
-         stn->station = station;
-         stn->port = port;
-
-         freeaddrinfo(result);
-         return 1;
-      }
-
-      freeaddrinfo(result);
+   for(int i = 0; i < station_count; i++) {
+      if(stations[i].station == station && stations[i].net == net)
+         return &stations[i];
    }
-
-   // not a valid config line
-   return 0;
+   return NULL;
 }
 
-// wait a defined amount of time for a message. Returns the ready fd or -1 if
-// timed out waiting.
-int
-sim_waitformsg()
+// Is a frame addressed to us? Net 0 is the local network.
+static bool
+for_us(const uint8_t *frame)
 {
-   fd_set rfds;
-   FD_ZERO(&rfds);
-   FD_SET(sockfd, &rfds);
-   struct timeval tv;
+   return frame[0] == our->station && (frame[1] == 0 || frame[1] == our->net);
+}
 
-   tv.tv_sec = 1;
-   tv.tv_usec = 0;
+// Send a frame from us to a station
+static void
+send_frame(const struct sockaddr_in *to, uint8_t net, uint8_t station,
+      const uint8_t *body, size_t len)
+{
+   uint8_t frame[MAX_ECONET_BUF];
+
+   frame[0] = station;
+   frame[1] = net;
+   frame[2] = our->station;
+   frame[3] = our->net;
+   memcpy(frame + FRAME_HDR_LEN, body, len);
+   sendto(sockfd, frame, len + FRAME_HDR_LEN, 0, (const struct sockaddr *)to,
+         sizeof(struct sockaddr_in));
+}
 
-   int rc=select(1, &rfds, NULL, NULL, &tv);
-   if(rc < 0) return rc;
+// A scout arrived: ack it if the port is being listened to and
+// there's room to queue the data.
+static int
+handle_scout(uint8_t *rxbuf, size_t size, const struct sockaddr_in *from)
+{
+   if(size != SCOUT_LEN || !(rxbuf[4] & 0x80)) return WAIT_SCOUT;
 
-   if(FD_ISSET(0, &rfds)) return sockfd;
+   uint8_t port = rxbuf[5];
+   if(port == 0 || !econet_rx_accept(port)) return WAIT_SCOUT;
 
-   return 0;
+   send_frame(from, rxbuf[3], rxbuf[2], NULL, 0);
+   return WAIT_DATA;
 }
 
+// The data frame following a scout we acked: queue it for the fd
+// listening on the port and ack it.
 static int
-handle_scout(uint8_t *rxbuf, size_t size)
+handle_data(uint8_t *rxbuf, size_t size, uint8_t port, const struct sockaddr_in *from)
 {
+   // ack first, as the receiver may answer straight away. The driver
+   // sees the source address followed by the data.
+   send_frame(from, rxbuf[3], rxbuf[2], NULL, 0);
+   econet_rx_deliver(port, rxbuf + 2, size - 2);
    return WAIT_SCOUT;
 }
 
-static int
-handle_data(uint8_t *rxbuf, size_t size)
+// An ack for the frame we're sending
+static bool
+handle_tx_ack(uint8_t *rxbuf, size_t size)
 {
-   return WAIT_SCOUT;
+   bool is_ack = false;
+
+   pthread_mutex_lock(&tx_lock);
+   if(size == FRAME_HDR_LEN && tx_busy && !tx_acked &&
+         rxbuf[2] == tx_dest.station && rxbuf[3] == tx_dest.net) {
+      tx_acked = true;
+      is_ack = true;
+      pthread_cond_broadcast(&tx_cond);
+   }
+   pthread_mutex_unlock(&tx_lock);
+   return is_ack;
 }
 
 // Main econet listening thread.
@@ -114,77 +154,192 @@ static void *
 sim_econet_thread(void *ptr)
 {
    socklen_t len;
-   int rxbytes;
+   ssize_t rxbytes;
    int state = WAIT_SCOUT;
    struct sockaddr_in cliaddr;
    uint8_t rxbuf[MAX_ECONET_BUF];
+   uint8_t pending_net = 0, pending_station = 0, pending_port = 0;
+   uint64_t data_deadline = 0;
 
    while(1) {
+      fd_set rfds;
+      struct timeval tv, *timeout = NULL;
+      if(state == WAIT_DATA) {
+         uint64_t now = now_ms();
+         if(now >= data_deadline) {
+            state = WAIT_SCOUT;
+            continue;
+         }
+         tv.tv_sec = 0;
+         tv.tv_usec = (data_deadline - now) * 1000;
+         timeout = &tv;
+      }
+      FD_ZERO(&rfds);
+      FD_SET(sockfd, &rfds);
+      if(select(sockfd + 1, &rfds, NULL, NULL, timeout) <= 0) continue;
+
       len = sizeof(cliaddr);
-     
+      rxbytes = recvfrom(sockfd, (uint8_t *)rxbuf, sizeof(rxbuf), 0,
+            (struct sockaddr *)&cliaddr, &len);
+      if(rxbytes < FRAME_HDR_LEN || !for_us(rxbuf)) continue;
+
+      if(handle_tx_ack(rxbuf, rxbytes)) continue;
+
       switch(state) {
-         case WAIT_SCOUT: 
-            rxbytes = recvfrom(sockfd, (uint8_t *)rxbuf, sizeof(rxbuf), 0,
-               (struct sockaddr *)&cliaddr, &len);
-            state = handle_scout(rxbuf, len);
+         case WAIT_SCOUT:
+            state = handle_scout(rxbuf, rxbytes, &cliaddr);
+            if(state == WAIT_DATA) {
+               pending_station = rxbuf[2];
+               pending_net = rxbuf[3];
+               pending_port = rxbuf[5];
+               data_deadline = now_ms() + SIM_ACK_TIMEOUT;
+            }
             break;
          case WAIT_DATA:
-            if(sim_waitformsg() > 0) {
-               rxbytes = recvfrom(sockfd, (uint8_t *)rxbuf, sizeof(rxbuf), 0,
-                  (struct sockaddr *)&cliaddr, &len);
-               handle_data(rxbuf, len); 
-            }
-            state = WAIT_SCOUT;
+            if(rxbuf[2] == pending_station && rxbuf[3] == pending_net)
+               state = handle_data(rxbuf, rxbytes, pending_port, &cliaddr);
             break;
          default:
             fprintf(stderr, "sim_econet_thread: unexpected state: %d\n", state);
             state = WAIT_SCOUT;
       }
    }
+   return NULL;
+}
+
+// Wait for an ack to the frame being sent
+static bool
+wait_tx_ack()
+{
+   struct timespec until;
+   clock_gettime(CLOCK_REALTIME, &until);
+   until.tv_nsec += SIM_ACK_TIMEOUT * 1000000L;
+   if(until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+   }
+
+   pthread_mutex_lock(&tx_lock);
+   while(!tx_acked) {
+      if(pthread_cond_timedwait(&tx_cond, &tx_lock, &until) == ETIMEDOUT)
+         break;
+   }
+   bool acked = tx_acked;
+   tx_acked = false;
+   pthread_mutex_unlock(&tx_lock);
+   return acked;
+}
+
+// Transmit thread: send the scout, wait for the ack, send the data
+// and wait for the final ack.
+static void *
+sim_tx_thread(void *ptr)
+{
+   while(1) {
+      pthread_mutex_lock(&tx_lock);
+      while(!tx_pending)
+         pthread_cond_wait(&tx_cond, &tx_lock);
+      tx_pending = false;
+      tx_acked = false;
+      pthread_mutex_unlock(&tx_lock);
+
+      int rc = 0;
+      EconetStation *dest = find_station(tx_dest.net, tx_dest.station);
+      if(dest == NULL) {
+         rc = -EHOSTUNREACH;
+      }
+      else {
+         uint8_t scout[2] = { 0x80, tx_dest.port };
+         send_frame(&dest->addr, tx_dest.net, tx_dest.station, scout, sizeof(scout));
+         if(!wait_tx_ack()) {
+            rc = -EHOSTUNREACH;
+         }
+         else {
+            send_frame(&dest->addr, tx_dest.net, tx_dest.station, tx_frame, tx_len);
+            if(!wait_tx_ack()) rc = -ETIMEDOUT;
+         }
+      }
+
+      pthread_mutex_lock(&tx_lock);
+      tx_result = rc;
+      tx_busy = false;
+      pthread_mutex_unlock(&tx_lock);
+      sim_signal(WAIT_ECONET_TX);
+   }
+   return NULL;
+}
+
+int
+sim_econet_tx_start(const struct econet_addr *dest, const void *data, size_t len)
+{
+   if(sockfd < 0) return -ENETDOWN;
+   if(len > sizeof(tx_frame) - FRAME_HDR_LEN) return -EMSGSIZE;
+
+   pthread_mutex_lock(&tx_lock);
+   if(tx_busy) {
+      pthread_mutex_unlock(&tx_lock);
+      return -EAGAIN;
+   }
+   tx_dest = *dest;
+   memcpy(tx_frame, data, len);
+   tx_len = len;
+   tx_busy = true;
+   tx_pending = true;
+   tx_result = -EINPROGRESS;
+   pthread_cond_broadcast(&tx_cond);
+   pthread_mutex_unlock(&tx_lock);
+   return 0;
+}
+
+int
+sim_econet_tx_status()
+{
+   pthread_mutex_lock(&tx_lock);
+   int rc = tx_busy ? -EINPROGRESS : tx_result;
+   pthread_mutex_unlock(&tx_lock);
+   return rc;
 }
 
-// Start the econet listening thread.
+// Start the econet listening and transmit threads.
 static int
 sim_start_econet()
 {
    int rc = pthread_create(&econet_thread, NULL, sim_econet_thread, NULL);
    if(rc != 0) return rc;
 
-   return 0;
+   return pthread_create(&tx_thread, NULL, sim_tx_thread, NULL);
 }
 
 // Configure and start up simulated econet.
 int
 sim_config_econet(const char *cfgfile, uint8_t our_net, uint8_t our_station)
 {
-   char buf[128];
-   int idx = 0;
-
-   FILE *stream = fopen(cfgfile, "r");
-   if(!stream) return -1;
-
-   memset(stations, 0, sizeof(stations));
-
-   while(fgets(buf, sizeof(buf), stream)) {
-      if(isdigit(buf[0])) {
-         EconetStation *stn = &stations[idx];
-         idx += parse_stn(buf, stn);
-
-         if(stn->net == our_net && stn->station == our_station)
-            our = stn;
-      }
+   // the address can only be set once, the socket stays bound
+   if(our) {
+      if(our->net == our_net && our->station == our_station) return 0;
+      errno = EBUSY;
+      return -1;
    }
 
-   fclose(stream);
+   station_count = sim_read_stations(cfgfile, stations, MAX_STATIONS);
+   if(station_count < 0) return -1;
+
+   our = find_station(our_net, our_station);
 
    // no configuration for our station?
-   if(our = NULL) {
+   if(our == NULL) {
       errno = EADDRNOTAVAIL;
       return -1;
    }
 
-   if(sim_udp_init() < 0) return -1;
+   if(sim_udp_init() < 0) {
+      our = NULL;
+      return -1;
+   }
 
-   return sim_start_econet();
+   if(sim_start_econet() != 0) {
+      errno = EAGAIN;
+      return -1;
+   }
+   return 0;
 }
-
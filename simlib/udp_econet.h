@@ -2,13 +2,26 @@
 #define UDP_ECONET_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#include <sys/econet.h>
+
 #define MAX_STATIONS    64
 #define MAX_ECONET_BUF  2048     // maximum econet datagram size
+#define SIM_ACK_TIMEOUT 100      // ms to wait for a scout or data ack
+
+// Each UDP datagram carries one econet frame, without the FCS:
+//   scout:   dst stn, dst net, src stn, src net, control, port
+//   ack:     dst stn, dst net, src stn, src net
+//   data:    dst stn, dst net, src stn, src net, payload...
+// so the four way handshake is the same as on a real network.
+#define FRAME_HDR_LEN   4
+#define SCOUT_LEN       6
 
-enum {
+typedef enum {
    WAIT_SCOUT,
    WAIT_DATA
 } EconetRxState;
@@ -20,8 +33,26 @@ typedef struct {
    uint16_t          port;
 } EconetStation;
 
+// Read a station table in b-em format (net station host port), one
+// station per line. Returns the number of stations, or -1 with errno
+// set if the file can't be read.
+int sim_read_stations(const char *cfgfile, EconetStation *table, int max);
+
 // Configure and start up simulated econet.
 // Returns 0 on success.
 int sim_config_econet(const char *cfgfile, uint8_t our_net, uint8_t our_station);
 
+// Start sending a frame. Only one frame can be in flight, as with the
+// hardware. Returns -EAGAIN if the transmitter is busy.
+int sim_econet_tx_start(const struct econet_addr *dest, const void *data, size_t len);
+
+// Result of the last frame sent: -EINPROGRESS while the handshake is
+// running, otherwise 0, -EHOSTUNREACH (no scout ack) or -ETIMEDOUT.
+int sim_econet_tx_status(void);
+
+// Provided by the driver (sim_econet.c) and called from the receive
+// thread, as the ISR uses the driver's port list and queues.
+bool econet_rx_accept(uint8_t port);
+void econet_rx_deliver(uint8_t port, const uint8_t *frame, size_t len);
+
 #endif
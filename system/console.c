@@ -34,6 +34,7 @@
 #include "fd.h"
 #include "sysdefs.h"
 #include "devices.h"
+#include "wait.h"
 
 static FDfunction cons_func = {
    .fd_read  = console_read,
@@ -120,7 +121,8 @@ static ssize_t console_read_interactive(int fd, void *buf, size_t count)
    if(!count) return 0;
 
    // FIXME will need a way to break out (eg Ctrl-C)
-   while(cons_rx_count == 0);
+   while(cons_rx_count == 0)
+      wait_event(WAIT_CONSOLE);
 
    DISABLE_INTERRUPTS
    cons_rx_count--;
@@ -28,19 +28,24 @@
 #include "printk.h"
 #include "super_shell.h"
 #include "cpu.h"
+#include "task.h"
 
 void ebreak_handler(uint32_t *registers)
 {
    printk("INFO: Hit EBREAK instruction\n");
    dump_registers(registers);
+   task_hold(true);
    super_shell();
+   task_hold(false);
 }
 
 void illegal_handler(uint32_t *registers)
 {
    printk("ERROR: Hit illegal instruction\n");
    dump_registers(registers);
+   task_hold(true);
    super_shell();
+   task_hold(false);
 }
 
 void memaccess_handler(uint32_t *registers)
@@ -49,5 +54,7 @@ void memaccess_handler(uint32_t *registers)
    printk("ERROR: Invalid memory access\n");
    dump_registers(registers);
    printk("Failed address: %08x\n", invalid_addr);
+   task_hold(true);
    super_shell();
+   task_hold(false);
 }
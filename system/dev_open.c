@@ -31,6 +31,8 @@
 #include "rgbled.h"
 #include "spi_flashdev.h"
 #include "raw_econet.h"
+#include "trace.h"
+#include "prof.h"
 #include "errno.h"
 
 extern FD fdtable[MAX_FILE_DESCRIPTORS];
@@ -40,6 +42,8 @@ DevOpen open_table[] = {
    { .devname = "rgbled",     .open_device_impl = rgbled_open },
    { .devname = "spiflash",   .open_device_impl = spiflash_open },
    { .devname = "econet",     .open_device_impl = econet_open },
+   { .devname = "trace",      .open_device_impl = trace_open },
+   { .devname = "prof",       .open_device_impl = prof_open },
    { .devname = NULL,         .open_device_impl = NULL }
 };
 
@@ -0,0 +1,279 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// diskcache.c: write-back LRU sector cache between FatFS and the block
+// devices.
+//
+// Single sector transfers go through the cache. FatFS reads and writes
+// FAT and directory sectors one at a time through its sector window,
+// and these are preferred when choosing what to keep. Multi-sector
+// transfers (file data) go straight to the device, but are kept
+// coherent with anything that's cached. Dirty sectors are written back
+// when evicted, on CTRL_SYNC, and at the latest DISKCACHE_FLUSH_MS
+// after the first of them was dirtied, so an idle server doesn't sit
+// on unwritten FAT and directory updates.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "diskcache.h"
+#include "filesystem.h"
+#include "ktimer.h"
+
+#define SLOT_VALID      0x01
+#define SLOT_DIRTY      0x02
+#define SLOT_META       0x04     // FAT or directory sector
+
+typedef struct {
+   uint8_t        flags;
+   BYTE           pdrv;
+   LBA_t          sector;
+   uint32_t       last_used;
+} CacheSlot;
+
+static CacheSlot slots[DISKCACHE_SLOTS];
+static uint8_t slot_data[DISKCACHE_SLOTS][512] __attribute__((aligned(4)));
+static uint32_t use_clock;
+static struct diskcache_stats stats = { .slots = DISKCACHE_SLOTS };
+
+static void flush_due(KTimer *t);
+static KTimer flush_timer = { .fn = flush_due };
+
+//------------------------------------------------------------------
+// Find a sector in the cache
+static CacheSlot *
+lookup(BYTE pdrv, LBA_t sector)
+{
+   for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+      CacheSlot *slot = &slots[i];
+      if((slot->flags & SLOT_VALID) && slot->pdrv == pdrv && slot->sector == sector)
+         return slot;
+   }
+   return NULL;
+}
+
+//------------------------------------------------------------------
+// Write a dirty slot back to its device
+static DRESULT
+writeback(CacheSlot *slot)
+{
+   DRESULT res = disk_dev_write(slot->pdrv, slot_data[slot - slots], slot->sector, 1);
+   if(res == RES_OK) {
+      slot->flags &= ~SLOT_DIRTY;
+      stats.writebacks++;
+      stats.dirty--;
+   }
+   return res;
+}
+
+//------------------------------------------------------------------
+// The flush deadline has passed: write back everything that's dirty.
+// Anything that fails stays dirty, and the next write tries again.
+static void
+flush_due(KTimer *t)
+{
+   for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+      if(slots[i].flags & SLOT_DIRTY)
+         writeback(&slots[i]);
+   }
+}
+
+//------------------------------------------------------------------
+// Choose a slot to reuse: an empty one if there is one, otherwise the
+// least recently used data sector, and only if the cache is all FAT
+// and directory sectors, the least recently used of those.
+// Returns NULL if the victim couldn't be written back.
+static CacheSlot *
+get_victim()
+{
+   CacheSlot *lru_data = NULL;
+   CacheSlot *lru_meta = NULL;
+
+   for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+      CacheSlot *slot = &slots[i];
+      if(!(slot->flags & SLOT_VALID)) return slot;
+
+      if(slot->flags & SLOT_META) {
+         if(!lru_meta || slot->last_used < lru_meta->last_used)
+            lru_meta = slot;
+      }
+      else if(!lru_data || slot->last_used < lru_data->last_used) {
+         lru_data = slot;
+      }
+   }
+
+   CacheSlot *victim = lru_data ? lru_data : lru_meta;
+   if((victim->flags & SLOT_DIRTY) && writeback(victim) != RES_OK)
+      return NULL;
+
+   victim->flags = 0;
+   return victim;
+}
+
+//------------------------------------------------------------------
+// Mark a slot as just used
+static void
+touch(CacheSlot *slot, const void *buf)
+{
+   slot->last_used = ++use_clock;
+   if(fatfs_is_window(buf))
+      slot->flags |= SLOT_META;
+}
+
+//------------------------------------------------------------------
+// Read sectors
+DRESULT
+diskcache_read(BYTE pdrv, BYTE *buf, LBA_t sector, UINT count)
+{
+   if(count > 1) {
+      stats.bypassed += count;
+      DRESULT res = disk_dev_read(pdrv, buf, sector, count);
+      if(res != RES_OK) return res;
+
+      // the cache may hold newer copies than the device
+      for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+         CacheSlot *slot = &slots[i];
+         if((slot->flags & SLOT_DIRTY) && slot->pdrv == pdrv &&
+               slot->sector >= sector && slot->sector < sector + count)
+            memcpy(buf + (slot->sector - sector) * 512, slot_data[i], 512);
+      }
+      return RES_OK;
+   }
+
+   CacheSlot *slot = lookup(pdrv, sector);
+   if(slot) {
+      stats.hits++;
+   }
+   else {
+      stats.misses++;
+      slot = get_victim();
+      if(!slot) return RES_ERROR;
+
+      DRESULT res = disk_dev_read(pdrv, slot_data[slot - slots], sector, 1);
+      if(res != RES_OK) return res;
+
+      slot->flags = SLOT_VALID;
+      slot->pdrv = pdrv;
+      slot->sector = sector;
+   }
+
+   touch(slot, buf);
+   memcpy(buf, slot_data[slot - slots], 512);
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Write sectors
+DRESULT
+diskcache_write(BYTE pdrv, const BYTE *buf, LBA_t sector, UINT count)
+{
+   if(count > 1) {
+      stats.bypassed += count;
+      DRESULT res = disk_dev_write(pdrv, buf, sector, count);
+      if(res != RES_OK) return res;
+
+      // refresh any cached copies, which are now clean
+      for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+         CacheSlot *slot = &slots[i];
+         if((slot->flags & SLOT_VALID) && slot->pdrv == pdrv &&
+               slot->sector >= sector && slot->sector < sector + count) {
+            memcpy(slot_data[i], buf + (slot->sector - sector) * 512, 512);
+            if(slot->flags & SLOT_DIRTY) {
+               slot->flags &= ~SLOT_DIRTY;
+               stats.dirty--;
+            }
+         }
+      }
+      return RES_OK;
+   }
+
+   CacheSlot *slot = lookup(pdrv, sector);
+   if(slot) {
+      stats.hits++;
+   }
+   else {
+      stats.misses++;
+      slot = get_victim();
+      if(!slot) return RES_ERROR;
+
+      slot->flags = SLOT_VALID;
+      slot->pdrv = pdrv;
+      slot->sector = sector;
+   }
+
+   if(!(slot->flags & SLOT_DIRTY)) {
+      slot->flags |= SLOT_DIRTY;
+      stats.dirty++;
+      if(!ktimer_pending(&flush_timer))
+         ktimer_start(&flush_timer, DISKCACHE_FLUSH_MS);
+   }
+
+   touch(slot, buf);
+   memcpy(slot_data[slot - slots], buf, 512);
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Write back everything that's dirty on a drive
+DRESULT
+diskcache_sync(BYTE pdrv)
+{
+   DRESULT rc = RES_OK;
+
+   for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+      CacheSlot *slot = &slots[i];
+      if((slot->flags & SLOT_DIRTY) && slot->pdrv == pdrv) {
+         DRESULT res = writeback(slot);
+         if(res != RES_OK) rc = res;
+      }
+   }
+   return rc;
+}
+
+//------------------------------------------------------------------
+// Forget everything cached for a drive, e.g. when the media changes.
+void
+diskcache_invalidate(BYTE pdrv)
+{
+   for(int i = 0; i < DISKCACHE_SLOTS; i++) {
+      CacheSlot *slot = &slots[i];
+      if((slot->flags & SLOT_VALID) && slot->pdrv == pdrv) {
+         if(slot->flags & SLOT_DIRTY) stats.dirty--;
+         slot->flags = 0;
+      }
+   }
+}
+
+//------------------------------------------------------------------
+// Report cache statistics
+int
+SYS_diskcache_stats(struct diskcache_stats *st)
+{
+   if(!st) return -EFAULT;
+
+   memcpy(st, &stats, sizeof(struct diskcache_stats));
+   return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <sys/diskcache.h>
+#include "ff.h"
+#include "diskio.h"
+
+// Number of 512 byte sectors to cache. This is the RAM budget for
+// the cache, so keep it small.
+#define DISKCACHE_SLOTS    8
+
+// Longest a sector stays dirty in the cache
+#define DISKCACHE_FLUSH_MS 2000
+
+DRESULT diskcache_read(BYTE pdrv, BYTE *buf, LBA_t sector, UINT count);
+DRESULT diskcache_write(BYTE pdrv, const BYTE *buf, LBA_t sector, UINT count);
+DRESULT diskcache_sync(BYTE pdrv);
+void diskcache_invalidate(BYTE pdrv);
+
+// Device access below the cache, in diskio.c
+DRESULT disk_dev_read(BYTE pdrv, BYTE *buf, LBA_t sector, UINT count);
+DRESULT disk_dev_write(BYTE pdrv, const BYTE *buf, LBA_t sector, UINT count);
+
+// System calls
+int SYS_diskcache_stats(struct diskcache_stats *stats);
+
+#endif
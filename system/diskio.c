@@ -34,6 +34,8 @@
 #include "diskio.h"		/* Declarations of disk functions */
 #include "flashdisc.h"        // our SPI flash chip
 #include "sd.h"               // our SD card interface
+#include "diskcache.h"
+#include "trace.h"
 
 /* Definitions of physical drive number for each drive */
 #define DEV_SPIFLASH    0
@@ -70,6 +72,10 @@ DSTATUS disk_initialize (
 )
 {
    int rc;
+
+   // whatever was cached may not be on this media
+   diskcache_invalidate(pdrv);
+
    switch(pdrv) {
       case DEV_SPIFLASH:
          return intflash_init();
@@ -101,6 +107,15 @@ DRESULT disk_read (
 #ifdef DEBUG
    printk("disk_read: pdrv=%d sector=%ld count=%d\n", pdrv, sector, count);
 #endif
+   trace_event(TRACE_DISK_READ, sector, pdrv << 16 | count);
+   DRESULT rc = diskcache_read(pdrv, buff, sector, count);
+   trace_event(TRACE_DISK_READ_END, rc, 0);
+   return rc;
+}
+
+// Read from the device itself, below the sector cache
+DRESULT disk_dev_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
    switch(pdrv) {
       case DEV_SPIFLASH:
          return intflash_read(buff, sector, count);
@@ -125,6 +140,15 @@ DRESULT disk_write (
 	LBA_t sector,		/* Start sector in LBA */
 	UINT count			/* Number of sectors to write */
 )
+{
+   trace_event(TRACE_DISK_WRITE, sector, pdrv << 16 | count);
+   DRESULT rc = diskcache_write(pdrv, buff, sector, count);
+   trace_event(TRACE_DISK_WRITE_END, rc, 0);
+   return rc;
+}
+
+// Write to the device itself, below the sector cache
+DRESULT disk_dev_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
 {
    switch(pdrv) {
       case DEV_SPIFLASH:
@@ -151,6 +175,11 @@ DRESULT disk_ioctl (
 #ifdef DEBUG
    printk("disk_ioctl: pdrv=%d cmd=%d\n", pdrv, cmd);
 #endif
+   if(cmd == CTRL_SYNC) {
+      DRESULT res = diskcache_sync(pdrv);
+      if(res != RES_OK) return res;
+   }
+
    switch(pdrv) {
       case DEV_SPIFLASH:
          return intflash_ioctl(cmd, buff);
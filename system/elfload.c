@@ -33,6 +33,7 @@
 #include "console.h"
 #include "fd.h"
 #include "elfload.h"
+#include "task.h"
 #include "brk.h"
 #include "printk.h"
 #include "init.h"
@@ -46,6 +47,10 @@ int elf_run(const char *args)
    char *filename;
    int status;
 
+   // loading would overwrite the kernel stack this is running on
+   if(task_self() != TASK_MAIN)
+      return -EBUSY;
+
    // make sure we're not going to overwrite the args
    // (e.g. new args are sufficiently large to overlap new user
    // stack)
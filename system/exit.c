@@ -30,10 +30,17 @@
 #include "printk.h"
 #include "super_shell.h"
 #include "init.h"
+#include "task.h"
 
 //---------------------------------------------------------------
 // Reload init from flash
 void SYS_exit(int status) {
+   // Another task's kernel stack is in the memory init is loaded into
+   if(task_self() != TASK_MAIN) {
+      task_reset();
+      task_call_on_stack(SYS_exit, status, MAIN_KSTACK);
+   }
+
    if(status != 0) printk("Abnormal exit: %d\n", status);
    int load_status;
 
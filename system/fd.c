@@ -29,6 +29,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #include "fd.h"
@@ -38,6 +39,10 @@
 #include "dev_open.h"
 #include "filesystem.h"
 
+// Bounce buffer, on the kernel stack, for sendfile between devices
+// that have no quicker way
+#define SENDFILE_CHUNK  512
+
 FD fdtable[MAX_FILE_DESCRIPTORS];
 
 //------------------------------------------------------------------------
@@ -56,7 +61,7 @@ void fd_init() {
 // Write to an fd
 //
 ssize_t SYS_write(int fd, const void *buf, size_t count) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -71,7 +76,7 @@ ssize_t SYS_write(int fd, const void *buf, size_t count) {
 // Read from an fd
 //
 ssize_t SYS_read(int fd, void *buf, size_t count) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -82,10 +87,132 @@ ssize_t SYS_read(int fd, void *buf, size_t count) {
    return -EBADF;
 }
 
+//------------------------------------------------------------------------
+// Write several buffers to an fd. Devices where each write is a
+// message (econet) gather them into one; otherwise it's the same as
+// a write for each buffer.
+ssize_t SYS_writev(int fd, const struct iovec *iov, int iovcnt) {
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
+      return -EBADF;
+   if(iovcnt < 0)
+      return -EINVAL;
+
+   FD fd_ent = fdtable[fd];
+   if(!fd_ent.flags)
+      return -EBADF;
+   if(fd_ent.fdfunc->fd_writev != NULL)
+      return fd_ent.fdfunc->fd_writev(fd, iov, iovcnt);
+   if(fd_ent.fdfunc->fd_write == NULL)
+      return -EBADF;
+
+   ssize_t total = 0;
+   for(int i = 0; i < iovcnt; i++) {
+      ssize_t rc = fd_ent.fdfunc->fd_write(fd, iov[i].iov_base, iov[i].iov_len);
+      if(rc < 0)
+         return total ? total : rc;
+      total += rc;
+      if(rc < iov[i].iov_len)
+         break;
+   }
+   return total;
+}
+
+//------------------------------------------------------------------------
+// Read or write at an offset, without moving the fd's position
+//
+ssize_t SYS_pread(int fd, void *buf, size_t count, off_t offset) {
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
+      return -EBADF;
+   if(offset < 0)
+      return -EINVAL;
+
+   FD fd_ent = fdtable[fd];
+   if(fd_ent.flags && fd_ent.fdfunc->fd_pread != NULL) {
+      return fd_ent.fdfunc->fd_pread(fd, buf, count, offset);
+   }
+
+   return fd_ent.flags ? -ESPIPE : -EBADF;
+}
+
+ssize_t SYS_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
+      return -EBADF;
+   if(offset < 0)
+      return -EINVAL;
+
+   FD fd_ent = fdtable[fd];
+   if(fd_ent.flags && fd_ent.fdfunc->fd_pwrite != NULL) {
+      return fd_ent.fdfunc->fd_pwrite(fd, buf, count, offset);
+   }
+
+   return fd_ent.flags ? -ESPIPE : -EBADF;
+}
+
+//------------------------------------------------------------------------
+// Copy from one fd to another without the data going through the
+// caller. If offset isn't NULL, in_fd is read at *offset (which is
+// advanced) instead of at its file position.
+// The output device's fd_sendfile gets the first go, so it can read
+// straight into its own buffers; otherwise it's a read/write loop.
+//
+ssize_t SYS_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+   if(out_fd >= MAX_FILE_DESCRIPTORS || out_fd < 0 ||
+         in_fd >= MAX_FILE_DESCRIPTORS || in_fd < 0)
+      return -EBADF;
+
+   FD out = fdtable[out_fd];
+   FD in = fdtable[in_fd];
+   if(!out.flags || !in.flags ||
+         out.fdfunc->fd_write == NULL || in.fdfunc->fd_read == NULL)
+      return -EBADF;
+   if(offset != NULL) {
+      if(in.fdfunc->fd_pread == NULL)
+         return -ESPIPE;
+      if(*offset < 0)
+         return -EINVAL;
+   }
+
+   if(out.fdfunc->fd_sendfile != NULL) {
+      ssize_t rc = out.fdfunc->fd_sendfile(out_fd, in_fd, offset, count);
+      if(rc != -EOPNOTSUPP)
+         return rc;
+   }
+
+   uint8_t buf[SENDFILE_CHUNK];
+   size_t total = 0;
+   ssize_t rc = 0;
+   while(total < count) {
+      size_t len = count - total;
+      if(len > sizeof(buf)) len = sizeof(buf);
+
+      if(offset != NULL)
+         rc = in.fdfunc->fd_pread(in_fd, buf, len, *offset);
+      else
+         rc = in.fdfunc->fd_read(in_fd, buf, len);
+      if(rc <= 0)
+         break;
+
+      ssize_t got = rc;
+      rc = out.fdfunc->fd_write(out_fd, buf, got);
+      if(rc <= 0)
+         break;
+
+      if(offset != NULL)
+         *offset += rc;
+      total += rc;
+      if(rc < got)
+         break;
+   }
+
+   if(total == 0 && rc < 0)
+      return rc;
+   return total;
+}
+
 //------------------------------------------------------------------------
 // Peek an fd and return how many bytes are available to read
 ssize_t SYS_peek(int fd) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -99,7 +226,7 @@ ssize_t SYS_peek(int fd) {
 //------------------------------------------------------------------------
 // ioctl
 int SYS_ioctl(int fd, unsigned long request, void *ptr) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -114,7 +241,7 @@ int SYS_ioctl(int fd, unsigned long request, void *ptr) {
 // Stat an fd
 //
 int SYS_fstat(int fd, struct stat *statbuf) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -129,7 +256,7 @@ int SYS_fstat(int fd, struct stat *statbuf) {
 // seek on an fd
 //
 off_t SYS_lseek(int fd, off_t offset, int whence) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    FD fd_ent = fdtable[fd];
@@ -144,7 +271,7 @@ off_t SYS_lseek(int fd, off_t offset, int whence) {
 // Close an fd
 //
 int SYS_close(int fd) {
-   if(fd > MAX_FILE_DESCRIPTORS || fd < 0)
+   if(fd >= MAX_FILE_DESCRIPTORS || fd < 0)
       return -EBADF;
 
    // No-op if trying to close stdout/stderr/stdin
@@ -201,7 +328,7 @@ FD *fd_alloc(int *fdnum) {
 //-----------------------------------------------------------------------
 // Get an fd entry from its integer value
 FD *get_fdentry(int fd) {
-   if(fd < 0 || fd > MAX_FILE_DESCRIPTORS)
+   if(fd < 0 || fd >= MAX_FILE_DESCRIPTORS)
       return NULL;
 
    return &fdtable[fd];
@@ -37,6 +37,8 @@
 // Temporary flag to reserve a file descriptor
 #define FLAG_ALLOCATED  0x80000000
 
+struct iovec;
+
 typedef struct _FDfunction {
    ssize_t (*fd_read)(int fd, void *ptr, size_t count);
    ssize_t (*fd_write)(int fd, const void *ptr, size_t count);
@@ -45,6 +47,12 @@ typedef struct _FDfunction {
    int     (*fd_close)(int fd);
    int     (*fd_ioctl)(int fd, unsigned long request, void *ptr);
    ssize_t (*fd_peek)(int fd);
+   short   (*fd_poll)(int fd);        // optional, returns POLL* flags
+   ssize_t (*fd_pread)(int fd, void *ptr, size_t count, off_t offset);          // optional
+   ssize_t (*fd_pwrite)(int fd, const void *ptr, size_t count, off_t offset);   // optional
+   ssize_t (*fd_writev)(int fd, const struct iovec *iov, int iovcnt);           // optional
+   // optional, on the output fd; -EOPNOTSUPP falls back to a plain copy
+   ssize_t (*fd_sendfile)(int fd, int in_fd, off_t *offset, size_t count);
 } FDfunction;
 
 typedef struct _FD {
@@ -69,6 +77,10 @@ off_t   SYS_lseek(int fd, off_t offset, int whence);
 int     SYS_ioctl(int fd, unsigned long request, void *ptr);
 int     SYS_close(int fd);
 int     SYS_open(const char *pathname, int flags, mode_t mode);
+ssize_t SYS_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t SYS_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t SYS_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t SYS_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 
 
 #endif
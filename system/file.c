@@ -41,17 +41,39 @@
 #include "ff.h"
 #include "filesystem.h"
 #include "printk.h"
+#include "kmalloc.h"
+
+// sendfile between files copies this many sectors at a time
+#define COPY_SECTORS    4
 
 static FDfunction fileio_func = {
    .fd_read          = fileio_read,
    .fd_write         = fileio_write,
    .fd_close         = fileio_close,
    .fd_lseek         = fileio_lseek,
-   .fd_fstat         = fileio_fstat
+   .fd_fstat         = fileio_fstat,
+   .fd_pread         = fileio_pread,
+   .fd_pwrite        = fileio_pwrite,
+   .fd_sendfile      = fileio_sendfile
 };
 
+
 FIL   fhnd[MAX_FD_COUNT];
 
+// Where read and write carry on from. pread and pwrite move the FatFS
+// file pointer but not this; the file pointer is only put back when
+// it's next needed, so a run of preads at increasing offsets seeks
+// forward from where the last one finished, not from the start of
+// the cluster chain.
+static FSIZE_t fpos[MAX_FD_COUNT];
+
+static FRESULT fileio_seek(FIL *fp, FSIZE_t pos)
+{
+   if(f_tell(fp) == pos)
+      return FR_OK;
+   return f_lseek(fp, pos);
+}
+
 void init_fileio()
 {
    memset(&fhnd, 0, sizeof(fhnd));
@@ -78,37 +100,110 @@ int fileio_open(const char *path, int flags, mode_t mode)
 
    FRESULT res = f_open(fp, path, fatfs_flags);
 
-   if(res == FR_OK) 
+   if(res == FR_OK) {
+      fpos[fdnum - MIN_FD_NUMBER] = f_tell(fp);
       return fdnum;
+   }
 
    fd_dealloc(fd);
    return fatfs_to_errno(res);
 }
 
 ssize_t fileio_read(int fd, void *buf, size_t count)
+{
+   FSIZE_t *pos = &fpos[fd - MIN_FD_NUMBER];
+   ssize_t rc = fileio_pread(fd, buf, count, *pos);
+   if(rc > 0)
+      *pos += rc;
+   return rc;
+}
+
+ssize_t fileio_write(int fd, const void *buf, size_t count)
+{
+   FSIZE_t *pos = &fpos[fd - MIN_FD_NUMBER];
+   ssize_t rc = fileio_pwrite(fd, buf, count, *pos);
+   if(rc > 0)
+      *pos += rc;
+   return rc;
+}
+
+ssize_t fileio_pread(int fd, void *buf, size_t count, off_t offset)
 {
    FIL *fp = &fhnd[fd - MIN_FD_NUMBER];
    UINT bytes_read;
 
-   FRESULT res = f_read(fp, buf, count, &bytes_read);
+   FRESULT res = fileio_seek(fp, offset);
+   if(res == FR_OK)
+      res = f_read(fp, buf, count, &bytes_read);
    if(res == FR_OK)
       return bytes_read;
 
    return fatfs_to_errno(res);
 }
 
-ssize_t fileio_write(int fd, const void *buf, size_t count)
+ssize_t fileio_pwrite(int fd, const void *buf, size_t count, off_t offset)
 {
    FIL *fp = &fhnd[fd - MIN_FD_NUMBER];
    UINT bytes_written;
 
-   FRESULT res = f_write(fp, buf, count, &bytes_written);
+   FRESULT res = fileio_seek(fp, offset);
+   if(res == FR_OK)
+      res = f_write(fp, buf, count, &bytes_written);
    if(res == FR_OK)
       return bytes_written;
 
    return fatfs_to_errno(res);
 }
 
+// Copy from another file, which may be on the other volume (such as
+// when installing a program from SD to flash). The first transfer
+// brings the read position up to a sector boundary, so the rest are
+// whole sectors that FatFS moves straight between the disc and the
+// buffer instead of through the file's sector window. Copying to the
+// start of a new file, the usual case, is then aligned at both ends.
+ssize_t fileio_sendfile(int fd, int in_fd, off_t *offset, size_t count)
+{
+   FD *in = get_fdentry(in_fd);
+   if(in->fdfunc != &fileio_func)
+      return -EOPNOTSUPP;
+
+   uint8_t *buf = kmalloc(COPY_SECTORS * FF_MIN_SS);
+   if(buf == NULL)
+      return -EOPNOTSUPP;     // the plain copy needs no heap
+
+   FSIZE_t pos = offset ? *offset : fpos[in_fd - MIN_FD_NUMBER];
+   size_t total = 0;
+   ssize_t rc = 0;
+   while(total < count) {
+      size_t len = COPY_SECTORS * FF_MIN_SS - pos % FF_MIN_SS;
+      if(len > count - total) len = count - total;
+
+      rc = fileio_pread(in_fd, buf, len, pos);
+      if(rc <= 0)
+         break;
+
+      ssize_t got = rc;
+      rc = fileio_write(fd, buf, got);
+      if(rc <= 0)
+         break;
+
+      pos += rc;
+      total += rc;
+      if(rc < got)
+         break;
+   }
+   kfree(buf);
+
+   if(offset)
+      *offset = pos;
+   else
+      fpos[in_fd - MIN_FD_NUMBER] = pos;
+
+   if(total == 0 && rc < 0)
+      return rc;
+   return total;
+}
+
 int fileio_close(int fd) {
    FIL *fp = &fhnd[fd - MIN_FD_NUMBER];
    FRESULT res = f_close(fp);
@@ -124,7 +219,7 @@ off_t fileio_lseek(int fd, off_t offset, int whence)
 
    switch(whence) {
       case SEEK_CUR:
-         target = f_tell(fp) + offset;
+         target = fpos[fd - MIN_FD_NUMBER] + offset;
          res = f_lseek(fp, target);
          break;
       case SEEK_END:
@@ -135,8 +230,10 @@ off_t fileio_lseek(int fd, off_t offset, int whence)
          res = f_lseek(fp, offset);
    }
 
-   if(res == FR_OK) 
+   if(res == FR_OK) {
+      fpos[fd - MIN_FD_NUMBER] = f_tell(fp);
       return f_tell(fp);
+   }
 
    return fatfs_to_errno(res);
 }
@@ -28,6 +28,7 @@
 #include <sys/dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 
 typedef struct {
    bool  open;
@@ -37,7 +38,9 @@ typedef struct {
 int SYS_mount(const char *src, const char *target, const char *fstype,
               unsigned long mountflags, const void *data);
 int SYS_umount(const char *target);
+int SYS_statfs(const char *path, struct statfs *buf);
 int fatfs_to_errno(FRESULT res);
+bool fatfs_is_window(const void *buf);
 
 void init_dirs(void);
 
@@ -48,6 +51,7 @@ int SYS_readdir(int dh, struct dirent *d);
 
 int SYS_unlink(const char *pathname);
 int SYS_mkdir(const char *pathname, mode_t mode);
+int SYS_chdir(const char *pathname);
 int SYS_stat(const char *pathname, struct stat *statbuf);
 
 // File i/o on open files
@@ -58,6 +62,9 @@ ssize_t fileio_write(int fd, const void *buf, size_t count);
 int fileio_close(int fd);
 off_t fileio_lseek(int fd, off_t offset, int whence);
 int fileio_fstat(int fd, struct stat *statbuf);
+ssize_t fileio_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t fileio_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t fileio_sendfile(int fd, int in_fd, off_t *offset, size_t count);
 
 // Automount/mount at start
 bool sd_insert_mount();
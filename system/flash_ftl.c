@@ -0,0 +1,319 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// flash_ftl.c: log-structured flash translation layer for the internal
+// flash FatFS volume.
+//
+// Rewriting a 512 byte sector in place needs a 4k erase, so instead
+// sectors are appended to a log of erase blocks and a remap table
+// tracks where the current copy of each sector lives. Each log block
+// starts with a header (magic, sequence number and the sector number
+// held in each slot) followed by FTL_SLOTS sector slots. The table is
+// rebuilt at mount by replaying the block headers in sequence order.
+// Sectors that have never been written through the FTL are read from
+// the original filesystem image at FS_START.
+//
+// A slot's data is programmed before its tag, so a write interrupted
+// by a power cut just leaves an untagged slot that is ignored at mount.
+// Blocks with no live sectors are reused; the garbage collector copies
+// the live sectors out of the block with the fewest of them. Some
+// collection is done from ftl_sync so it's normally out of the way
+// before a write needs space.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash_ftl.h"
+#include "flashdisc.h"
+#include "spi_flashdev.h"
+
+#define FTL_MAGIC          0x314c5446     // "FTL1"
+#define FTL_BLOCK_SIZE     4096
+#define FTL_UNMAPPED       0xFFFF
+
+typedef struct {
+   uint32_t       magic;
+   uint32_t       seq;
+   uint16_t       tag[FTL_SLOTS];      // sector in each slot, 0xFFFF if unused
+} FTLHeader;
+
+#define BLOCK_ADDR(b)      (FTL_LOG_START + ((b) * FTL_BLOCK_SIZE))
+#define SLOT_ADDR(b, s)    (BLOCK_ADDR(b) + (((s) + 1) * SECTOR_SIZE))
+
+static uint16_t map[SECTOR_COUNT];           // block * FTL_SLOTS + slot
+static uint8_t  valid[FTL_LOG_BLOCKS];       // live sectors in each block
+static bool     erased[FTL_LOG_BLOCKS];      // known to be erased
+static uint32_t block_seq[FTL_LOG_BLOCKS];   // only used at mount
+static uint32_t next_seq;
+static int      cur_block;
+static int      cur_slot;
+static int      last_opened;
+static bool     mounted;
+static bool     in_gc;
+static uint8_t  gc_buf[SECTOR_SIZE] __attribute__((aligned(4)));
+
+static DRESULT append(LBA_t sector, const BYTE *data);
+
+//------------------------------------------------------------------
+// Rebuild the remap table from the log
+DRESULT
+ftl_mount(void)
+{
+   FTLHeader hdr;
+   uint32_t prev_seq = 0;
+
+   if(mounted) return RES_OK;
+
+   // anything buffered for the raw device must be on the chip first
+   spiflash_sync();
+
+   memset(map, 0xFF, sizeof(map));
+   memset(valid, 0, sizeof(valid));
+   memset(erased, 0, sizeof(erased));
+   next_seq = 1;
+
+   for(int b = 0; b < FTL_LOG_BLOCKS; b++) {
+      flash_memcpy(BLOCK_ADDR(b), &hdr, offsetof(FTLHeader, tag));
+      block_seq[b] = (hdr.magic == FTL_MAGIC) ? hdr.seq : 0;
+      if(block_seq[b] >= next_seq) next_seq = block_seq[b] + 1;
+   }
+
+   // Replay blocks oldest first so later copies of a sector win
+   for(;;) {
+      int b = -1;
+      for(int i = 0; i < FTL_LOG_BLOCKS; i++) {
+         if(block_seq[i] > prev_seq && (b < 0 || block_seq[i] < block_seq[b]))
+            b = i;
+      }
+      if(b < 0) break;
+      prev_seq = block_seq[b];
+
+      flash_memcpy(BLOCK_ADDR(b), &hdr, sizeof(hdr));
+      for(int s = 0; s < FTL_SLOTS; s++) {
+         if(hdr.tag[s] < SECTOR_COUNT)
+            map[hdr.tag[s]] = b * FTL_SLOTS + s;
+      }
+   }
+
+   for(int i = 0; i < SECTOR_COUNT; i++) {
+      if(map[i] != FTL_UNMAPPED)
+         valid[map[i] / FTL_SLOTS]++;
+   }
+
+   // Partly used blocks aren't appended to, start a new one
+   cur_block = -1;
+   cur_slot = FTL_SLOTS;
+   last_opened = -1;
+   mounted = true;
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+void
+ftl_unmount(void)
+{
+   mounted = false;
+}
+
+//------------------------------------------------------------------
+// Read sectors from wherever their current copy is
+DRESULT
+ftl_read(BYTE *buf, LBA_t sector, UINT count)
+{
+   if(!mounted) return RES_NOTRDY;
+   if(sector + count > SECTOR_COUNT) return RES_PARERR;
+   spiflash_sync();
+
+   while(count--) {
+      uint16_t loc = map[sector];
+      uint32_t addr = (loc == FTL_UNMAPPED) ?
+         FS_START + (sector * SECTOR_SIZE) :
+         SLOT_ADDR(loc / FTL_SLOTS, loc % FTL_SLOTS);
+
+      flash_memcpy(addr, buf, SECTOR_SIZE);
+      buf += SECTOR_SIZE;
+      sector++;
+   }
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+DRESULT
+ftl_write(const BYTE *buf, LBA_t sector, UINT count)
+{
+   if(!mounted) return RES_NOTRDY;
+   if(sector + count > SECTOR_COUNT) return RES_PARERR;
+   spiflash_sync();
+
+   while(count--) {
+      DRESULT res = append(sector, buf);
+      if(res != RES_OK) return res;
+      buf += SECTOR_SIZE;
+      sector++;
+   }
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Number of blocks that can be opened for writing
+static int
+free_blocks(void)
+{
+   int count = 0;
+   for(int b = 0; b < FTL_LOG_BLOCKS; b++) {
+      if(valid[b] == 0 && b != cur_block) count++;
+   }
+   return count;
+}
+
+//------------------------------------------------------------------
+// Find the next free block after the last one opened, so the wear is
+// spread round the log. Returns -1 if there isn't one.
+static int
+next_free(bool only_erased)
+{
+   for(int i = 1; i <= FTL_LOG_BLOCKS; i++) {
+      int b = (last_opened + i + FTL_LOG_BLOCKS) % FTL_LOG_BLOCKS;
+      if(valid[b] == 0 && b != cur_block && (erased[b] || !only_erased))
+         return b;
+   }
+   return -1;
+}
+
+//------------------------------------------------------------------
+// Pick a free block, preferring one the collector has already erased,
+// erase it if need be and write its header.
+static DRESULT
+open_block(void)
+{
+   int b = next_free(true);
+   if(b < 0) b = next_free(false);
+   if(b < 0) return RES_ERROR;
+
+   if(!erased[b]) spiflash_erase_sector(BLOCK_ADDR(b));
+   erased[b] = false;
+
+   FTLHeader hdr;
+   hdr.magic = FTL_MAGIC;
+   hdr.seq = next_seq++;
+   spiflash_program(BLOCK_ADDR(b), (uint8_t *)&hdr, offsetof(FTLHeader, tag));
+
+   cur_block = b;
+   cur_slot = 0;
+   last_opened = b;
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Copy the live sectors out of the block with the fewest of them, as
+// long as it has no more than max_live, and erase it.
+static DRESULT
+gc_step(int max_live)
+{
+   FTLHeader hdr;
+   int victim = -1;
+
+   for(int b = 0; b < FTL_LOG_BLOCKS; b++) {
+      if(b == cur_block || valid[b] == 0) continue;
+      if(victim < 0 || valid[b] < valid[victim]) victim = b;
+   }
+   if(victim < 0 || valid[victim] > max_live) return RES_OK;
+
+   in_gc = true;
+   flash_memcpy(BLOCK_ADDR(victim), &hdr, sizeof(hdr));
+   for(int s = 0; s < FTL_SLOTS; s++) {
+      uint16_t sector = hdr.tag[s];
+      if(sector < SECTOR_COUNT && map[sector] == victim * FTL_SLOTS + s) {
+         flash_memcpy(SLOT_ADDR(victim, s), gc_buf, SECTOR_SIZE);
+         DRESULT res = append(sector, gc_buf);
+         if(res != RES_OK) {
+            in_gc = false;
+            return res;
+         }
+      }
+   }
+   in_gc = false;
+
+   spiflash_erase_sector(BLOCK_ADDR(victim));
+   erased[victim] = true;
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Append a sector to the log and remap it.
+// One free block is always held back so the collector has somewhere
+// to copy to.
+static DRESULT
+append(LBA_t sector, const BYTE *data)
+{
+   DRESULT res;
+
+   while(!in_gc && cur_slot == FTL_SLOTS && free_blocks() <= 1) {
+      int before = free_blocks();
+      if((res = gc_step(FTL_SLOTS - 1)) != RES_OK) return res;
+      if(cur_slot == FTL_SLOTS && free_blocks() <= before)
+         return RES_ERROR;    // nothing left to collect
+   }
+   if(cur_slot == FTL_SLOTS && (res = open_block()) != RES_OK)
+      return res;
+
+   uint16_t tag = sector;
+   spiflash_program(SLOT_ADDR(cur_block, cur_slot), data, SECTOR_SIZE);
+   spiflash_program(BLOCK_ADDR(cur_block) + offsetof(FTLHeader, tag[cur_slot]),
+         (uint8_t *)&tag, sizeof(tag));
+
+   if(map[sector] != FTL_UNMAPPED)
+      valid[map[sector] / FTL_SLOTS]--;
+   map[sector] = cur_block * FTL_SLOTS + cur_slot;
+   valid[cur_block]++;
+   cur_slot++;
+   return RES_OK;
+}
+
+//------------------------------------------------------------------
+// Writes go straight to the chip so there's nothing to flush. Use the
+// opportunity to collect mostly stale blocks while space is getting
+// low, and to erase a free block ahead of time.
+DRESULT
+ftl_sync(void)
+{
+   if(!mounted) return RES_NOTRDY;
+   spiflash_sync();
+
+   if(free_blocks() < FTL_GC_LOW) {
+      DRESULT res = gc_step(FTL_SLOTS / 2);
+      if(res != RES_OK) return res;
+   }
+
+   if(next_free(true) < 0) {
+      int b = next_free(false);
+      if(b >= 0) {
+         spiflash_erase_sector(BLOCK_ADDR(b));
+         erased[b] = true;
+      }
+   }
+   return RES_OK;
+}
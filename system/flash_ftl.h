@@ -0,0 +1,45 @@
+#ifndef FLASH_FTL_H
+#define FLASH_FTL_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include "ff.h"
+#include "diskio.h"
+
+// Log area for the flash translation layer. Sectors written by FatFS
+// are appended here; anything not yet rewritten is still read from the
+// original image at FS_START.
+#define FTL_LOG_START      0x80000
+#define FTL_LOG_BLOCKS     96       // 4k erase blocks, 384k
+#define FTL_SLOTS          7        // sectors per block after the header
+#define FTL_GC_LOW         8        // collect when idle below this many free blocks
+
+DRESULT ftl_mount(void);
+DRESULT ftl_read(BYTE *buf, LBA_t sector, UINT count);
+DRESULT ftl_write(const BYTE *buf, LBA_t sector, UINT count);
+DRESULT ftl_sync(void);
+void ftl_unmount(void);
+
+#endif
@@ -9,52 +9,33 @@
 #include "diskio.h"
 #include "flashdisc.h"
 #include "printk.h"
-#include "spi_flashdev.h"  // for spiflash_sync
+#include "flash_ftl.h"
 
 #include "fd.h"
 //#define FLASH_DEBUG 1
 
-static int flash_fd = -1;
 static LBA_t sectorCount = SECTOR_COUNT;
 static WORD secsz = SECTOR_SIZE;
 static DWORD blocksz = BLOCK_SIZE;
 
 DSTATUS intflash_init() {
-   if(flash_fd < 0)
-      flash_fd = SYS_open("/dev/spiflash", O_RDWR, 0);
+   DRESULT res = ftl_mount();
 
 #ifdef FLASH_DEBUG
-   printk("intflash_init: fd open: %d\n", flash_fd);
+   printk("intflash_init: ftl mount: %d\n", res);
 #endif
-   return (flash_fd > 0) ? 0 : STA_NOINIT;
+   return (res == RES_OK) ? 0 : STA_NOINIT;
 }
 
 //-------------------------------------------------------------
-// Read a flash sector. Calculate the byte offset, lseek to
-// the offset, and perform a read.
+// Read a flash sector. The FTL knows where the current copy of
+// each sector is.
 DRESULT intflash_read(BYTE *buf, LBA_t sector, UINT count)
 {
 #ifdef FLASH_DEBUG
    printk("Read sector %d count %d\n", sector, count);
 #endif
-   uint32_t flashaddress;
-   uint32_t bytecount;
-   if(flash_fd < 0) return RES_NOTRDY;
-
-   flashaddress = FS_START + (sector * SECTOR_SIZE);
-   bytecount = count * SECTOR_SIZE;
-
-   off_t rc = SYS_lseek(flash_fd, flashaddress, SEEK_SET);
-#ifdef FLASH_DEBUG
-   printk("seek: offset=%x result=%x\n", flashaddress, rc);
-#endif
-   if(rc < 0) return RES_ERROR;
-
-   int bytes = SYS_read(flash_fd, buf, bytecount);
-#ifdef FLASH_DEBUG
-   printk("read: bytes = %d\n", bytes);
-#endif
-   return rc > -1 ? RES_OK : RES_ERROR;
+   return ftl_read(buf, sector, count);
 }
 
 //---------------------------------------------------------------
@@ -83,42 +64,24 @@ DRESULT intflash_ioctl(BYTE cmd, void *buf)
    return RES_PARERR;
 }
 
+//---------------------------------------------------------------
+// Write flash sectors. These are appended to the FTL's log rather
+// than rewriting (and erasing) the 4k block they're in.
 DRESULT intflash_write(const BYTE *buf, LBA_t sector, UINT count)
 {
 #ifdef FLASH_DEBUG
    printk("Write sector %d count %d\n", sector, count);
 #endif
-   uint32_t flashaddress;
-   uint32_t bytecount;
-   if(flash_fd < 0) return RES_NOTRDY;
-
-   flashaddress = FS_START + (sector * SECTOR_SIZE);
-   bytecount = count * SECTOR_SIZE;
-
-   off_t rc = SYS_lseek(flash_fd, flashaddress, SEEK_SET);
-#ifdef FLASH_DEBUG
-   printk("seek: offset=%x result=%x\n", flashaddress, rc);
-#endif
-   if(rc < 0) return RES_ERROR;
-
-   int bytes = SYS_write(flash_fd, buf, bytecount);
-#ifdef FLASH_DEBUG
-   printk("write: bytes = %d\n", bytes);
-#endif
-
-   return rc > -1 ? RES_OK : RES_ERROR;
+   return ftl_write(buf, sector, count);
 }
 
 DRESULT intflash_sync()
 {
-   spiflash_sync();
-   return RES_OK;
+   return ftl_sync();
 }
 
 void intflash_release()
 {
-   if(flash_fd > 0)
-      SYS_close(flash_fd);
-   flash_fd = -1;
+   ftl_unmount();
 }
 
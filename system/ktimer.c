@@ -0,0 +1,156 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// ktimer.c: kernel timers on a hashed timing wheel (see ktimer.h).
+//
+// A timer goes in the slot for the tick it's due at, modulo the number
+// of slots. Turning the wheel looks at the slots for the ticks that
+// have passed and runs the timers in them that are due; the others are
+// a lap or more away. The timer ISR only signals WAIT_TIMER once
+// ktimer_due is reached, so nothing wakes up for ticks with nothing
+// to do beyond the periodic KTIMER_WAKE.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "wait.h"
+#include "ktimer.h"
+
+#define SLOT_MASK       (KTIMER_SLOTS - 1)
+
+static KTimer *wheel[KTIMER_SLOTS];
+static uint32_t wheel_tick;         // first tick whose slot is still to look at
+volatile uint32_t ktimer_due = KTIMER_WAKE;
+
+//------------------------------------------------------------------
+static void
+link(KTimer **head, KTimer *t)
+{
+   t->next = *head;
+   if(t->next) t->next->pprev = &t->next;
+   t->pprev = head;
+   *head = t;
+}
+
+static void
+unlink(KTimer *t)
+{
+   *t->pprev = t->next;
+   if(t->next) t->next->pprev = t->pprev;
+   t->next = NULL;
+   t->pprev = NULL;
+}
+
+// Work out when the wheel next needs turning: the first tick within
+// KTIMER_WAKE that has a timer due, otherwise KTIMER_WAKE from now.
+static void
+update_due(uint32_t now)
+{
+   for(uint32_t tick = now + 1; tick != now + KTIMER_WAKE; tick++) {
+      for(KTimer *t = wheel[tick & SLOT_MASK]; t; t = t->next) {
+         if(t->expires == tick) {
+            ktimer_due = tick;
+            return;
+         }
+      }
+   }
+   ktimer_due = now + KTIMER_WAKE;
+}
+
+//------------------------------------------------------------------
+void
+ktimer_init(KTimer *t, void (*fn)(KTimer *), void *arg)
+{
+   t->next = NULL;
+   t->pprev = NULL;
+   t->fn = fn;
+   t->arg = arg;
+}
+
+// Start (or restart) a timer to go off in ms milliseconds
+void
+ktimer_start(KTimer *t, uint32_t ms)
+{
+   if(t->pprev) unlink(t);
+
+   t->expires = timer_count + (ms ? ms : 1);
+   link(&wheel[t->expires & SLOT_MASK], t);
+
+   if((int32_t)(t->expires - ktimer_due) < 0)
+      ktimer_due = t->expires;
+}
+
+// Stop a timer if it hasn't gone off yet
+void
+ktimer_cancel(KTimer *t)
+{
+   if(t->pprev) unlink(t);
+}
+
+bool
+ktimer_pending(const KTimer *t)
+{
+   return t->pprev != NULL;
+}
+
+//------------------------------------------------------------------
+// Run the timers that are due. Called by wait_event once ktimer_due
+// has been reached.
+void
+ktimer_run(void)
+{
+   uint32_t now = timer_count;
+   KTimer *expired = NULL;
+
+   // If the wheel's been left for a lap or more, every slot needs
+   // looking at, but only once.
+   uint32_t ticks = now - wheel_tick + 1;
+   if(ticks > KTIMER_SLOTS) ticks = KTIMER_SLOTS;
+
+   for(uint32_t i = 0; i < ticks; i++) {
+      KTimer *t = wheel[(wheel_tick + i) & SLOT_MASK];
+      while(t) {
+         KTimer *next = t->next;
+         if((int32_t)(t->expires - now) <= 0) {
+            unlink(t);
+            link(&expired, t);
+         }
+         t = next;
+      }
+   }
+   wheel_tick = now + 1;
+
+   // Callbacks can start and cancel timers, including ones still on
+   // the expired list.
+   bool fired = expired != NULL;
+   while(expired) {
+      KTimer *t = expired;
+      unlink(t);
+      t->fn(t);
+   }
+
+   update_due(now);
+   if(fired) wait_signal(WAIT_TIMER);
+}
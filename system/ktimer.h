@@ -0,0 +1,68 @@
+#ifndef KTIMER_H
+#define KTIMER_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Kernel timers on a hashed timing wheel. Starting and cancelling a
+// timer is O(1). The wheel has one slot per tick of the general purpose
+// timer (1ms); a timer due more than KTIMER_SLOTS ticks away waits in
+// its slot until the wheel has gone round enough times.
+//
+// Callbacks are run by wait_event, outside any filesystem call, with
+// interrupts on. They mustn't wait for events themselves. WAIT_TIMER
+// is signalled after any have run, so waiters can recheck.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KTIMER_SLOTS       64       // power of 2
+#define KTIMER_WAKE        10       // ticks between WAIT_TIMER at most
+
+// A timer that's all zero apart from fn and arg is idle, so a static
+// one can be set up with an initializer instead of ktimer_init.
+typedef struct ktimer {
+   struct ktimer  *next;
+   struct ktimer  **pprev;          // what points at it, NULL if idle
+   uint32_t       expires;          // timer_count when it's due
+   void           (*fn)(struct ktimer *);
+   void           *arg;
+} KTimer;
+
+extern volatile uint32_t timer_count;  // ticks since reset (timer.s)
+extern volatile uint32_t ktimer_due;   // tick the wheel next needs turning
+
+void  ktimer_init(KTimer *t, void (*fn)(KTimer *), void *arg);
+void  ktimer_start(KTimer *t, uint32_t ms);
+void  ktimer_cancel(KTimer *t);
+bool  ktimer_pending(const KTimer *t);
+void  ktimer_run(void);
+
+// True if the wheel is due to be turned
+static inline bool
+ktimer_expired(void)
+{
+   return (int32_t)(timer_count - ktimer_due) >= 0;
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "devices.h"
 #include "printk.h"
 #include "flashdisc.h"
+#include "diskcache.h"
 
 static FATFS sdfs;         // FatFS filesystem SD card TODO: array of these
 static FATFS flashfs;      // internal flash
@@ -44,11 +45,11 @@ int SYS_mount(const char *src, const char *target, const char *fstype,
    TCHAR *drv = NULL;
    if(!strcmp(src, "sd")) {
       fs = &sdfs;
-      drv = "1";
+      drv = "1:";
    }
    else if(!strcmp(src, "flash")) {
       fs = &flashfs;
-      drv = "0";
+      drv = "0:";
    }
 
    // It's quite likely we'll only ever support fatfs but never say never.
@@ -59,22 +60,64 @@ int SYS_mount(const char *src, const char *target, const char *fstype,
 
    FRESULT res = f_mount(fs, drv, 1);
 
+   // FAT12/16 has no FSINFO sector, so count the free clusters now.
+   // FatFS keeps the count up to date as clusters are allocated and
+   // freed, so statfs never has to scan the FAT again.
+   if(res == FR_OK) {
+      DWORD nclst;
+      res = f_getfree(drv, &nclst, &fs);
+   }
+
    // convert results to standard errno types
    return fatfs_to_errno(res);
 }
 
-// Implements the umount syscall
+// Implements the umount syscall. The target is the drive, "0:" for
+// the flash or "1:" for the SD card (the colon can be left off).
 int SYS_umount(const char *target)
 {
-   FRESULT res = f_unmount(target);
+   BYTE pdrv = target[0] - '0';
+   if(pdrv >= FF_VOLUMES || (target[1] && strcmp(target + 1, ":")))
+      return -EINVAL;
+   TCHAR drv[3] = { target[0], ':', 0 };
+
+   // FatFS doesn't sync on unmount, so write back anything cached
+   diskcache_sync(pdrv);
+
+   FRESULT res = f_unmount(drv);
+   diskcache_invalidate(pdrv);
 
    // close the flash if drive 0
-   if(!strcmp(target, "0"))
+   if(pdrv == 0)
       intflash_release();
 
    return fatfs_to_errno(res);
 }
 
+// Implements the statfs syscall. The free cluster count is seeded at
+// mount, so this doesn't touch the disc.
+int SYS_statfs(const char *path, struct statfs *buf)
+{
+   FATFS *fs;
+   DWORD nclst;
+
+   FRESULT res = f_getfree(path, &nclst, &fs);
+   if(res != FR_OK)
+      return fatfs_to_errno(res);
+
+   buf->f_bsize = fs->csize * FF_MIN_SS;
+   buf->f_blocks = fs->n_fatent - 2;
+   buf->f_bfree = nclst;
+   return 0;
+}
+
+// Whether a buffer is the sector window of a mounted filesystem. FatFS
+// reads and writes FAT and directory sectors through this window.
+bool fatfs_is_window(const void *buf)
+{
+   return buf == sdfs.win || buf == flashfs.win;
+}
+
 int fatfs_to_errno(FRESULT res) {
    switch(res) {
       case FR_OK:
@@ -112,7 +155,7 @@ bool sd_insert_mount()
   // if(*sd_slot & 2 == false) {
 #endif
       printk("SD card present\n");
-      FRESULT res = f_mount(&sdfs, "1", 1);
+      FRESULT res = f_mount(&sdfs, "1:", 1);
 
       if(res == FR_OK) {
          printk("Mounted SD card\n");
@@ -23,11 +23,19 @@
 */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <poll.h>
 
-#include "time.h"
 #include "cpu.h"
 #include "fd.h"
+#include "wait.h"
+#include "ktimer.h"
+
+static void
+poll_timeout(KTimer *t)
+{
+   *(bool *)t->arg = true;
+}
 
 // -------------------------------------------------------------------
 // Poll a list of file descriptors until at least one is ready or there
@@ -35,12 +43,10 @@
 int 
 SYS_poll(struct pollfd *fds, int nfds, int timeout)
 {
-   uint64_t current_time;
-   uint64_t end_time;
-   if(timeout) {
-      current_time = get_ms();
-      end_time = current_time + timeout;
-   }
+   bool timed_out = false;
+   KTimer timer;
+   ktimer_init(&timer, poll_timeout, &timed_out);
+   if(timeout) ktimer_start(&timer, timeout);
 
    int ready = 0;
 
@@ -50,6 +56,16 @@ SYS_poll(struct pollfd *fds, int nfds, int timeout)
          if(ptr->fd < 0) continue;
 
          ptr->revents = 0;
+
+         // drivers that can report more than POLLIN do it themselves
+         FD *fd_ent = get_fdentry(ptr->fd);
+         if(fd_ent && fd_ent->flags && fd_ent->fdfunc->fd_poll) {
+            ptr->revents = fd_ent->fdfunc->fd_poll(ptr->fd) &
+               (ptr->events | POLLERR | POLLHUP);
+            if(ptr->revents) ready++;
+            continue;
+         }
+
          ssize_t bytes = SYS_peek(ptr->fd);
 
          if(bytes < 0) {
@@ -62,9 +78,15 @@ SYS_poll(struct pollfd *fds, int nfds, int timeout)
          }
       }
 
-      if(ready) return ready;
+      if(ready) break;
+
+      // Sleep until something happens. The timeout signals WAIT_TIMER
+      // when it goes off, and the console (which has no interrupt)
+      // gets checked at least every KTIMER_WAKE ticks.
+      wait_event(WAIT_ECONET_RX | WAIT_ECONET_TX | WAIT_CONSOLE | WAIT_TIMER);
 
-   } while(timeout == 0 || get_ms() < end_time);
+   } while(!timed_out);
 
-   return 0;
+   ktimer_cancel(&timer);
+   return ready;
 }
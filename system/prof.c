@@ -0,0 +1,147 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+
+// prof.c: /dev/prof, the sampling profiler's histogram (see prof.h).
+// The timer tick (timer.s) counts the interrupted pc in prof_hist
+// while prof_state.running is set.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/clock.h>
+
+#include "fd.h"
+#include "sysdefs.h"
+#include "elfload.h"
+#include "prof.h"
+
+volatile ProfState prof_state;
+volatile uint16_t prof_hist[PROF_BUCKETS];
+
+static ssize_t prof_read(int fd, void *buf, size_t count);
+static int prof_ioctl(int fd, unsigned long request, void *ptr);
+static int prof_close(int fd);
+
+static FDfunction prof_func = {
+   .fd_read  = prof_read,
+   .fd_ioctl = prof_ioctl,
+   .fd_close = prof_close,
+};
+
+//------------------------------------------------------------------
+// Bytes of histogram in use
+static uint32_t
+prof_hist_size(void)
+{
+   if(prof_state.size == 0)
+      return 0;
+   return (((prof_state.size - 1) >> prof_state.shift) + 1) * sizeof(uint16_t);
+}
+
+// Clear the histogram and start sampling lo to hi, with buckets as
+// small as will fit.
+static int
+prof_start(uint32_t lo, uint32_t hi)
+{
+   if(hi <= lo)
+      return -EINVAL;
+
+   uint32_t shift = PROF_MIN_SHIFT;
+   while(((hi - lo - 1) >> shift) >= PROF_BUCKETS)
+      shift++;
+
+   prof_state.running = 0;
+   memset((void *)prof_hist, 0, sizeof(prof_hist));
+   prof_state.lo = lo;
+   prof_state.size = hi - lo;
+   prof_state.shift = shift;
+   prof_state.samples = 0;
+   prof_state.outside = 0;
+   prof_state.running = 1;
+   return 0;
+}
+
+//------------------------------------------------------------------
+// Device functions. The read position is kept in the fd's data.
+int
+prof_open(const char *devname, int flags, mode_t mode, FD *fd)
+{
+   fd->fdfunc = &prof_func;
+   fd->data = NULL;
+   return 0;
+}
+
+static ssize_t
+prof_read(int fd, void *buf, size_t count)
+{
+   FD *fdent = get_fdentry(fd);
+   uint32_t pos = (uintptr_t)fdent->data;
+   uint32_t size = prof_hist_size();
+
+   if(pos >= size)
+      return 0;
+   if(count > size - pos)
+      count = size - pos;
+
+   memcpy(buf, (uint8_t *)prof_hist + pos, count);
+   fdent->data = (void *)(uintptr_t)(pos + count);
+   return count;
+}
+
+static int
+prof_ioctl(int fd, unsigned long request, void *ptr)
+{
+   uint32_t req_id = request & 0xFF000000;
+   struct prof_range *range = ptr;
+   struct prof_status *st = ptr;
+
+   switch(req_id) {
+      case PROF_START:
+         if(range == NULL)
+            return prof_start(0, USER_SP);
+         return prof_start(range->lo, range->hi);
+      case PROF_STOP:
+         prof_state.running = 0;
+         return 0;
+      case PROF_GET_STATUS:
+         if(ptr == NULL) return -EFAULT;
+         st->running = prof_state.running;
+         st->lo = prof_state.lo;
+         st->shift = prof_state.shift;
+         st->buckets = prof_hist_size() / sizeof(uint16_t);
+         st->samples = prof_state.samples;
+         st->outside = prof_state.outside;
+         st->hz = CPU_CLOCK_HZ / TIMER_TICK;
+         return 0;
+   }
+   return -EINVAL;
+}
+
+static int
+prof_close(int fd)
+{
+   return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef PROF_H
+#define PROF_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Sampling profiler (sys/prof.h). timer.s takes the samples, so it
+// knows the layout of ProfState.
+
+#include <stdint.h>
+#include <sys/prof.h>
+
+#include "fd.h"
+
+#ifndef PROF_BUCKETS
+#define PROF_BUCKETS       1024     // 16 bit counts
+#endif
+#define PROF_MIN_SHIFT     2        // 4 byte buckets at the finest
+
+typedef struct {
+   uint32_t       running;          // 0
+   uint32_t       lo;               // 4
+   uint32_t       size;             // 8, bytes covered from lo
+   uint32_t       shift;            // 12
+   uint32_t       samples;          // 16
+   uint32_t       outside;          // 20
+} ProfState;
+
+extern volatile ProfState prof_state;
+extern volatile uint16_t prof_hist[PROF_BUCKETS];
+
+int prof_open(const char *devname, int flags, mode_t mode, FD *fd);
+
+#endif
@@ -24,13 +24,19 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #include "console.h"
+#include "devices.h"
 #include "fd.h"
 #include "raw_econet.h"
 #include "sysdefs.h"
+#include "wait.h"
 #include <sys/econet.h>
 
 #include "printk.h"
@@ -45,7 +51,15 @@ extern volatile uint32_t econet_tx_end;
 extern volatile uint32_t econet_tx_status;
 extern volatile uint32_t econet_timeout_state;
 extern volatile uint32_t econet_monitor_frames;
+extern volatile uint32_t econet_rx_queued;
+extern volatile uint32_t econet_rx_refused;
 extern volatile uint8_t econet_port_list[256];
+extern volatile struct econet_rxq econet_rx_queues[ECONET_RXQ_COUNT];
+extern volatile uint32_t econet_rx_held[ECONET_RXHOLD_COUNT];
+
+#if ECONET_RXQ_COUNT != MAX_FILE_DESCRIPTORS
+#error "econet receive queues must match the number of file descriptors"
+#endif
 
 // Hardware registers
 static volatile uint32_t *econet_state    = (uint32_t *)0x80011c;  // reg_status
@@ -58,8 +72,15 @@ static volatile uint32_t *timer_a_stat    = (uint32_t *)0x800308;
 static volatile uint32_t *econet_clkterm  = (uint32_t *)0x800320;
 
 uint8_t fd_rx_portmap[MAX_FILE_DESCRIPTORS];
+static uint8_t rx_held_fd[ECONET_RXHOLD_COUNT];   // fd holding each frame
 struct econet_addr fd_tx_destmap[MAX_FILE_DESCRIPTORS];
 
+// Result of the last write on each fd: 0, -EINPROGRESS while the
+// handshake is under way, or the error it failed with.
+static int fd_tx_result[MAX_FILE_DESCRIPTORS];
+static int tx_owner = -1;        // fd whose frame is being sent
+static int txbuf_owner = -1;     // fd composing a frame with ECONET_GET_TXBUF
+
 uint16_t econet_address;
 
 static FDfunction econet_func = {
@@ -69,7 +90,10 @@ static FDfunction econet_func = {
    .fd_fstat = NULL,
    .fd_ioctl = econet_ioctl,
    .fd_close = econet_close,
-   .fd_peek  = econet_peek
+   .fd_peek  = econet_peek,
+   .fd_poll  = econet_poll,
+   .fd_writev = econet_writev,
+   .fd_sendfile = econet_sendfile
 };
 
 static uint32_t *addr_set = (uint32_t *)0x800118;
@@ -82,6 +106,17 @@ static int econet_set_addr(uint16_t netstation);         // sets our net and sta
 static int econet_set_tx_addr(int fd, struct econet_addr *dest);
 static ssize_t econet_monitor(int fd, void *ptr, size_t count); 
 static int econet_set_clkterm(uint16_t flags); 
+static int econet_set_nonblock(int fd, bool nonblock);
+static void econet_tx_reap();
+static void econet_rxq_reset(int fd);
+static int econet_rx_wait(int fd);
+static bool econet_rx_consume(int fd, uint32_t entry, size_t count);
+static int econet_get_rxview(int fd, struct econet_rxview *view);
+static int econet_release_rx(int fd, int id);
+static int econet_tx_acquire(int fd);
+static ssize_t econet_tx_send(int fd, size_t count, bool wait_idle);
+static int econet_get_txbuf(int fd, uint8_t **bufp);
+static ssize_t econet_tx_commit(int fd, size_t count);
 
 static uint32_t *led = (uint32_t *)0x800000;
 
@@ -93,6 +128,7 @@ void econet_init() {
 
 int econet_open(const char *devname, int flags, mode_t mode, FD *fd) {
    fd->fdfunc = & econet_func;
+   fd_tx_result[fd->fd] = 0;
    return 0;
 }
 
@@ -113,6 +149,12 @@ int econet_ioctl(int fd, unsigned long request, void *ptr) {
          return 0;
       case ECONET_SET_CLKTERM:
          return econet_set_clkterm(request & 0xFFFF);
+      case ECONET_SET_NONBLOCK:
+         return econet_set_nonblock(fd, request & 0xFF);
+      case ECONET_RELEASE_RX:
+         return econet_release_rx(fd, request & 0xFF);
+      case ECONET_TX_COMMIT:
+         return econet_tx_commit(fd, request & 0xFFFF);
       case ECONET_GET_ADDR:
          {
             uint8_t *nsta = (uint8_t *)ptr;
@@ -125,6 +167,18 @@ int econet_ioctl(int fd, unsigned long request, void *ptr) {
             *clkt = *econet_clkterm;
             return 0;
          }
+      case ECONET_GET_TXSTATUS:
+         {
+            // an error is only reported once
+            econet_tx_reap();
+            int rc = fd_tx_result[fd];
+            if(rc != -EINPROGRESS) fd_tx_result[fd] = 0;
+            return rc;
+         }
+      case ECONET_GET_RXVIEW:
+         return econet_get_rxview(fd, ptr);
+      case ECONET_GET_TXBUF:
+         return econet_get_txbuf(fd, ptr);
 
       case ECONET_DBG_BUF:
          memcpy(ptr, (uint8_t *)&econet_state_val, sizeof(struct econet_state));
@@ -140,38 +194,153 @@ int econet_ioctl(int fd, unsigned long request, void *ptr) {
 ssize_t econet_read(int fd, void *ptr, size_t count) {
    if(*econet_mon) return econet_monitor(fd, ptr, count);
 
-   uint8_t port = fd_rx_portmap[fd];
-   if(!port)
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+   uint32_t entry;
+   size_t copy_sz;
+   do {
+      int rc = econet_rx_wait(fd);
+      if(rc < 0)
+         return rc;
+
+      entry = q->entry[q->head];
+      uint32_t start = entry & 0xFFFF;
+      size_t len = entry >> 16;
+      copy_sz = len > count ? count : len;
+
+      // the frame may wrap round the end of the ring
+      size_t part = ECONET_RXBUFSZ - start;
+      if(part > copy_sz) part = copy_sz;
+      memcpy(ptr, (uint8_t *)ECONET_RXBUF + start, part);
+      memcpy((uint8_t *)ptr + part, (uint8_t *)ECONET_RXBUF, copy_sz - part);
+
+      // if the frame was overwritten while being copied, try the next
+   } while(!econet_rx_consume(fd, entry, copy_sz));
+
+   return copy_sz;
+}
+
+// Wait for a frame to be queued for an fd
+static int econet_rx_wait(int fd) {
+   if(!fd_rx_portmap[fd])
       return -EINVAL;
 
-   // wait for a valid data frame
-   while(!(econet_port_list[port] & 0x80));
-   size_t copy_sz = econet_buf_len > count ? count : econet_buf_len;
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+   if(q->count == 0 && (get_fdentry(fd)->flags & O_NONBLOCK))
+      return -EAGAIN;
+   while(q->count == 0)
+      wait_event(WAIT_ECONET_RX);
+   return 0;
+}
 
-   // FIXME: define for buffer address
-   uint8_t *bufptr = ((uint8_t *)0x810000) + econet_buf_start;
-   memcpy(ptr, bufptr, copy_sz);
+// Use up bytes from the start of the fd's oldest frame, removing it
+// from the queue once it's all gone. The ISR drops frames that a new
+// one has overwritten, so this fails if entry is no longer the oldest.
+static bool econet_rx_consume(int fd, uint32_t entry, size_t count) {
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+   uint32_t start = entry & 0xFFFF;
+   size_t len = entry >> 16;
 
-   if(copy_sz < econet_buf_len) {
-      econet_buf_len -= copy_sz;
-      econet_buf_start += copy_sz;
+   // the ISR changes the queue, so update it with interrupts off
+   DISABLE_INTERRUPTS
+   if(q->count == 0 || q->entry[q->head] != entry) {
+      ENABLE_INTERRUPTS
+      return false;
+   }
+   econet_rx_queued -= count;
+   if(count < len) {
+      q->entry[q->head] = ((start + count) & ECONET_RXBUF_MASK) |
+         (len - count) << 16;
    }
    else {
+      q->head = q->head + 1 < ECONET_RXQ_DEPTH ? q->head + 1 : 0;
+      q->count--;
+
       // this resets 'valid data ready' flag
-      econet_port_list[port] = fd;
+      if(q->count == 0)
+         econet_port_list[fd_rx_portmap[fd]] = fd;
    }
+   ENABLE_INTERRUPTS
+   return true;
+}
 
-   return copy_sz;
+// Take the oldest frame off the fd's queue and describe it where it
+// is in the receive ring, rather than copying it out. It's held, so
+// its part of the ring isn't reused, until ECONET_RELEASE_RX; in the
+// meantime other readers of the fd get the frames after it.
+static int econet_get_rxview(int fd, struct econet_rxview *view) {
+   if(*econet_mon) return -EINVAL;
+
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+   int id;
+   while(1) {
+      int rc = econet_rx_wait(fd);
+      if(rc < 0)
+         return rc;
+
+      DISABLE_INTERRUPTS
+      for(id = 0; id < ECONET_RXHOLD_COUNT && econet_rx_held[id]; id++);
+      if(id == ECONET_RXHOLD_COUNT) {
+         ENABLE_INTERRUPTS
+         return -EBUSY;
+      }
+
+      // the ISR may have dropped the frame since the wait
+      if(q->count) break;
+      ENABLE_INTERRUPTS
+   }
+
+   uint32_t entry = q->entry[q->head];
+   econet_rx_held[id] = entry;
+   rx_held_fd[id] = fd;
+   q->head = q->head + 1 < ECONET_RXQ_DEPTH ? q->head + 1 : 0;
+   q->count--;
+   if(q->count == 0)
+      econet_port_list[fd_rx_portmap[fd]] = fd;
+   ENABLE_INTERRUPTS
+
+   uint32_t start = entry & 0xFFFF;
+   size_t len = entry >> 16;
+
+   view->id = id;
+   view->data = (uint8_t *)ECONET_RXBUF + start;
+   if(start + len > ECONET_RXBUFSZ) {
+      view->len = ECONET_RXBUFSZ - start;
+      view->wrap = (uint8_t *)ECONET_RXBUF;
+      view->wraplen = len - view->len;
+   }
+   else {
+      view->len = len;
+      view->wrap = NULL;
+      view->wraplen = 0;
+   }
+   return len;
+}
+
+// Give a held frame's part of the ring back. Fails with EIO if a new
+// frame ran over it while it was held.
+static int econet_release_rx(int fd, int id) {
+   if(id >= ECONET_RXHOLD_COUNT || rx_held_fd[id] != fd)
+      return -ENOENT;
+
+   DISABLE_INTERRUPTS
+   uint32_t entry = econet_rx_held[id];
+   econet_rx_held[id] = 0;
+   econet_rx_queued -= entry >> 16;
+   ENABLE_INTERRUPTS
+
+   if(entry == 0)
+      return -ENOENT;
+   return entry & ECONET_RXHOLD_OVERRUN ? -EIO : 0;
 }
 
 static ssize_t econet_monitor(int fd, void *ptr, size_t count) {
    // wait for a frame
-   while(econet_monitor_frames == last_monitor_frames);
+   while(econet_monitor_frames == last_monitor_frames)
+      wait_event(WAIT_ECONET_RX);
 
    size_t copy_sz = econet_buf_len > count ? count : econet_buf_len;
 
-   // FIXME: define for buffer address
-   uint8_t *bufptr = ((uint8_t *)0x810000) + econet_buf_start;
+   uint8_t *bufptr = (uint8_t *)ECONET_RXBUF + econet_buf_start;
    memcpy(ptr, bufptr, copy_sz);
 
    if(copy_sz < econet_buf_len) {
@@ -196,47 +365,174 @@ ssize_t econet_peek(int fd)
       return -EINVAL;
 
    // no data
-   if(!(econet_port_list[port] & 0x80)) return 0;
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+   if(q->count == 0) return 0;
 
-   return econet_buf_len; 
+   return q->entry[q->head] >> 16;
 }
 
-ssize_t econet_write(int fd, const void *ptr, size_t count) {
-   uint8_t *scout_buf = (uint8_t *)0x820000;
-   uint8_t *data_buf  = (uint8_t *)0x820008;
+// Readiness for poll: POLLIN when a frame is queued, POLLOUT when
+// this fd has no frame still being sent, POLLERR when its last write
+// failed and the error hasn't been collected with ECONET_GET_TXSTATUS.
+short econet_poll(int fd)
+{
+   short revents = 0;
+
+   if(econet_peek(fd) > 0)
+      revents |= POLLIN;
+
+   econet_tx_reap();
+   if(fd_tx_result[fd] != -EINPROGRESS)
+      revents |= POLLOUT;
+   if(fd_tx_result[fd] < 0 && fd_tx_result[fd] != -EINPROGRESS)
+      revents |= POLLERR;
 
+   return revents;
+}
+
+// If a frame was being sent and the handshake has finished, record
+// the result against the fd that sent it.
+static void econet_tx_reap() {
+   if(tx_owner < 0 || econet_handshake_state >= STATE_TXSCOUT)
+      return;
+
+   int rc = 0;
+   if(econet_tx_status != STATUS_TXDONE) {
+      // Not listening
+      if(econet_timeout_state == ECONET_STATE_TXSCOUT) 
+         rc = -EHOSTUNREACH;
+      else
+         // got scout ack but no data ack
+         rc = -ETIMEDOUT;
+   }
+
+   fd_tx_result[tx_owner] = rc;
+   tx_owner = -1;
+}
+
+// The transmit buffer holds the scout frame, then the data frame's
+// address header and payload. The receive ISR only uses the first 8
+// bytes (for acks) so the payload can be written while the line is busy.
+#define TX_SCOUT     ((uint8_t *)ECONET_TXBUF)
+#define TX_DATA      ((uint8_t *)ECONET_TXBUF + 8)
+#define TX_PAYLOAD   (TX_DATA + 4)
+
+ssize_t econet_write(int fd, const void *ptr, size_t count) {
    // Validate the size
-   if(count > ECONET_TXBUFSZ - 8) return -EMSGSIZE;
+   if(count > ECONET_MAX_PAYLOAD) return -EMSGSIZE;
 
-   // Reset transmit flags
-   econet_tx_status = 0;
-   econet_timeout_state = 0;
+   // Validate that there is a valid destination
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0)
+      return rc;
+
+   memcpy(TX_PAYLOAD, ptr, count);
+   return econet_tx_send(fd, count, false);
+}
+
+// Gather the buffers into one frame in the transmit buffer
+ssize_t econet_writev(int fd, const struct iovec *iov, int iovcnt) {
+   size_t count = 0;
+   for(int i = 0; i < iovcnt; i++)
+      count += iov[i].iov_len;
+   if(count > ECONET_MAX_PAYLOAD) return -EMSGSIZE;
+
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0)
+      return rc;
+
+   uint8_t *ptr = TX_PAYLOAD;
+   for(int i = 0; i < iovcnt; i++) {
+      memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+      ptr += iov[i].iov_len;
+   }
+   return econet_tx_send(fd, count, false);
+}
 
+// Read up to a frame's worth from in_fd straight into the transmit
+// buffer and send it. Like a short write, it's one frame per call.
+ssize_t econet_sendfile(int fd, int in_fd, off_t *offset, size_t count) {
+   if(count > ECONET_MAX_PAYLOAD) count = ECONET_MAX_PAYLOAD;
+   if(count == 0) return 0;
+
+   struct econet_addr *dest = &fd_tx_destmap[fd];
+   if(dest->station == 0) return -EDESTADDRREQ;
+
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0)
+      return rc;
+
+   // hold the buffer while the data is read into it
+   txbuf_owner = fd;
+   ssize_t got;
+   if(offset != NULL)
+      got = SYS_pread(in_fd, TX_PAYLOAD, count, *offset);
+   else
+      got = SYS_read(in_fd, TX_PAYLOAD, count);
+   if(got <= 0) {
+      txbuf_owner = -1;
+      return got;
+   }
+
+   // in_fd may have moved on, so this can't give up with -EAGAIN
+   ssize_t sent = econet_tx_send(fd, got, true);
+   if(sent > 0 && offset != NULL)
+      *offset += sent;
+   return sent;
+}
+
+// Wait until the transmit buffer is free: no frame is being sent from
+// it, and no other fd is composing one in it.
+static int econet_tx_acquire(int fd) {
+   if(txbuf_owner >= 0 && txbuf_owner != fd)
+      return -EBUSY;
+
+   bool nonblock = get_fdentry(fd)->flags & O_NONBLOCK;
+   if(nonblock && econet_handshake_state >= STATE_TXSCOUT)
+      return -EAGAIN;
+   while(econet_handshake_state >= STATE_TXSCOUT)
+      wait_event(WAIT_ECONET_TX);
+   return 0;
+}
+
+// Send the count bytes of payload in the transmit buffer. With
+// wait_idle, a non-blocking fd still waits for the line to go idle
+// rather than returning -EAGAIN.
+static ssize_t econet_tx_send(int fd, size_t count, bool wait_idle) {
    // This is not a turnaround (reply)
    *tx_flags = 0;
 
-   // Validate that there is a valid destination
    struct econet_addr *dest = &fd_tx_destmap[fd];
-   if(dest->station == 0) return -EDESTADDRREQ;
+   bool nonblock = get_fdentry(fd)->flags & O_NONBLOCK;
 
    // wait until idle:
    // check receiving and frame_valid flags (the latter is reset only once the ISR
    // has acknowledged a frame), and that handshake state is idle
    *led = 0;
+   if(nonblock && !wait_idle && (*econet_state & 3 || econet_handshake_state > STATE_WAITSCOUT))
+      return -EAGAIN;
    while(*econet_state & 3 || econet_handshake_state > STATE_WAITSCOUT);
    DISABLE_INTERRUPTS
 
+   // any previous frame has now finished
+   econet_tx_reap();
+
    // Create the address word
    uint32_t addr = dest->station | dest->net << 8 | econet_address << 16;
 
    // Set up the scout frame
-   *((uint32_t *)scout_buf) = addr;
-   *(scout_buf + 4) = 0x80;            // scout flag
-   *(scout_buf + 5) = dest->port;
+   *((uint32_t *)TX_SCOUT) = addr;
+   *(TX_SCOUT + 4) = 0x80;             // scout flag
+   *(TX_SCOUT + 5) = dest->port;
 
-   // Set up the data frame
-   *((uint32_t *)data_buf)  = addr;
-   memcpy(data_buf + 4, ptr, count);
+   // Set up the data frame's header, the payload is already there
+   *((uint32_t *)TX_DATA)  = addr;
    econet_tx_start = 8;          // start offset in transmit buffer for data frame
    econet_tx_end   = 11 + count; // index of last byte of transmit buffer for data frame
 
@@ -244,6 +540,13 @@ ssize_t econet_write(int fd, const void *ptr, size_t count) {
    *timer_a_val = TIMER_HUNDRED_MS;
    *timer_a_stat = TIMER_ENABLE|TIMER_RESET;
 
+   // Reset transmit flags
+   econet_tx_status = 0;
+   econet_timeout_state = 0;
+   tx_owner = fd;
+   txbuf_owner = -1;
+   fd_tx_result[fd] = -EINPROGRESS;
+
    // Transmit the scout frame. The ISR will handle the handshaking.
    // Setting the end offset will trigger the transmission of the scout frame.
    econet_handshake_state = STATE_TXSCOUT;
@@ -251,32 +554,72 @@ ssize_t econet_write(int fd, const void *ptr, size_t count) {
    *tx_end_offset   = 5;      // index of last byte of scout frame
    ENABLE_INTERRUPTS
 
-   // TODO: nonblocking writes
-   while(econet_handshake_state >= STATE_TXSCOUT);
+   // The frame is in the transmit buffer, so in non blocking mode
+   // the caller can carry on and collect the result with poll or
+   // ECONET_GET_TXSTATUS.
+   if(nonblock)
+      return count;
 
-   if(econet_tx_status != STATUS_TXDONE) {
-      // Not listening
-      if(econet_timeout_state == ECONET_STATE_TXSCOUT) 
-         return -EHOSTUNREACH;
+   while(econet_handshake_state >= STATE_TXSCOUT)
+      wait_event(WAIT_ECONET_TX);
+   econet_tx_reap();
 
-      // got scout ack but no data ack
-      return -ETIMEDOUT;
-   }
+   int rc = fd_tx_result[fd];
+   fd_tx_result[fd] = 0;
+   if(rc < 0)
+      return rc;
 
    return count;
 }
 
+// Give the caller the transmit buffer's payload area to build a frame
+// in, rather than having write copy it there. The buffer is the fd's
+// until ECONET_TX_COMMIT.
+static int econet_get_txbuf(int fd, uint8_t **bufp) {
+   int rc = econet_tx_acquire(fd);
+   if(rc < 0)
+      return rc;
+
+   txbuf_owner = fd;
+   *bufp = TX_PAYLOAD;
+   return ECONET_MAX_PAYLOAD;
+}
+
+// Send the frame built in the transmit buffer. A length of 0 gives
+// the buffer up without sending anything.
+static ssize_t econet_tx_commit(int fd, size_t count) {
+   if(txbuf_owner != fd)
+      return -EINVAL;
+
+   if(count == 0 || count > ECONET_MAX_PAYLOAD || fd_tx_destmap[fd].station == 0) {
+      txbuf_owner = -1;
+      if(count == 0) return 0;
+      return count > ECONET_MAX_PAYLOAD ? -EMSGSIZE : -EDESTADDRREQ;
+   }
+
+   return econet_tx_send(fd, count, false);
+}
+
 int econet_close(int fd) {
+   if(txbuf_owner == fd)
+      txbuf_owner = -1;
+
    uint8_t port = fd_rx_portmap[fd];
    if(port) {
       econet_port_list[port] = 0;
       fd_rx_portmap[fd] = 0;
    }
+   econet_rxq_reset(fd);
    return 0;
 }
 
 static int econet_set_rx_port(int fd, uint8_t port) {
    // TODO: error handling
+   uint8_t old_port = fd_rx_portmap[fd];
+   if(old_port)
+      econet_port_list[old_port] = 0;
+
+   econet_rxq_reset(fd);
    fd_rx_portmap[fd] = port;
 
    // indicates to the ISR that the port is being listened
@@ -284,6 +627,36 @@ static int econet_set_rx_port(int fd, uint8_t port) {
    return 0;
 }
 
+static int econet_set_nonblock(int fd, bool nonblock) {
+   FD *fd_ent = get_fdentry(fd);
+   if(nonblock)
+      fd_ent->flags |= O_NONBLOCK;
+   else
+      fd_ent->flags &= ~O_NONBLOCK;
+   return 0;
+}
+
+// Discard any frames queued for an fd
+static void econet_rxq_reset(int fd) {
+   volatile struct econet_rxq *q = &econet_rx_queues[fd];
+
+   DISABLE_INTERRUPTS
+   while(q->count) {
+      econet_rx_queued -= q->entry[q->head] >> 16;
+      q->head = q->head + 1 < ECONET_RXQ_DEPTH ? q->head + 1 : 0;
+      q->count--;
+   }
+   q->head = 0;
+
+   for(int id = 0; id < ECONET_RXHOLD_COUNT; id++) {
+      if(econet_rx_held[id] && rx_held_fd[id] == fd) {
+         econet_rx_queued -= econet_rx_held[id] >> 16;
+         econet_rx_held[id] = 0;
+      }
+   }
+   ENABLE_INTERRUPTS
+}
+
 static int econet_set_tx_addr(int fd, struct econet_addr *dest) {
    fd_tx_destmap[fd].port = dest->port;
    fd_tx_destmap[fd].net = dest->net;
@@ -24,12 +24,35 @@
 ;THE SOFTWARE.
 */
 
+#ifndef ASM
 #include <stdlib.h>
 #include <stdint.h>
+#endif
 
 #define ECONET_TXBUFSZ     2048
 #define ECONET_RXBUFSZ     2048
 
+// Receive queues. Each fd has a queue of frames that have been acked
+// but not yet read, described by their position in the hardware
+// receive ring. The ring is shared with all other traffic so frames
+// can't be left in it indefinitely: scouts are refused (not acked)
+// when an fd's queue is full, or when something is queued and there
+// are fewer than ECONET_RXQ_RESERVE bytes of the ring free before the
+// oldest queued frame, and the sender will retry later. A data frame
+// bigger than that can still run over queued frames, and those are
+// dropped from their queues.
+#define ECONET_RXQ_COUNT     16          // one per file descriptor
+#define ECONET_RXQ_DEPTH     6           // frames per fd
+#define ECONET_RXQ_SHIFT     5           // log2 of sizeof(struct econet_rxq)
+#define ECONET_RXQ_RESERVE   1024        // ring kept free for the next frame
+#define ECONET_RXBUF_MASK    0x7ff
+
+// Frames given out in place by ECONET_GET_RXVIEW are taken off their
+// queue and held until they're released. They still take up the ring,
+// and a data frame that runs over one flags it rather than dropping it.
+#define ECONET_RXHOLD_COUNT   8
+#define ECONET_RXHOLD_OVERRUN 0x8000     // flag in a held entry
+
 // Hardware driver states
 #define STATE_WAITSCOUT    0           // idle
 #define STATE_WAITDATA     1           // waiting for data frame to us
@@ -40,6 +63,13 @@
 #define STATUS_TXDONE      1           // Successful transmission
 #define STATUS_TXNETERR    2           // Generic failure of transmission
 
+#ifndef ASM
+struct econet_rxq {
+   uint32_t       head;                      // index of the oldest frame
+   uint32_t       count;                     // number of frames queued
+   uint32_t       entry[ECONET_RXQ_DEPTH];   // length << 16 | start offset
+};
+
 void econet_init();
 int econet_open(const char *devname, int flags, mode_t mode, FD *fd);
 
@@ -47,8 +77,12 @@ int econet_open(const char *devname, int flags, mode_t mode, FD *fd);
 int econet_ioctl(int fd, unsigned long request, void *ptr);
 ssize_t econet_read(int fd, void *ptr, size_t count);
 ssize_t econet_peek(int fd);
+short econet_poll(int fd);
 ssize_t econet_write(int fd, const void *ptr, size_t count);
+ssize_t econet_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t econet_sendfile(int fd, int in_fd, off_t *offset, size_t count);
 int econet_close(int fd);
+#endif
 
 #endif
 
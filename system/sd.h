@@ -46,13 +46,17 @@ typedef struct _sd_r37 {
 #define CMD0SEQ   { CMD0, { 0x00, 0x00, 0x00, 0x00 }, 0x95 }
 #define CMD8      0x48     // SEND_IF_COND send interface condition
 #define CMD8SEQ   { CMD8, { 0x00, 0x00, 0x01, 0xAA }, 0x87 }
+#define CMD12     0x4C     // STOP_TRANSMISSION
 #define CMD17     0x51     // READ_SINGLE_BLOCK
+#define CMD18     0x52     // READ_MULTIPLE_BLOCK
 #define CMD24     0x58     // WRITE_SINGLE_BLOCK
+#define CMD25     0x59     // WRITE_MULTIPLE_BLOCK
 #define CMD55     0x77     // Next command is an ACMD
 #define CMD55SEQ  { CMD55, {0x00, 0x00, 0x00, 0x00 }, 0x00 }
 #define CMD58     0x7A     // READ_OCR, read operations condition register
 #define CMD58SEQ  { CMD58, { 0x00, 0x00, 0x00, 0x00 }, 0x00 }
 
+#define ACMD23    0x57     // SET_WR_BLK_ERASE_COUNT, pre-erase before a multiple block write
 #define ACMD41    0x69     // SD_SEND_OP_COND, send operating condition
 #define ACMD41SEQ { ACMD41, { 0x40, 0x00, 0x00, 0x00 }, 0x00 }
 #define ACMD41V1SEQ { ACMD41, { 0x00, 0x00, 0x00, 0x00 }, 0x00 }
@@ -60,6 +64,8 @@ typedef struct _sd_r37 {
 // SD defines
 #define SD_READY 0x00
 #define SD_START_TOKEN 0xFE
+#define SD_START_MULTI_TOKEN 0xFC
+#define SD_STOP_TRAN_TOKEN 0xFD
 #define SD_ERROR_TOKEN 0x00
 #define SD_DATA_ACCEPTED 0x05
 #define SD_DATA_REJECTED_CRC 0x08
@@ -83,6 +89,12 @@ uint8_t sd_readsingleblk(uint32_t addr, uint8_t *buf, uint8_t *token);
 // Write a single 512 byte block
 uint8_t sd_writesingleblk(uint32_t addr, const uint8_t *buf, uint8_t *token); 
 
+// Read count consecutive 512 byte blocks
+uint8_t sd_readmultiblk(uint32_t addr, uint8_t *buf, uint32_t count, uint8_t *token);
+
+// Write count consecutive 512 byte blocks
+uint8_t sd_writemultiblk(uint32_t addr, const uint8_t *buf, uint32_t count, uint8_t *token);
+
 // Deassert SD slave select
 void  sd_done();
 
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <stdbool.h>
 
 #include "spi.h"
 #include "devices.h"
@@ -35,6 +36,8 @@
 
 static uint8_t sd_readres1(void); 
 static void sd_readres37(SD_R37 *res); 
+static uint8_t sd_readtoken(void);
+static bool sd_waitbusy(void);
 
 //----------------------------------------------------------
 // Initialize the SD card.
@@ -121,6 +124,28 @@ static void sd_readres37(SD_R37 *res) {
    res->r7data[3] = spi_byte(0xFF);
 }
 
+// Wait for a start block token (or error token) from the card
+static uint8_t sd_readtoken() {
+   uint8_t read;
+   uint16_t readAttempts = 0;
+
+   while(++readAttempts != 65535)
+      if((read = spi_byte(0xFF)) != 0xFF) break;
+
+   return read;
+}
+
+// Wait for the card to stop signalling busy after a write
+static bool sd_waitbusy() {
+   uint16_t readAttempts = 0;
+
+   while(spi_byte(0xFF) == 0x00) {
+      if(++readAttempts == 65535)
+         return false;
+   }
+   return true;
+}
+
 static SDCmd rsb={ CMD17, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
 
 //---------------------------------------------------------------------
@@ -158,6 +183,53 @@ uint8_t sd_readsingleblk(uint32_t addr, uint8_t *buf, uint8_t *token) {
    return rx;
 }
 
+//---------------------------------------------------------------------
+// Read consecutive 512 byte blocks with a single READ_MULTIPLE_BLOCK
+// command, so the command and R1 overhead is only paid once.
+static SDCmd rmb={ CMD18, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
+static SDCmd stop={ CMD12, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
+
+uint8_t sd_readmultiblk(uint32_t addr, uint8_t *buf, uint32_t count, uint8_t *token) {
+   uint8_t rx, read = 0xFF;
+
+   spi_set_slave(SD_SLAVE_ID);
+
+   *token=0xFF;
+   rmb.arg[0] = (uint8_t)(addr >> 24);
+   rmb.arg[1] = (uint8_t)(addr >> 16);
+   rmb.arg[2] = (uint8_t)(addr >> 8);
+   rmb.arg[3] = (uint8_t)addr;
+
+   spi_write(&rmb, sizeof(rmb), false);
+
+   rx = sd_readres1();
+   if(rx != SD_READY) return rx;
+
+   while(count) {
+      read = sd_readtoken();
+      if(read != SD_START_TOKEN) break;
+
+      spi_read(buf, 512, false, 0xFFFFFFFF);
+
+      // CRC bytes
+      spi_byte(0xFF);
+      spi_byte(0xFF);
+
+      buf += 512;
+      count--;
+   }
+   *token = read;
+
+   // Stop the transfer. The byte after the command is a stuff byte,
+   // then R1 and busy while the card finishes up.
+   spi_write(&stop, sizeof(stop), false);
+   spi_byte(0xFF);
+   sd_readres1();
+   sd_waitbusy();
+
+   return rx;
+}
+
 //----------------------------------------------------------------------------
 // Write a 512 byte block
 static SDCmd wsb={ CMD24, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
@@ -205,3 +277,69 @@ uint8_t sd_writesingleblk(uint32_t addr, const uint8_t *buf, uint8_t *token) {
    return rx;
 }
 
+
+//----------------------------------------------------------------------------
+// Write consecutive 512 byte blocks with a single WRITE_MULTIPLE_BLOCK
+// command. The card is told how many blocks are coming first so it can
+// erase them in advance.
+static SDCmd acmd={ CMD55, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
+static SDCmd wbe={ ACMD23, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
+static SDCmd wmb={ CMD25, { 0x00, 0x00, 0x00, 0x00 }, 0x00 };
+
+uint8_t sd_writemultiblk(uint32_t addr, const uint8_t *buf, uint32_t count, uint8_t *token) {
+   uint8_t read = 0xFF, rx;
+   uint16_t readAttempts;
+
+   spi_set_slave(SD_SLAVE_ID);
+
+   *token=0;
+
+   // pre-erase is only a hint, so the result doesn't matter much
+   wbe.arg[1] = (uint8_t)(count >> 16);
+   wbe.arg[2] = (uint8_t)(count >> 8);
+   wbe.arg[3] = (uint8_t)count;
+   spi_write(&acmd, sizeof(acmd), false);
+   sd_readres1();
+   spi_write(&wbe, sizeof(wbe), false);
+   sd_readres1();
+
+   wmb.arg[0] = (uint8_t)(addr >> 24);
+   wmb.arg[1] = (uint8_t)(addr >> 16);
+   wmb.arg[2] = (uint8_t)(addr >> 8);
+   wmb.arg[3] = (uint8_t)addr;
+
+   spi_write(&wmb, sizeof(wmb), false);
+   rx = sd_readres1();
+   if(rx != SD_READY) return rx;
+
+   while(count) {
+      spi_byte(SD_START_MULTI_TOKEN);
+      spi_write(buf, 512, false);
+
+      for(readAttempts = 0; readAttempts < 65535; readAttempts++) {
+         read = spi_byte(0xFF);
+         if(read != 0xFF) {
+            break;
+         }
+      }
+
+      *token = read & 0x1F;
+      if(*token != SD_DATA_ACCEPTED) break;
+
+      if(!sd_waitbusy()) {
+         *token=0;
+         break;
+      }
+
+      buf += 512;
+      count--;
+   }
+
+   // The stop token must be sent even if a block was rejected
+   spi_byte(SD_STOP_TRAN_TOKEN);
+   spi_byte(0xFF);
+   if(!sd_waitbusy())
+      *token=0;
+
+   return rx;
+}
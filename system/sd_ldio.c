@@ -69,6 +69,15 @@ DRESULT sd_read(BYTE *buf, LBA_t sector, UINT count) {
    UINT i;
    LBA_t phys=sector + lba_offset;
 
+   // several sectors: stream them with one command
+   if(count > 1) {
+      rx = sd_readmultiblk(phys, buf, count, &token);
+      if(token != 0xFE || rx > 1)
+         return RES_ERROR;
+
+      return RES_OK;
+   }
+
    for(i = 0; i < count; i++) {
       rx = sd_readsingleblk(phys, buf, &token);
       if(token != 0xFE || rx > 1)
@@ -88,6 +97,14 @@ DRESULT sd_write(const BYTE *buf, LBA_t sector, UINT count) {
    UINT i;
    LBA_t phys=sector + lba_offset;
 
+   if(count > 1) {
+      rx = sd_writemultiblk(phys, buf, count, &token);
+      if(token != 0x05 || rx != 0)
+         return RES_ERROR;
+
+      return RES_OK;
+   }
+
    for(i = 0; i < count; i++) {
       rx = sd_writesingleblk(phys, buf, &token);
       if(token != 0x05 || rx != 0)
@@ -95,6 +112,8 @@ DRESULT sd_write(const BYTE *buf, LBA_t sector, UINT count) {
       buf += 512;
       phys++;
    }
+
+   return RES_OK;
 }
 
 // FatFS support
@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/spiflash.h>
 
 #include "printk.h"
 #include "spi_flashdev.h"
@@ -37,6 +38,7 @@
 #include "sysdefs.h"
 #include "kmalloc.h"
 #include "devices.h"
+#include "trace.h"
 
 // #define DEBUG_FLASHWRITE
 #define MAX_FLASH_FDS   4
@@ -46,7 +48,10 @@ static FDfunction spiflash_func = {
    .fd_write   = spiflash_write,
    .fd_lseek   = spiflash_lseek,
    .fd_fstat   = spiflash_fstat,
-   .fd_close   = spiflash_close
+   .fd_close   = spiflash_close,
+   .fd_ioctl   = spiflash_ioctl,
+   .fd_pread   = spiflash_pread,
+   .fd_pwrite  = spiflash_pwrite
 };
 
 typedef struct  open_fd {
@@ -65,9 +70,19 @@ static OpenFD *get_fd(int fd);
 #define WRITE_FILEPTR_OFFSET_MASK   0x00000FFF
 #define WRITE_ERASE_SEC_SHIFT       12
 
-static uint8_t    *writebuf = NULL;
-static uint32_t   write_blk_offset = 0;
-static uint32_t   write_blk_end = 0;
+// Erase blocks being written are kept in RAM until they are evicted,
+// synced or the last fd is closed, so writes to the same block (such
+// as repeated FAT updates) are coalesced.
+#define WRITE_BUFFERS               2
+
+typedef struct {
+   uint8_t     *data;         // NULL if the buffer isn't in use
+   uint32_t    offset;        // flash address of the erase block
+   uint32_t    last_used;
+} WriteBuf;
+
+static WriteBuf   writebufs[WRITE_BUFFERS];
+static uint32_t   write_clock;
 
 volatile uint8_t  *spi_reg_ss       = (uint8_t *)(DEV_BASE + OFFS_SPI_REG_SS);
 volatile uint8_t  *spi_reg_active   = (uint8_t *)(DEV_BASE + OFFS_SPI_REG_ACTIVE);
@@ -76,10 +91,15 @@ volatile uint8_t  *spi_reg_active   = (uint8_t *)(DEV_BASE + OFFS_SPI_REG_ACTIVE
 #define FLASH_CMD_SE          0x20     // 4k sector erase
 #define FLASH_CMD_PP          0x02     // page program
 #define FLASH_CMD_RDSR        0x05     // read status register
+#define FLASH_PAGE_SIZE       256
+#define FLASH_PAGES_PER_SEC   (WRITE_SECTOR_SIZE / FLASH_PAGE_SIZE)
+
+static struct spiflash_stats stats;
+static uint8_t page_buf[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
 
 static ssize_t spiflash_write_to_sector(OpenFD *fdinfo, const uint8_t *buf, size_t count);
-static ssize_t spiflash_load_sector(OpenFD *fdinfo);
-static void spiflash_writebuffer(void);
+static WriteBuf *spiflash_load_sector(uint32_t offset);
+static void spiflash_writebuffer(WriteBuf *wb);
 
 //------------------------------------------------------------------------
 // Initialise
@@ -129,12 +149,24 @@ int spiflash_open(const char *devname, int flags, mode_t mode, FD *fd) {
 ssize_t spiflash_read(int fd, void *buf, size_t count) {
    OpenFD *fdinfo = get_fd(fd);
    if(!fdinfo) return -EIO;
-   if(writebuf != NULL) spiflash_writebuffer();
 
 #ifdef DEBUG_FLASHWRITE
    printk("reading %d bytes at %x\n", count, fdinfo->fileptr);
 #endif
    flash_memcpy(fdinfo->fileptr, buf, count);
+
+   // anything not yet written out overrides what's on the chip
+   uint32_t start = fdinfo->fileptr;
+   uint32_t end = start + count;
+   for(int i = 0; i < WRITE_BUFFERS; i++) {
+      WriteBuf *wb = &writebufs[i];
+      if(wb->data == NULL) continue;
+      uint32_t from = (wb->offset > start) ? wb->offset : start;
+      uint32_t to = (wb->offset + WRITE_SECTOR_SIZE < end) ?
+         wb->offset + WRITE_SECTOR_SIZE : end;
+      if(from < to)
+         memcpy((uint8_t *)buf + (from - start), wb->data + (from - wb->offset), to - from);
+   }
    fdinfo->fileptr += count;
    return count;
 }
@@ -142,7 +174,7 @@ ssize_t spiflash_read(int fd, void *buf, size_t count) {
 //------------------------------------------------------------------------
 // Write
 // The erase sector size is 4k so writes get buffered and written out
-// when this buffer is filled.
+// when a buffer is needed for another block, on sync or on close.
 ssize_t spiflash_write(int fd, const void *buf, size_t count) {
    OpenFD *fdinfo = get_fd(fd);
    if(!fdinfo) return -EIO;
@@ -167,82 +199,112 @@ ssize_t spiflash_write(int fd, const void *buf, size_t count) {
 }
 
 static ssize_t spiflash_write_to_sector(OpenFD *fdinfo, const uint8_t *buf, size_t count) {
-   uint32_t end_addr = count + fdinfo->fileptr;
+   uint32_t blk_offset = fdinfo->fileptr & WRITE_OFFSET_MASK;
+   uint32_t fileptr_in_blk = fdinfo->fileptr & WRITE_FILEPTR_OFFSET_MASK;
 
-   if(writebuf == NULL) {
-#ifdef DEBUG_FLASHWRITE
-      printk("load new sector\n");
-#endif
-      int rc = spiflash_load_sector(fdinfo);
-      if(rc < 0) return rc;
+   WriteBuf *wb = NULL;
+   for(int i = 0; i < WRITE_BUFFERS; i++) {
+      if(writebufs[i].data && writebufs[i].offset == blk_offset) {
+         wb = &writebufs[i];
+         break;
+      }
    }
-   else if(end_addr > write_blk_end || fdinfo->fileptr < write_blk_offset) {
+   if(wb == NULL) {
 #ifdef DEBUG_FLASHWRITE
-      printk("flush prev sector and load new sector, fileptr = %x end_addr = %x, count = %x\n",
-            fileptr, end_addr, count);
+      printk("load new sector\n");
 #endif
-      spiflash_writebuffer();
-      int rc = spiflash_load_sector(fdinfo);
-      if(rc < 0) return rc;
+      wb = spiflash_load_sector(blk_offset);
+      if(wb == NULL) return -ENOMEM;
    }
 
-   uint32_t fileptr_in_blk = fdinfo->fileptr & WRITE_FILEPTR_OFFSET_MASK;
-   if(end_addr > write_blk_end) {
+   if(fileptr_in_blk + count > WRITE_SECTOR_SIZE) {
 #ifdef DEBUG_FLASHWRITE
       printk("reducing count from %d ", count);
 #endif
-      count = write_blk_end - fdinfo->fileptr;
+      count = WRITE_SECTOR_SIZE - fileptr_in_blk;
 #ifdef DEBUG_FLASHWRITE
-      printk("to %d: write_blk_end = %x fileptr = %x\n",
-            count, write_blk_end, fdinfo->fileptr);
+      printk("to %d: blk_offset = %x fileptr = %x\n",
+            count, blk_offset, fdinfo->fileptr);
 #endif
    }
 
-   uint8_t *bufptr = writebuf + fileptr_in_blk;
-   memcpy(bufptr, buf, count);
-
-   // if the block end was hit, write it out
-   if(end_addr >= write_blk_end) {
-      spiflash_writebuffer();
-   }
-
+   memcpy(wb->data + fileptr_in_blk, buf, count);
+   wb->last_used = ++write_clock;
    return count;
 }
 
-static ssize_t spiflash_load_sector(OpenFD *fdinfo)
+//-------------------------------------------------------------------------
+// Get a buffer for an erase block and fill it with what's currently on
+// the chip. An unused buffer is taken if there is one and there's the
+// memory for it, otherwise the least recently used one is written out
+// and reused.
+static WriteBuf *spiflash_load_sector(uint32_t offset)
 {
-   writebuf = kmalloc(WRITE_SECTOR_SIZE);
-   if(writebuf == NULL) return -ENOMEM;
+   WriteBuf *wb = NULL;
+   WriteBuf *lru = NULL;
+
+   for(int i = 0; i < WRITE_BUFFERS; i++) {
+      WriteBuf *candidate = &writebufs[i];
+      if(candidate->data == NULL) {
+         candidate->data = kmalloc(WRITE_SECTOR_SIZE);
+         if(candidate->data) {
+            wb = candidate;
+            break;
+         }
+      }
+      else if(lru == NULL || candidate->last_used < lru->last_used) {
+         lru = candidate;
+      }
+   }
 
-   // calculate the start byte of the erase sector
-   write_blk_offset = fdinfo->fileptr & WRITE_OFFSET_MASK;
-   write_blk_end = write_blk_offset + WRITE_SECTOR_SIZE;
+   if(wb == NULL) {
+      if(lru == NULL) return NULL;
+      spiflash_writebuffer(lru);
+      wb = lru;
+   }
 
    // get what's currently in the erase sector block
-   flash_memcpy(write_blk_offset, writebuf, WRITE_SECTOR_SIZE);
+   wb->offset = offset;
+   flash_memcpy(offset, wb->data, WRITE_SECTOR_SIZE);
 #ifdef DEBUG_FLASHWRITE
-   printk("Loaded flash sector at %x\n", write_blk_offset);
+   printk("Loaded flash sector at %x\n", offset);
 #endif
-   return 0;
+   return wb;
 }
 
 //-------------------------------------------------------------------------
-// Flush write buffer (without any other operations)
+// Write out and release all the write buffers
 void spiflash_sync(void)
 {
-   if(writebuf) spiflash_writebuffer();
+   for(int i = 0; i < WRITE_BUFFERS; i++) {
+      WriteBuf *wb = &writebufs[i];
+      if(wb->data) {
+         spiflash_writebuffer(wb);
+         kfree(wb->data);
+         wb->data = NULL;
+      }
+   }
 }
 
 //-------------------------------------------------------------------------
-// write a 4k erase block's worth of data
-static void spiflash_writebuffer(void)
+// Wait for an erase or program to complete
+static void spiflash_wait_ready(void)
 {
-#ifdef DEBUG_FLASHWRITE
-   printk("Writing out to flash at %x\n", write_blk_offset);
-#endif
-   uint8_t *pageptr = writebuf;
    uint8_t status;
 
+   flash_byte(FLASH_CMD_RDSR);
+   do {
+      status = flash_byte(0xFF);
+   } while(status & 1);
+   *spi_reg_active = 0;
+}
+
+//-------------------------------------------------------------------------
+// Erase the 4k sector containing addr
+void spiflash_erase_sector(uint32_t addr)
+{
+   trace_event(TRACE_FLASH_ERASE, addr, 0);
+
    // set SPI slave select to flash
    *spi_reg_ss = SPI_SS;
 
@@ -252,48 +314,124 @@ static void spiflash_writebuffer(void)
 
    // Sector erase
    flash_byte(FLASH_CMD_SE);
-   flash_byte((uint8_t)(write_blk_offset >> 16));
-   flash_byte((uint8_t)(write_blk_offset >> 8));
-   flash_byte((uint8_t)(write_blk_offset));
+   flash_byte((uint8_t)(addr >> 16));
+   flash_byte((uint8_t)(addr >> 8));
+   flash_byte((uint8_t)(addr));
    *spi_reg_active = 0;    // SS high completes erase
 
-   // wait for erase sector
-   flash_byte(FLASH_CMD_RDSR);
-   do {
-      status = flash_byte(0xFF);
-   } while(status & 1);
-   *spi_reg_active = 0;
+   spiflash_wait_ready();
+   stats.erases++;
+   trace_event(TRACE_FLASH_ERASE_END, addr, 0);
+}
+
+//-------------------------------------------------------------------------
+// Program already erased flash. Programming can only clear bits.
+// The data is split at 256 byte page boundaries as the chip wraps
+// around within a page.
+void spiflash_program(uint32_t addr, const uint8_t *buf, size_t count)
+{
+   trace_event(TRACE_FLASH_PROGRAM, addr, count);
+
+   *spi_reg_ss = SPI_SS;
+
+   while(count) {
+      size_t chunk = FLASH_PAGE_SIZE - (addr & (FLASH_PAGE_SIZE - 1));
+      if(chunk > count) chunk = count;
 
-   // Write 16 x 4k blocks
-   for(int i = 0; i < 16; i++) {
       flash_byte(FLASH_CMD_WREN);
       *spi_reg_active = 0;
       flash_byte(FLASH_CMD_PP);
-      flash_byte((uint8_t)(write_blk_offset >> 16));
-      flash_byte((uint8_t)(write_blk_offset >> 8));
-      flash_byte((uint8_t)(write_blk_offset));
+      flash_byte((uint8_t)(addr >> 16));
+      flash_byte((uint8_t)(addr >> 8));
+      flash_byte((uint8_t)(addr));
 
-      for(int j = 0; j < 256; j++) {
-         flash_byte(*pageptr++);
+      for(size_t i = 0; i < chunk; i++) {
+         flash_byte(*buf++);
       }
       *spi_reg_active = 0;
 
       // wait for write to complete
-      flash_byte(FLASH_CMD_RDSR);
-      do {
-         status = flash_byte(0xFF);
-      } while(status & 1);
-      *spi_reg_active = 0;
-      write_blk_offset += 256;
+      spiflash_wait_ready();
+      stats.pages_programmed++;
+      addr += chunk;
+      count -= chunk;
    }
+   trace_event(TRACE_FLASH_PROGRAM_END, addr, 0);
+}
 
-   // turn off slave select
-   *spi_reg_active = 0;
+//-------------------------------------------------------------------------
+// write a 4k erase block's worth of data
+// Each page is compared with what's on the chip first. Unchanged pages
+// aren't programmed, and if the new data only clears bits the erase
+// (which stalls everything for tens of milliseconds) is skipped.
+static void spiflash_writebuffer(WriteBuf *wb)
+{
+   uint32_t changed = 0;   // bit per page
+   uint32_t blank = 0;     // pages that are all 0xFF
+   bool need_erase = false;
+
+   for(int p = 0; p < FLASH_PAGES_PER_SEC; p++) {
+      const uint32_t *new = (uint32_t *)(wb->data + (p * FLASH_PAGE_SIZE));
+      const uint32_t *old = (uint32_t *)page_buf;
+      uint32_t and_all = 0xFFFFFFFF;
+
+      flash_memcpy(wb->offset + (p * FLASH_PAGE_SIZE), page_buf, FLASH_PAGE_SIZE);
+      for(int i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+         if(new[i] != old[i]) {
+            changed |= 1 << p;
+            if((old[i] & new[i]) != new[i]) need_erase = true;
+         }
+         and_all &= new[i];
+      }
+      if(and_all == 0xFFFFFFFF) blank |= 1 << p;
+   }
+
+#ifdef DEBUG_FLASHWRITE
+   printk("Writing out to flash at %x: changed=%x erase=%d\n",
+         wb->offset, changed, need_erase);
+#endif
+   if(need_erase) {
+      spiflash_erase_sector(wb->offset);
+      changed = ~blank;
+   }
+   else {
+      stats.erases_avoided++;
+   }
 
-   // clear buffers
-   write_blk_offset = 0;
-   kfree(writebuf);
-   writebuf = NULL;
+   for(int p = 0; p < FLASH_PAGES_PER_SEC; p++) {
+      if(changed & (1 << p)) {
+         spiflash_program(wb->offset + (p * FLASH_PAGE_SIZE),
+               wb->data + (p * FLASH_PAGE_SIZE), FLASH_PAGE_SIZE);
+      }
+      else {
+         stats.pages_skipped++;
+      }
+   }
+}
+
+//------------------------------------------------------------------------
+// Read and write at an offset. The flash has no notion of position
+// beyond the fd's pointer, so these just move it for the duration.
+ssize_t spiflash_pread(int fd, void *buf, size_t count, off_t offset) {
+   OpenFD *fdinfo = get_fd(fd);
+   if(!fdinfo) return -EIO;
+
+   uint32_t saved = fdinfo->fileptr;
+   fdinfo->fileptr = offset;
+   ssize_t rc = spiflash_read(fd, buf, count);
+   fdinfo->fileptr = saved;
+   return rc;
+}
+
+ssize_t spiflash_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+   OpenFD *fdinfo = get_fd(fd);
+   if(!fdinfo) return -EIO;
+
+   uint32_t saved = fdinfo->fileptr;
+   fdinfo->fileptr = offset;
+   ssize_t rc = spiflash_write(fd, buf, count);
+   fdinfo->fileptr = saved;
+   return rc;
 }
 
 //------------------------------------------------------------------------
@@ -337,9 +475,25 @@ int spiflash_close(int fd) {
    OpenFD *fdinfo = get_fd(fd);
    if(!fdinfo) return -EIO;
 
-   if(writebuf) spiflash_writebuffer();
    fdinfo->fd = 0;
 
+   // flush once nobody has the device open
+   for(int i = 0; i < MAX_FLASH_FDS; i++) {
+      if(fd_list[i].fd) return 0;
+   }
+   spiflash_sync();
+
    return 0;
 }
 
+//------------------------------------------------------------------------
+// ioctl
+int spiflash_ioctl(int fd, unsigned long request, void *ptr) {
+   switch(request) {
+      case SPIFLASH_GET_STATS:
+         if(ptr == NULL) return -EFAULT;
+         memcpy(ptr, &stats, sizeof(stats));
+         return 0;
+   }
+   return -EINVAL;
+}
@@ -35,11 +35,16 @@ void spiflash_init(void);
 int spiflash_open(const char *devname, int flags, mode_t mode, FD *fd);
 ssize_t spiflash_read(int fd, void *buf, size_t count);
 ssize_t spiflash_write(int fd, const void *buf, size_t count);
+ssize_t spiflash_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t spiflash_pwrite(int fd, const void *buf, size_t count, off_t offset);
 int spiflash_fstat(int fd, struct stat *statbuf);
 off_t spiflash_lseek(int fd, off_t offset, int whence);
 int spiflash_close(int fd);
+int spiflash_ioctl(int fd, unsigned long request, void *ptr);
 
 void spiflash_sync(void);
+void spiflash_erase_sector(uint32_t addr);
+void spiflash_program(uint32_t addr, const uint8_t *buf, size_t count);
 
 // From spi_flash.s
 void flash_memcpy(uint32_t srcaddr, void *destptr, size_t count);
@@ -30,6 +30,9 @@
 .set SCAUSE_MEMACCESS, 0x5
 .set SCAUSE_EBREAK, 0x3
 .set SCAUSE_ILLEGAL, 0x2
+.set CSR_PRIVMODE, 0x5c1
+.set TRACE_SYSCALL, 0x10            # sys/trace.h
+.set TRACE_SYSCALL_END, 0x90
 
 .option arch, +zicsr
 .text
@@ -42,13 +45,17 @@
 super_trap:
    csrw     sscratch, sp      # store userland stack pointer
 #   la       sp, __stack_top - 16   # set up supervisor stack
-   li       sp, 0xFEF0
+   la       sp, task_kstack   # the current task's supervisor stack,
+   lw       sp, 0(sp)         # 0xFEF0 for the main task
    sw       s1, 0(sp)         # save s1      128
    sw       s2, 4(sp)         # save s2      132
    sw       ra, 8(sp)         #              136
    csrr     s1, sscratch      # retrieve user stack ptr
    sw       s1, 12(sp)        # save it on the stack IMPORTANT: always store at 12(sp) (142)
                               # some syscalls check the user sp!
+   csrr     s1, sepc          # another task's trap may overwrite sepc
+   la       s2, task_epc      # before this one returns
+   sw       s1, 0(s2)
 
    la       ra, .trap_done
    csrr     s1, scause
@@ -104,14 +111,38 @@ super_trap:
    beq      s1, s2, memaccess_handler
    call     illegal_handler
 .restore_stack:
+   lw       a0, 0(sp)         # the handler may have used any of the
+   lw       a1, 4(sp)         # temporaries, so put them all back
+   lw       a2, 8(sp)
+   lw       a3, 12(sp)
+   lw       a4, 16(sp)
+   lw       a5, 20(sp)
+   lw       a6, 24(sp)
+   lw       a7, 28(sp)
+   lw       t0, 80(sp)
+   lw       t1, 84(sp)
+   lw       t2, 88(sp)
+   lw       t3, 92(sp)
+   lw       t4, 96(sp)
+   lw       t5, 100(sp)
+   lw       t6, 104(sp)
    addi     sp, sp, 128
+   lw       s1, 0(sp)
+   lw       s2, 4(sp)
+   lw       ra, 8(sp)
+   lw       sp, 12(sp)
+   sret                       # the handlers hold other tasks, so sepc is still ours
 
 .trap_done:
+   la       t0, task_epc      # sepc can't be written, so return by hand,
+                              # t0 is free after an ecall
+   lw       t0, 0(t0)
    lw       s1, 0(sp)
    lw       s2, 4(sp)
    lw       ra, 8(sp)
    lw       sp, 12(sp)
-   sret
+   csrwi    CSR_PRIVMODE, 0   # leave S mode, as sret would
+   jr       t0
 
 ##-------------------------------------------------------------------------
 ## Handle syscalls. Syscall number is in a7.
@@ -120,6 +151,8 @@ syscall_handler:
    addi     sp, sp, -16
    sw       ra, 12(sp)
    sw       a7, 8(sp)
+   li       t0, TRACE_SYSCALL
+   jal      t4, trace_syscall
 
    # debug
 #   addi     sp, sp, -48
@@ -181,6 +214,8 @@ syscall_handler:
 
 .syscall_done:
    lw       a7, 8(sp)
+   li       t0, TRACE_SYSCALL_END
+   jal      t4, trace_syscall
    lw       ra, 12(sp)
    addi     sp, sp, 16
    ret
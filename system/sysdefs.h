@@ -13,11 +13,16 @@
 #define NOT_IN_KERNEL_SPACE(x) (uint32_t)x > 10000
 
 // Timer definitions
+#define  TIMER_ONE_MS         12000
 #define  TIMER_TEN_MS         120000
 #define  TIMER_HUNDRED_MS     1200000
 #define  TIMER_QUARTER_SEC    3000000
 #define  TIMER_ONE_SEC        12000000
 
+// Period of the general purpose timer tick, which drives the kernel
+// timers (ktimer.h)
+#define  TIMER_TICK           TIMER_ONE_MS
+
 #define  TIMER_RESET          1
 #define  TIMER_ENABLE         2
 
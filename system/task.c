@@ -0,0 +1,257 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// task.c: cooperative tasks, so that a program such as the fileserver
+// can get on with one job while another is waiting for the network.
+//
+// Tasks share the program's memory and each has its own stack, which
+// the program provides. The top TASK_KSTACK_SIZE bytes are the task's
+// kernel stack: a task can be switched away from in the middle of a
+// system call (in wait_event), so it needs somewhere to keep that
+// call's state. super_trap finds the current task's kernel stack in
+// task_kstack, and keeps the address to return to in task_epc, since
+// another task's system call will have overwritten sepc.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sysdefs.h"
+#include "elfload.h"
+#include "wait.h"
+#include "task.h"
+#include "trace.h"
+
+#define TASK_FREE       0
+#define TASK_READY      1        // yielded, or not started yet
+#define TASK_WAITING    2        // in wait_event
+#define TASK_RUNNING    3
+
+typedef struct {
+   TaskContext    ctx;
+   uint8_t        state;
+   uint32_t       pending;       // events signalled since it last took them
+   uint32_t       waitmask;      // events it's waiting for
+   uint32_t       epc;           // where its system call returns to
+   uint32_t       kstack;        // top of its kernel stack
+} Task;
+
+static Task tasks[TASK_MAX] = {
+   [TASK_MAIN] = { .state = TASK_RUNNING, .kstack = MAIN_KSTACK }
+};
+static int current = TASK_MAIN;
+static bool held;                // no switching while a fault is handled
+
+uint32_t task_kstack = MAIN_KSTACK;
+uint32_t task_epc;
+
+//------------------------------------------------------------------
+// Find another task that can run: one that's ready, or one that's
+// waiting for an event it now has. Round robin from the current one.
+static int
+task_next(void)
+{
+   if(held)
+      return -1;
+
+   for(int n = 1; n < TASK_MAX; n++) {
+      int i = (current + n) % TASK_MAX;
+      Task *t = &tasks[i];
+      if(t->state == TASK_READY ||
+            (t->state == TASK_WAITING && (t->pending & t->waitmask)))
+         return i;
+   }
+   return -1;
+}
+
+// Switch to another task. The caller has set the current task's state
+// and turned interrupts off. Returns when this task is switched back to.
+static void
+task_run(int next)
+{
+   Task *from = &tasks[current];
+   Task *to = &tasks[next];
+
+   trace_event(TRACE_TASK_SWITCH, current, next);
+   from->epc = task_epc;
+   task_epc = to->epc;
+   task_kstack = to->kstack;
+   to->state = TASK_RUNNING;
+   current = next;
+
+   task_switch(&from->ctx, &to->ctx);
+}
+
+//------------------------------------------------------------------
+// Events are handed to every task, since more than one may be waiting
+// for the same one (e.g. frames for two fds both raise WAIT_ECONET_RX).
+// Called with interrupts off.
+void
+task_collect_events(void)
+{
+   uint32_t events = wait_pending;
+   if(!events) return;
+
+   wait_pending = 0;
+   for(int i = 0; i < TASK_MAX; i++) {
+      if(tasks[i].state != TASK_FREE)
+         tasks[i].pending |= events;
+   }
+}
+
+// Take the events in mask that the current task has been given
+uint32_t
+task_take_events(uint32_t mask)
+{
+   uint32_t events = tasks[current].pending & mask;
+   tasks[current].pending &= ~events;
+   return events;
+}
+
+// Run another task while the current one waits for the events in
+// mask. Returns false if there's nothing else to run, in which case
+// the caller should sleep.
+bool
+task_wait(uint32_t mask)
+{
+   int next = task_next();
+   if(next < 0)
+      return false;
+
+   tasks[current].state = TASK_WAITING;
+   tasks[current].waitmask = mask;
+   task_run(next);
+   return true;
+}
+
+// Keep the current task running until released. The fault handlers
+// return with sret, so no other task may trap in the meantime.
+void
+task_hold(bool hold)
+{
+   held = hold;
+}
+
+//------------------------------------------------------------------
+// Which task is running
+int
+task_self(void)
+{
+   return current;
+}
+
+// Forget every task but the main one, when a new program is started.
+void
+task_reset(void)
+{
+   for(int i = 0; i < TASK_MAX; i++)
+      tasks[i].state = TASK_FREE;
+
+   current = TASK_MAIN;
+   held = false;
+   tasks[TASK_MAIN].state = TASK_RUNNING;
+   tasks[TASK_MAIN].pending = 0;
+   task_kstack = MAIN_KSTACK;
+}
+
+//------------------------------------------------------------------
+// Create a task that runs fn(arg) on the given stack. entry is the
+// C library's start routine, which calls fn and then task_exit. The
+// new task first runs when the caller next waits or yields.
+int
+SYS_task_create(void *entry, void *fn, void *arg, void *stack, size_t size)
+{
+   // the whole stack has to be in user memory
+   uint32_t base = (uint32_t)stack;
+   if(base < USRMEM_START || base > USER_SP || size > USER_SP - base ||
+         (base | size) & 15 || size < TASK_KSTACK_SIZE * 2)
+      return -EINVAL;
+
+   int id;
+   for(id = 1; id < TASK_MAX; id++) {
+      if(tasks[id].state == TASK_FREE)
+         break;
+   }
+   if(id == TASK_MAX)
+      return -EAGAIN;
+
+   Task *t = &tasks[id];
+   uint32_t top = base + size;
+
+   // super_trap saves the caller's registers just above the kernel stack
+   t->kstack = top - 16;
+   t->pending = 0;
+
+   memset(&t->ctx, 0, sizeof(t->ctx));
+   t->ctx.ra = (uint32_t)task_first_run;
+   t->ctx.sp = t->kstack;
+   t->ctx.s[0] = (uint32_t)entry;
+   t->ctx.s[1] = (uint32_t)fn;
+   t->ctx.s[2] = (uint32_t)arg;
+   t->ctx.s[3] = t->kstack - TASK_KSTACK_SIZE;     // user stack
+   t->state = TASK_READY;
+
+   trace_event(TRACE_TASK_CREATE, id, 0);
+   return id;
+}
+
+// Let any other task that can run have a go
+int
+SYS_task_yield(void)
+{
+   DISABLE_INTERRUPTS
+   task_collect_events();
+   int next = task_next();
+   if(next >= 0) {
+      tasks[current].state = TASK_READY;
+      task_run(next);
+   }
+   ENABLE_INTERRUPTS
+   return 0;
+}
+
+// End the current task. The main task ends by exiting the program.
+int
+SYS_task_exit(void)
+{
+   if(current == TASK_MAIN)
+      return -EINVAL;
+
+   trace_event(TRACE_TASK_EXIT, current, 0);
+   DISABLE_INTERRUPTS
+   tasks[current].state = TASK_FREE;
+
+   int next;
+   while((next = task_next()) < 0) {
+      asm volatile("wfi");
+      ENABLE_INTERRUPTS
+      DISABLE_INTERRUPTS
+      task_collect_events();
+   }
+   task_run(next);
+
+   // not reached
+   return 0;
+}
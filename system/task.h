@@ -0,0 +1,65 @@
+#ifndef TASK_H
+#define TASK_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Cooperative tasks within the running program. A task only gives up
+// the CPU when it waits for an event (wait_event), yields or exits,
+// so kernel code never needs locking against other tasks.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/task.h>         // TASK_MAX, TASK_KSTACK_SIZE
+
+#define TASK_MAIN          0
+#define MAIN_KSTACK        0xFEF0   // the main task's kernel stack (see super_trap.s)
+
+// Registers kept across a task switch
+typedef struct {
+   uint32_t       ra;
+   uint32_t       sp;
+   uint32_t       s[12];
+} TaskContext;
+
+// task_switch.S
+void task_switch(TaskContext *save, TaskContext *load);
+void task_first_run(void);
+void task_call_on_stack(void (*fn)(int), int arg, uint32_t sp);
+
+void  task_reset(void);
+int   task_self(void);
+void  task_hold(bool hold);
+
+// Used by wait_event
+void     task_collect_events(void);
+uint32_t task_take_events(uint32_t mask);
+bool     task_wait(uint32_t mask);
+
+// System calls
+int   SYS_task_create(void *entry, void *fn, void *arg, void *stack, size_t size);
+int   SYS_task_yield(void);
+int   SYS_task_exit(void);
+
+#endif
@@ -23,14 +23,86 @@
 */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/clock.h>
 
 #include "time.h"
 #include "cpu.h"
+#include "devices.h"
+#include "sysdefs.h"
+
+// The general purpose timer counts up to the stop value and one
+// more before wrapping to zero, interrupting when it hits the stop value.
+static volatile uint32_t *timer_stop = (uint32_t *)(DEV_BASE + OFFS_TMRSET);
+static volatile uint32_t *timer_ctl  = (uint32_t *)(DEV_BASE + OFFS_TMRCTL);
+
+// Start the periodic timer tick, which counts time for the kernel
+// timers and wakes up sleeping calls when one is due.
+void
+timer_init(void)
+{
+   *timer_stop = TIMER_TICK - 2;
+   *timer_ctl  = 5;           // reset counter and enable
+}
+
+// Divide a 64 bit number with 32 bit divides, 8 bits at a time. The
+// divisor must be below 2^24, so each partial dividend fits in 32 bits.
+#if CPU_CLOCK_HZ >= (1 << 24)
+#error "CPU_CLOCK_HZ too big for div_small"
+#endif
+static uint64_t
+div_small(uint64_t n, uint32_t d, uint32_t *rem)
+{
+   uint32_t hi = n >> 32;
+   uint64_t q = (uint64_t)(hi / d) << 32;
+   uint32_t r = hi % d;
+
+   for(int shift = 24; shift >= 0; shift -= 8) {
+      r = r << 8 | ((uint32_t)n >> shift & 0xff);
+      q |= (uint64_t)(r / d) << shift;
+      r %= d;
+   }
+   if(rem) *rem = r;
+   return q;
+}
 
 // Time since reset
+void
+get_time(struct timespec *ts)
+{
+   uint32_t cycles;
+   ts->tv_sec = div_small(get_cycle(), CPU_CLOCK_HZ, &cycles);
+   ts->tv_nsec = div_small((uint64_t)cycles * 1000000000, CPU_CLOCK_HZ, NULL);
+}
+
 uint64_t 
 get_ms(void)
 {
-   uint64_t cyc = get_cycle();
-   return cyc >> 13;
+   return div_small(get_cycle(), CPU_CLOCK_HZ / 1000, NULL);
+}
+
+//------------------------------------------------------------------
+// System calls. The C library reads the cycle counter itself, so
+// these are only for code that makes the system call directly.
+int
+SYS_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+   if(clk != CLOCK_MONOTONIC && clk != CLOCK_REALTIME) return -EINVAL;
+   if(!ts) return -EFAULT;
+
+   get_time(ts);
+   return 0;
+}
+
+int
+SYS_gettimeofday(struct timeval *tv, void *tz)
+{
+   if(!tv) return -EFAULT;
+
+   struct timespec ts;
+   get_time(&ts);
+   tv->tv_sec = ts.tv_sec;
+   tv->tv_usec = ts.tv_nsec / 1000;
+   return 0;
 }
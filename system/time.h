@@ -25,7 +25,15 @@
 */
 
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
 
+void     get_time(struct timespec *ts);
 uint64_t get_ms(void);
+void     timer_init(void);
+
+// System calls
+int   SYS_clock_gettime(clockid_t clk, struct timespec *ts);
+int   SYS_gettimeofday(struct timeval *tv, void *tz);
 
 #endif
@@ -22,6 +22,7 @@
 #THE SOFTWARE.
 #
 
+.option arch, +zicsr
 .text
 
 # On entry a0 = device_base, a1 = timer_ctl, ra = isr_exit
@@ -29,11 +30,47 @@
 timer_done:
    li    a1, 6          # reset timer interrupt and enable
    sw    a1, 8(a0)      # timer control reg
+
+   la    a2, prof_state # profiling? (prof.h)
+   lw    a1, 0(a2)
+   beqz  a1, 3f
+   lw    a1, 16(a2)     # count the sample
+   addi  a1, a1, 1
+   sw    a1, 16(a2)
+   csrr  a1, mepc       # where we interrupted
+   lw    a3, 4(a2)      # lo
+   sub   a1, a1, a3
+   lw    a3, 8(a2)      # size
+   bgeu  a1, a3, 2f     # outside the range
+   lw    a3, 12(a2)     # shift
+   srl   a1, a1, a3
+   slli  a1, a1, 1
+   la    a3, prof_hist
+   add   a3, a3, a1
+   lhu   a1, 0(a3)
+   addi  a1, a1, 1
+   srli  a4, a1, 16     # don't wrap round to 0
+   bnez  a4, 3f
+   sh    a1, 0(a3)
+   j     3f
+2:
+   lw    a1, 20(a2)     # outside++
+   addi  a1, a1, 1
+   sw    a1, 20(a2)
+3:
    la    a2, timer_count
    lw    a1, 0(a2)      # get timer count and increment
    addi  a1, a1, 1
    sw    a1, 0(a2)
-   sw    a1, 0(a0)
+   la    a2, ktimer_due # nothing to wake up for yet? (ktimer.c)
+   lw    a2, 0(a2)
+   sub   a2, a1, a2
+   bltz  a2, 1f
+   la    a2, wait_pending
+   lw    a1, 0(a2)
+   ori   a1, a1, 0x08   # WAIT_TIMER (wait.h)
+   sw    a1, 0(a2)
+1:
    ret                  # isr_exit
 
 .data
@@ -0,0 +1,189 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+
+// trace.c: the kernel trace ring and /dev/trace (see trace.h).
+//
+// trace_head counts every record ever made and trace_tail every one
+// read, so the ring holds trace_head - trace_tail of them, unless the
+// reader has fallen more than TRACE_ENTRIES behind. ISRs add records,
+// so everything else touches the ring with interrupts off.
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fd.h"
+#include "trace.h"
+#ifdef SIMLIB
+#include "simulator.h"
+#endif
+
+uint32_t trace_mask = TRACE_ALL & ~TRACE_SYSCALLS;
+uint32_t trace_head;
+struct trace_rec trace_buf[TRACE_ENTRIES];
+
+static uint32_t trace_tail;
+static uint32_t trace_lost;
+
+static ssize_t trace_read(int fd, void *buf, size_t count);
+static int trace_ioctl(int fd, unsigned long request, void *ptr);
+static int trace_close(int fd);
+
+static FDfunction trace_func = {
+   .fd_read  = trace_read,
+   .fd_ioctl = trace_ioctl,
+   .fd_close = trace_close,
+};
+
+//------------------------------------------------------------------
+#ifdef SIMLIB
+// The simulator's tasks run one at a time, and it has no ISRs
+static inline uint32_t trace_lock(void) { return 0; }
+static inline void trace_unlock(uint32_t status) { }
+static inline uint32_t trace_cycle(void) { return sim_cycle(); }
+#else
+// Interrupts off, returning how to put them back. Unlike
+// DISABLE_INTERRUPTS, this can be used where they're already off.
+static inline uint32_t
+trace_lock(void)
+{
+   uint32_t status;
+   asm volatile(".option arch, +zicsr\n\t"
+                "csrr %0, mstatus\n\t"
+                "csrwi mstatus, 0" : "=r"(status) : : "memory");
+   return status;
+}
+
+static inline void
+trace_unlock(uint32_t status)
+{
+   asm volatile(".option arch, +zicsr\n\t"
+                "csrw mstatus, %0" : : "r"(status) : "memory");
+}
+
+static inline uint32_t
+trace_cycle(void)
+{
+   uint32_t cycle;
+   asm volatile(".option arch, +zicsr\n\t"
+                "csrr %0, cycle" : "=r"(cycle));
+   return cycle;
+}
+#endif
+
+// Forget records the reader is too far behind to get back
+static void
+trace_catch_up(void)
+{
+   if(trace_head - trace_tail > TRACE_ENTRIES) {
+      trace_lost += trace_head - trace_tail - TRACE_ENTRIES;
+      trace_tail = trace_head - TRACE_ENTRIES;
+   }
+}
+
+//------------------------------------------------------------------
+// Add a record. Use trace_event, which checks the mask first.
+void
+trace_record(uint32_t event, uint32_t a, uint32_t b)
+{
+   uint32_t status = trace_lock();
+   struct trace_rec *r = &trace_buf[trace_head++ & (TRACE_ENTRIES - 1)];
+
+   r->cycle = trace_cycle();
+   r->event = event;
+   r->a = a;
+   r->b = b;
+   trace_unlock(status);
+}
+
+//------------------------------------------------------------------
+// Device functions
+int
+trace_open(const char *devname, int flags, mode_t mode, FD *fd)
+{
+   fd->fdfunc = &trace_func;
+   return 0;
+}
+
+// Drain whole records, oldest first. Returns 0 if there are none.
+static ssize_t
+trace_read(int fd, void *buf, size_t count)
+{
+   uint8_t *bufptr = buf;
+   ssize_t rc = 0;
+
+   while(count >= sizeof(struct trace_rec)) {
+      uint32_t status = trace_lock();
+      trace_catch_up();
+      if(trace_tail == trace_head) {
+         trace_unlock(status);
+         break;
+      }
+      memcpy(bufptr, &trace_buf[trace_tail++ & (TRACE_ENTRIES - 1)],
+            sizeof(struct trace_rec));
+      trace_unlock(status);
+
+      bufptr += sizeof(struct trace_rec);
+      count -= sizeof(struct trace_rec);
+      rc += sizeof(struct trace_rec);
+   }
+   return rc;
+}
+
+static int
+trace_ioctl(int fd, unsigned long request, void *ptr)
+{
+   uint32_t req_id = request & 0xFF000000;
+   struct trace_status *st = ptr;
+   uint32_t status;
+
+   switch(req_id) {
+      case TRACE_SET_MASK:
+         trace_mask = request & TRACE_ALL;
+         return 0;
+      case TRACE_CLEAR:
+         status = trace_lock();
+         trace_tail = trace_head;
+         trace_lost = 0;
+         trace_unlock(status);
+         return 0;
+      case TRACE_GET_STATUS:
+         if(ptr == NULL) return -EFAULT;
+         status = trace_lock();
+         trace_catch_up();
+         st->mask = trace_mask;
+         st->queued = trace_head - trace_tail;
+         st->lost = trace_lost;
+         trace_unlock(status);
+         return 0;
+   }
+   return -EINVAL;
+}
+
+static int
+trace_close(int fd)
+{
+   return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Kernel tracepoints: a ring of timestamped records (sys/trace.h)
+// which /dev/trace drains. When the ring is full the oldest records
+// are overwritten and counted as lost. Recording is cheap enough to
+// leave in, and only the classes in trace_mask are recorded.
+
+#include <sys/trace.h>
+
+#ifndef TRACE_ENTRIES
+#define TRACE_ENTRIES      128      // power of 2, 16 bytes each
+#endif
+
+#ifdef ASM
+// Claim the next record and stamp it. Leaves its address in tmp1.
+// Interrupts must be off.
+#define TRACE_SLOT(tmp1, tmp2, tmp3) \
+   la    tmp1, trace_head; \
+   lw    tmp2, 0(tmp1); \
+   addi  tmp3, tmp2, 1; \
+   sw    tmp3, 0(tmp1); \
+   andi  tmp2, tmp2, TRACE_ENTRIES - 1; \
+   slli  tmp2, tmp2, 4; \
+   la    tmp1, trace_buf; \
+   add   tmp1, tmp1, tmp2; \
+   csrr  tmp2, cycle; \
+   sw    tmp2, 0(tmp1)
+
+// Record event ev from an ISR. areg and breg mustn't be any of the
+// temporaries, which are clobbered.
+#define TRACE_ISR(ev, areg, breg, tmp1, tmp2, tmp3) \
+   la    tmp1, trace_mask; \
+   lw    tmp1, 0(tmp1); \
+   andi  tmp1, tmp1, TRACE_CLASS(ev); \
+   beqz  tmp1, 9f; \
+   TRACE_SLOT(tmp1, tmp2, tmp3); \
+   li    tmp2, ev; \
+   sw    tmp2, 4(tmp1); \
+   sw    areg, 8(tmp1); \
+   sw    breg, 12(tmp1); \
+9:
+#else
+#include <stdint.h>
+
+#include "fd.h"
+
+extern uint32_t trace_mask;
+
+void trace_record(uint32_t event, uint32_t a, uint32_t b);
+
+static inline void trace_event(uint32_t event, uint32_t a, uint32_t b)
+{
+   if(trace_mask & TRACE_CLASS(event))
+      trace_record(event, a, b);
+}
+
+int trace_open(const char *devname, int flags, mode_t mode, FD *fd);
+#endif
+
+#endif
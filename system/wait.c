@@ -0,0 +1,81 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// wait.c: put blocking calls to sleep until an interrupt handler
+// signals something they're interested in, running other tasks and
+// kernel timers meanwhile.
+
+#include <stdint.h>
+
+#include "sysdefs.h"
+#include "wait.h"
+#include "task.h"
+#include "ktimer.h"
+
+volatile uint32_t wait_pending;
+
+//------------------------------------------------------------------
+// Sleep until one of the events in mask has been signalled since this
+// task last waited for it. The events are consumed, and returned.
+// Callers should re-check whatever they are waiting for on return.
+uint32_t 
+wait_event(uint32_t mask)
+{
+   uint32_t events;
+
+   if(ktimer_expired()) ktimer_run();
+
+   // Interrupts are off while checking so an event can't arrive
+   // between the check and the wfi. wfi still wakes up for a pending
+   // interrupt when they're disabled, and it gets handled as soon as
+   // they're turned back on.
+   DISABLE_INTERRUPTS
+   task_collect_events();
+   while(!(events = task_take_events(mask))) {
+      if(!task_wait(mask)) {
+         asm volatile("wfi");
+         ENABLE_INTERRUPTS
+         DISABLE_INTERRUPTS
+      }
+      if(ktimer_expired()) {
+         ENABLE_INTERRUPTS
+         ktimer_run();
+         DISABLE_INTERRUPTS
+      }
+      task_collect_events();
+   }
+   ENABLE_INTERRUPTS
+
+   return events;
+}
+
+//------------------------------------------------------------------
+// Signal events from kernel code, as an ISR would
+void
+wait_signal(uint32_t events)
+{
+   DISABLE_INTERRUPTS
+   wait_pending |= events;
+   ENABLE_INTERRUPTS
+}
@@ -0,0 +1,52 @@
+#ifndef WAIT_H
+#define WAIT_H
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+// Events that interrupt handlers signal to wake up blocked calls.
+// They're sticky: an event signalled before anyone waits for it
+// is not lost.
+#define WAIT_ECONET_RX     0x01     // frame queued, or seen in monitor mode
+#define WAIT_ECONET_TX     0x02     // transmit handshake finished or failed
+#define WAIT_CONSOLE       0x04     // byte received (software FIFO only)
+#define WAIT_TIMER         0x08     // kernel timer due, or KTIMER_WAKE ticks on
+#define WAIT_SDCARD        0x10     // card inserted or removed
+
+#ifdef ASM
+// Signal events from an ISR. Clobbers tmp1 and tmp2.
+#define WAIT_SIGNAL(events, tmp1, tmp2) \
+   la    tmp1, wait_pending; \
+   lw    tmp2, 0(tmp1); \
+   ori   tmp2, tmp2, events; \
+   sw    tmp2, 0(tmp1)
+#else
+#include <stdint.h>
+
+extern volatile uint32_t wait_pending;
+
+uint32_t wait_event(uint32_t mask);
+void     wait_signal(uint32_t events);
+#endif
+
+#endif
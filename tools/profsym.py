@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+#The MIT License
+#
+#Copyright (c) 2025 Dylan Smith
+#
+#Permission is hereby granted, free of charge, to any person obtaining a copy
+#of this software and associated documentation files (the "Software"), to deal
+#in the Software without restriction, including without limitation the rights
+#to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#copies of the Software, and to permit persons to whom the Software is
+#furnished to do so, subject to the following conditions:
+#
+#The above copyright notice and this permission notice shall be included in
+#all copies or substantial portions of the Software.
+#
+#THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#THE SOFTWARE.
+#
+
+# profsym.py: put names to a profile from init's "prof dump".
+#
+#    profsym.py prof.txt build/system/filestick-system.elf \
+#       build/fileserver/fileserver.elf
+#
+# The dump can be a capture of the console with other output around
+# it. Give the kernel's ELF file and the one for the program that was
+# running, since programs are all loaded at the same address. Buckets
+# that span more than one function are shared between them by how many
+# of the bucket's bytes each has, so if the functions you're interested
+# in are small, profile a narrower range to get smaller buckets.
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+from bisect import bisect_right
+from collections import defaultdict
+
+NM_NAMES = ["riscv-none-elf-nm", "riscv32-unknown-elf-nm",
+            "riscv64-unknown-elf-nm", "nm"]
+
+HEADER = re.compile(r"^prof ([0-9a-fA-F]{8}) (\d+) (\d+) (\d+) (\d+)\s*$")
+BUCKET = re.compile(r"^([0-9a-fA-F]{8}) (\d+)\s*$")
+
+
+def read_dump(path):
+    header = None
+    buckets = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip("\r\n").lstrip("*> ")
+            m = HEADER.match(line)
+            if m:
+                # a later dump replaces an earlier one
+                header = [int(m.group(1), 16)] + [int(g) for g in m.group(2, 3, 4, 5)]
+                buckets = []
+                continue
+            m = BUCKET.match(line)
+            if header and m:
+                buckets.append((int(m.group(1), 16), int(m.group(2))))
+    if not header:
+        sys.exit("%s: no profile found" % path)
+    return header, buckets
+
+
+def find_nm(name):
+    if name:
+        return name
+    for n in NM_NAMES:
+        if shutil.which(n):
+            return n
+    sys.exit("no nm found, use --nm")
+
+
+# Code symbols as (start, end, name, file), sorted by start
+def read_symbols(nm, elfs, with_files):
+    syms = []
+    for elf in elfs:
+        cmd = [nm, "-n", "-S", "--defined-only"]
+        if with_files:
+            cmd.append("-l")
+        try:
+            text = subprocess.run(cmd + [elf], check=True, capture_output=True,
+                                  text=True).stdout
+        except (OSError, subprocess.CalledProcessError) as e:
+            sys.exit("%s: %s" % (elf, e))
+
+        for line in text.splitlines():
+            line, _, where = line.partition("\t")
+            fields = line.split()
+            if len(fields) == 4:
+                addr, size, kind, name = fields
+                size = int(size, 16)
+            elif len(fields) == 3:
+                addr, kind, name = fields
+                size = 0
+            else:
+                continue
+            if kind not in "tTwW":
+                continue
+            src = where.rsplit(":", 1)[0].rsplit("/", 1)[-1] if where else "?"
+            syms.append([int(addr, 16), size, name, src])
+
+    syms.sort()
+    out = []
+    for i, (addr, size, name, src) in enumerate(syms):
+        end = addr + size
+        if size == 0:
+            end = syms[i + 1][0] if i + 1 < len(syms) else addr + 4
+        out.append((addr, end, name, src))
+    return out
+
+
+# Share a bucket's count between the symbols it overlaps
+def attribute(buckets, bucket_size, syms, with_files):
+    starts = [s[0] for s in syms]
+    totals = defaultdict(float)
+    for addr, count in buckets:
+        end = addr + bucket_size
+        i = max(bisect_right(starts, addr) - 1, 0)
+        shares = []
+        while i < len(syms) and syms[i][0] < end:
+            lo = max(addr, syms[i][0])
+            hi = min(end, syms[i][1])
+            if hi > lo:
+                key = syms[i][3] if with_files else syms[i][2]
+                shares.append((key, hi - lo))
+            i += 1
+        covered = sum(n for _, n in shares)
+        if covered == 0:
+            totals["[%08x]" % addr] += count
+            continue
+        for key, n in shares:
+            totals[key] += count * n / covered
+    return totals
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Symbolize a FileStick profile")
+    ap.add_argument("dump", help="output of init's prof dump")
+    ap.add_argument("elf", nargs="+", help="kernel and program ELF files")
+    ap.add_argument("--nm", help="nm to use (default: the first RISC-V one found)")
+    ap.add_argument("--files", action="store_true",
+                    help="total by source file (needs debug info)")
+    ap.add_argument("-n", type=int, default=30, help="lines to show (default 30)")
+    args = ap.parse_args()
+
+    (lo, shift, hz, samples, outside), buckets = read_dump(args.dump)
+    bucket_size = 1 << shift
+    syms = read_symbols(find_nm(args.nm), args.elf, args.files)
+    totals = attribute(buckets, bucket_size, syms, args.files)
+
+    print("%d samples at %dHz (%.1fs), %d outside the range, %d byte buckets from %08x"
+          % (samples, hz, samples / hz if hz else 0, outside, bucket_size, lo))
+    if samples == 0:
+        return
+
+    print("%9s %6s %6s  %s" % ("samples", "%", "cum%", "file" if args.files else "function"))
+    cum = 0
+    for key, count in sorted(totals.items(), key=lambda kv: -kv[1])[:args.n]:
+        cum += count
+        print("%9.1f %6.2f %6.2f  %s"
+              % (count, 100 * count / samples, 100 * cum / samples, key))
+
+
+if __name__ == "__main__":
+    main()
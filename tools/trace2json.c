@@ -0,0 +1,303 @@
+/*
+;The MIT License
+;
+;Copyright (c) 2025 Dylan Smith
+;
+;Permission is hereby granted, free of charge, to any person obtaining a copy
+;of this software and associated documentation files (the "Software"), to deal
+;in the Software without restriction, including without limitation the rights
+;to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+;copies of the Software, and to permit persons to whom the Software is
+;furnished to do so, subject to the following conditions:
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+;AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+;OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+;THE SOFTWARE.
+*/
+
+
+// trace2json.c: turn a kernel trace saved by init's "trace save"
+// command into Chrome trace event JSON, which chrome://tracing and
+// Perfetto (ui.perfetto.dev) show as a timeline.
+//
+// Each task gets a track of its system calls and the disk and flash
+// operations done within them. The "cpu" track shows which task was
+// running, and the "isr" track the econet interrupts. Records only
+// say which task was running when the scheduler switches, so until
+// the first switch everything is put down to task 0.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/trace.h>
+
+#define MAX_TASKS       16
+#define TID_CPU         100
+#define TID_ISR         101
+
+static FILE *out;
+static bool first_event = true;
+static int depth[MAX_TASKS];        // spans open on each task's track
+
+static const char *econet_states[] = {
+   "waitscout", "waitdata", "txscout", "txdata"
+};
+
+//------------------------------------------------------------
+static const char *
+syscall_name(uint32_t num)
+{
+   switch(num) {
+      case 18:   return "opendir";
+      case 19:   return "closedir";
+      case 20:   return "readdir";
+      case 21:   return "peek";
+      case 22:   return "printk";
+      case 24:   return "exec_elf";
+      case 26:   return "diskcache_stats";
+      case 27:   return "task_create";
+      case 28:   return "task_yield";
+      case 29:   return "ioctl";
+      case 30:   return "task_exit";
+      case 32:   return "hexdump";
+      case 34:   return "malloc_init";
+      case 35:   return "malloc";
+      case 36:   return "realloc";
+      case 37:   return "free";
+      case 39:   return "umount";
+      case 40:   return "mount";
+      case 43:   return "statfs";
+      case 49:   return "chdir";
+      case 57:   return "close";
+      case 62:   return "lseek";
+      case 63:   return "read";
+      case 64:   return "write";
+      case 66:   return "writev";
+      case 67:   return "pread";
+      case 68:   return "pwrite";
+      case 71:   return "sendfile";
+      case 75:   return "poll";
+      case 80:   return "fstat";
+      case 93:   return "exit";
+      case 113:  return "clock_gettime";
+      case 169:  return "gettimeofday";
+      case 214:  return "brk";
+      case 1024: return "open";
+      case 1026: return "unlink";
+      case 1030: return "mkdir";
+      case 1038: return "stat";
+   }
+   return NULL;
+}
+
+static const char *
+econet_state(uint32_t state)
+{
+   return state < 4 ? econet_states[state] : "?";
+}
+
+//------------------------------------------------------------
+// Write one trace event. args is a JSON object's contents, or NULL.
+static void
+emit(const char *name, char phase, double ts, int tid, const char *args)
+{
+   fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%d",
+         first_event ? "" : ",", name, phase, ts, tid);
+   if(phase == 'i')
+      fprintf(out, ",\"s\":\"t\"");
+   if(args)
+      fprintf(out, ",\"args\":{%s}", args);
+   fprintf(out, "}");
+   first_event = false;
+}
+
+static void
+emit_name(int tid, const char *name)
+{
+   fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+         "\"args\":{\"name\":\"%s\"}}", first_event ? "" : ",", tid, name);
+   first_event = false;
+}
+
+// Spans ending before the start of the trace were begun in records
+// that have been overwritten, so their ends are dropped.
+static void
+begin(const char *name, double ts, int task, const char *args)
+{
+   depth[task]++;
+   emit(name, 'B', ts, task, args);
+}
+
+static void
+end(double ts, int task, const char *args)
+{
+   if(depth[task] == 0) return;
+   depth[task]--;
+   emit("", 'E', ts, task, args);
+}
+
+//------------------------------------------------------------
+static void
+usage()
+{
+   fprintf(stderr, "usage: trace2json [-o file.json] trace-file\n");
+   exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+   const char *outfile = NULL;
+   int opt;
+
+   while((opt = getopt(argc, argv, "o:")) != -1) {
+      switch(opt) {
+         case 'o': outfile = optarg; break;
+         default: usage();
+      }
+   }
+   if(optind != argc - 1)
+      usage();
+
+   FILE *in = fopen(argv[optind], "rb");
+   if(!in) {
+      perror(argv[optind]);
+      return 1;
+   }
+
+   struct trace_file_header hdr;
+   if(fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != TRACE_FILE_MAGIC ||
+         hdr.clock_hz == 0) {
+      fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+      return 1;
+   }
+
+   out = outfile ? fopen(outfile, "w") : stdout;
+   if(!out) {
+      perror(outfile);
+      return 1;
+   }
+
+   fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"lost\":%u},\"traceEvents\":[",
+         hdr.lost);
+   emit_name(TID_CPU, "cpu");
+   emit_name(TID_ISR, "isr");
+   for(int i = 0; i < MAX_TASKS; i++) {
+      char name[16];
+      snprintf(name, sizeof(name), "task %d", i);
+      emit_name(i, name);
+   }
+
+   // The cycle counter wraps every few minutes at 12MHz, so this
+   // assumes no more than that passes between records.
+   struct trace_rec rec;
+   uint64_t cycles = 0;
+   uint32_t last = 0;
+   bool started = false;
+   int task = 0;
+   long count = 0;
+   char args[128];
+   char name[32];
+
+   while(fread(&rec, sizeof(rec), 1, in) == 1) {
+      if(started) cycles += (uint32_t)(rec.cycle - last);
+      last = rec.cycle;
+      double ts = cycles * 1e6 / hdr.clock_hz;
+
+      if(!started) {
+         snprintf(name, sizeof(name), "task %d", task);
+         emit(name, 'B', ts, TID_CPU, NULL);
+         started = true;
+      }
+
+      switch(rec.event) {
+         case TRACE_ECONET_RX:
+            snprintf(args, sizeof(args), "\"state\":\"%s\",\"len\":%u",
+                  econet_state(rec.a), rec.b);
+            emit("econet_rx", 'i', ts, TID_ISR, args);
+            break;
+         case TRACE_ECONET_TIMEOUT:
+            snprintf(args, sizeof(args), "\"state\":\"%s\"", econet_state(rec.a));
+            emit("econet_timeout", 'i', ts, TID_ISR, args);
+            break;
+
+         case TRACE_SYSCALL: {
+            const char *sys = syscall_name(rec.a);
+            if(!sys) {
+               snprintf(name, sizeof(name), "syscall %u", rec.a);
+               sys = name;
+            }
+            snprintf(args, sizeof(args), "\"arg0\":\"0x%x\"", rec.b);
+            begin(sys, ts, task, args);
+            break;
+         }
+         case TRACE_SYSCALL_END:
+            snprintf(args, sizeof(args), "\"ret\":%d", (int32_t)rec.b);
+            end(ts, task, args);
+            break;
+
+         case TRACE_DISK_READ:
+         case TRACE_DISK_WRITE:
+            snprintf(args, sizeof(args), "\"drive\":%u,\"sector\":%u,\"count\":%u",
+                  rec.b >> 16, rec.a, rec.b & 0xffff);
+            begin(rec.event == TRACE_DISK_READ ? "disk_read" : "disk_write",
+                  ts, task, args);
+            break;
+         case TRACE_DISK_READ_END:
+         case TRACE_DISK_WRITE_END:
+            snprintf(args, sizeof(args), "\"result\":%u", rec.a);
+            end(ts, task, args);
+            break;
+
+         case TRACE_FLASH_ERASE:
+            snprintf(args, sizeof(args), "\"addr\":\"0x%x\"", rec.a);
+            begin("flash_erase", ts, task, args);
+            break;
+         case TRACE_FLASH_PROGRAM:
+            snprintf(args, sizeof(args), "\"addr\":\"0x%x\",\"len\":%u", rec.a, rec.b);
+            begin("flash_program", ts, task, args);
+            break;
+         case TRACE_FLASH_ERASE_END:
+         case TRACE_FLASH_PROGRAM_END:
+            end(ts, task, NULL);
+            break;
+
+         case TRACE_TASK_SWITCH:
+            if(rec.b >= MAX_TASKS) break;
+            emit("", 'E', ts, TID_CPU, NULL);
+            task = rec.b;
+            snprintf(name, sizeof(name), "task %d", task);
+            emit(name, 'B', ts, TID_CPU, NULL);
+            break;
+         case TRACE_TASK_CREATE:
+         case TRACE_TASK_EXIT:
+            snprintf(args, sizeof(args), "\"task\":%u", rec.a);
+            emit(rec.event == TRACE_TASK_CREATE ? "task_create" : "task_exit",
+                  'i', ts, task, args);
+            break;
+
+         default:
+            snprintf(name, sizeof(name), "event 0x%x", rec.event);
+            snprintf(args, sizeof(args), "\"a\":\"0x%x\",\"b\":\"0x%x\"", rec.a, rec.b);
+            emit(name, 'i', ts, task, args);
+      }
+      count++;
+   }
+
+   fprintf(out, "\n]}\n");
+   if(outfile) fclose(out);
+   fclose(in);
+
+   fprintf(stderr, "%ld records, %u lost\n", count, hdr.lost);
+   return 0;
+}